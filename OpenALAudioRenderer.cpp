@@ -77,11 +77,12 @@ CUnknown * WINAPI COpenALFilter::CreateInstance(LPUNKNOWN pUnk, HRESULT *phr)
 #pragma warning(disable:4355 4127)
 
 COpenALFilter::COpenALFilter(LPUNKNOWN pUnk, HRESULT *phr) :
-  CBaseFilter(NAME("OpenAL Renderer"), pUnk, (CCritSec *)this, CLSID_OALRend),
-  m_mixer(NAME("OpenAL Renderer"), this, phr)
+  CBaseFilter(NAME("OpenAL Renderer"), pUnk, (CCritSec *)this, CLSID_OALRend)
 {
   ASSERT(phr);
 
+  LockStatsName(this, TEXT("Filter lock"));
+
   // Create the single input pin
   m_pInputPin = new CAudioInputPin(this, phr, L"Audio Input Pin");
   if (m_pInputPin == nullptr)
@@ -91,6 +92,29 @@ COpenALFilter::COpenALFilter(LPUNKNOWN pUnk, HRESULT *phr) :
   }
 
   m_openal_device = new COpenALStream(&m_mixer, static_cast<IBaseFilter*>(this), phr);
+  m_mixer.SetOutput(m_openal_device->GetOutput());
+
+  // Record what upstream delivers and when, for replaying it with trace_replay
+  char trace_path[MAX_PATH];
+  DWORD trace_path_length = GetEnvironmentVariableA("OPENAL_RENDERER_TRACE", trace_path, MAX_PATH);
+  if (trace_path_length > 0 && trace_path_length < MAX_PATH)
+  {
+    m_arrival_trace.Open(trace_path);
+  }
+
+  // Hot path events go to the debugger unless a file is given, as text or
+  // as a Chrome trace for a timeline viewer
+  trace_path_length = GetEnvironmentVariableA("OPENAL_RENDERER_EVENTS", trace_path, MAX_PATH);
+  if (trace_path_length > 0 && trace_path_length < MAX_PATH)
+  {
+    m_event_sink_set = CEventTrace::Get().SetOutputFile(trace_path);
+  }
+
+  trace_path_length = GetEnvironmentVariableA("OPENAL_RENDERER_CHROME_TRACE", trace_path, MAX_PATH);
+  if (trace_path_length > 0 && trace_path_length < MAX_PATH)
+  {
+    m_event_sink_set = SetChromeTraceOutput(trace_path);
+  }
 } // (Constructor)
 
   //
@@ -107,6 +131,26 @@ COpenALFilter::~COpenALFilter()
   ASSERT(m_openal_device);
   delete m_openal_device;
   m_openal_device = nullptr;
+
+  // The device drained the last events, close the file they went to
+  if (m_event_sink_set)
+  {
+    CEventTrace::Get().SetSink(nullptr);
+  }
+
+  // Append the MSR_ timing statistics of the process so far
+  char measure_path[MAX_PATH];
+  DWORD measure_path_length = GetEnvironmentVariableA("OPENAL_RENDERER_MEASURE", measure_path, MAX_PATH);
+  if (measure_path_length > 0 && measure_path_length < MAX_PATH)
+  {
+    HANDLE measure_file = CreateFileA(measure_path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+      FILE_ATTRIBUTE_NORMAL, NULL);
+    if (measure_file != INVALID_HANDLE_VALUE)
+    {
+      MSR_DUMPSTATS(measure_file);
+      CloseHandle(measure_file);
+    }
+  }
 } // (Destructor)
 
   //
@@ -290,6 +334,9 @@ CAudioInputPin::CAudioInputPin(COpenALFilter *pFilter,
   CBaseInputPin(NAME("Audio Input Pin"), pFilter, pFilter, phr, pPinName)
 {
   m_pFilter = pFilter;
+
+  LockStatsName(this, TEXT("Input pin lock"));
+  LockStatsName(&m_receiveMutex, TEXT("Input pin receive lock"));
 } // (Constructor)
 
   //
@@ -299,6 +346,85 @@ CAudioInputPin::~CAudioInputPin()
 {
 } // (Destructor)
 
+  //
+  // GetAllocator
+  //
+  // The base class allocator, rather than the one from quartz.dll, with each
+  // sample's data aligned to and padded out to cache lines, so the mixer's
+  // conversions read aligned data and no two samples share a line. The
+  // samples go on large pages with OPENAL_RENDERER_LARGE_PAGES=1, if the
+  // process may lock memory
+  //
+STDMETHODIMP CAudioInputPin::GetAllocator(IMemAllocator** ppAllocator)
+{
+  CheckPointer(ppAllocator, E_POINTER);
+  CAutoLock cObjectLock(m_pLock);
+
+  if (m_pAllocator == nullptr)
+  {
+    HRESULT hr = S_OK;
+    CMemAllocator* allocator = new CMemAllocator(NAME("Audio input allocator"), nullptr, &hr);
+    if (allocator == nullptr)
+    {
+      return E_OUTOFMEMORY;
+    }
+    allocator->AddRef();
+    if (FAILED(hr))
+    {
+      allocator->Release();
+      return hr;
+    }
+
+    char large_pages[2];
+    DWORD large_pages_length = GetEnvironmentVariableA("OPENAL_RENDERER_LARGE_PAGES", large_pages, 2);
+    hr = allocator->SetCacheFriendlyLayout(CMemAllocator::CACHE_LINE_SIZE,
+      large_pages_length == 1 && large_pages[0] == '1');
+    if (FAILED(hr))
+    {
+      allocator->Release();
+      return hr;
+    }
+
+    m_pAllocator = allocator;
+  }
+
+  *ppAllocator = m_pAllocator;
+  m_pAllocator->AddRef();
+  return NOERROR;
+} // GetAllocator
+
+  //
+  // GetAllocatorRequirements
+  //
+  // Samples of exactly one AL buffer of the connection format, as many as
+  // the sound loop queues, so the mixer doesn't have to slice them up or
+  // wait for the rest of a buffer. Only a hint, the upstream pin decides
+  //
+STDMETHODIMP CAudioInputPin::GetAllocatorRequirements(ALLOCATOR_PROPERTIES* pProps)
+{
+  CheckPointer(pProps, E_POINTER);
+  CAutoLock cObjectLock(m_pLock);
+
+  if (m_mt.IsValid() == FALSE || m_mt.FormatLength() < sizeof(WAVEFORMATEX))
+  {
+    return E_NOTIMPL;
+  }
+
+  auto wave_format = reinterpret_cast<const WAVEFORMATEX*>(m_mt.Format());
+  COpenALOutput* output = m_pFilter->m_openal_device->GetOutput();
+  uint32_t frames_per_buffer = output->getFramesPerBuffer(wave_format->nSamplesPerSec);
+  if (frames_per_buffer == 0 || wave_format->nBlockAlign == 0)
+  {
+    return E_NOTIMPL;
+  }
+
+  pProps->cBuffers = OAL_BUFFERS;
+  pProps->cbBuffer = frames_per_buffer * wave_format->nBlockAlign;
+  pProps->cbAlign = CMemAllocator::CACHE_LINE_SIZE;
+  pProps->cbPrefix = 0;
+  return S_OK;
+} // GetAllocatorRequirements
+
   //
   // BreakConnect
   //
@@ -328,112 +454,175 @@ HRESULT CAudioInputPin::BreakConnect()
   return CBaseInputPin::BreakConnect();
 } // BreakConnect
 
-HRESULT CAudioInputPin::CheckOpenALMediaType(const WAVEFORMATEX* wave_format)
+  //
+  // CheckOpenALMediaType
+  //
+  // Translate a wave format into the OpenAL stream format without touching
+  // the format currently playing. Returns S_FALSE if the device can't play it
+  //
+HRESULT CAudioInputPin::CheckOpenALMediaType(const WAVEFORMATEX* wave_format, AudioFormat* format)
 {
-  // Set frequency
-  m_pFilter->m_openal_device->setFrequency(wave_format->nSamplesPerSec);
+  CheckPointer(format, E_POINTER);
 
-  // Get supported layout
-  auto supported_bitness = m_pFilter->m_openal_device->getSupportedBitness();
+  COpenALOutput* output = m_pFilter->m_openal_device->GetOutput();
 
-  // Get supported bitness
-  auto supported_layouts = m_pFilter->m_openal_device->getSupportedSpeakerLayout();
-  bool valid_channel_layout = false;
-  bool valid_sample_type = false;
+  // Ambisonic B-Format. FuMa has its own subtypes, ACN ordered content
+  // (AmbiX) arrives as plain PCM or float without speaker positions. 9 and
+  // 16 channels without them can only be that, 4 are quad unless opted in,
+  // and quad too where OpenAL can't take ACN ordering.
+  const WAVEFORMATEXTENSIBLE* extensible = nullptr;
+  if (wave_format->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+  {
+    extensible = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(wave_format);
+  }
+
+  bool ambisonic = false;
+  AmbisonicLayout ambisonic_layout = FuMa;
+  AmbisonicScaling ambisonic_scaling = FuMaScaling;
+  if (extensible)
+  {
+    if (extensible->SubFormat == SUBTYPE_AMBISONIC_B_FORMAT_PCM ||
+      extensible->SubFormat == SUBTYPE_AMBISONIC_B_FORMAT_IEEE_FLOAT)
+    {
+      ambisonic = true;
+    }
+    else if (extensible->dwChannelMask == 0 &&
+      (wave_format->nChannels == 9 || wave_format->nChannels == 16 ||
+      (wave_format->nChannels == 4 && output->getACNFirstOrder() && output->getCapabilities().bformat_ex)))
+    {
+      ambisonic = true;
+      ambisonic_layout = ACN;
+      ambisonic_scaling = output->getACNScaling();
+    }
+  }
 
   // Normalize channels
-  COpenALStream::SpeakerLayout speaker_layout;
-  switch (wave_format->nChannels)
-  {
-  case 1:
-    speaker_layout = COpenALStream::SpeakerLayout::Mono;
-    break;
-  case 2:
-    speaker_layout = COpenALStream::SpeakerLayout::Stereo;
-    break;
-  case 4:
-    speaker_layout = COpenALStream::SpeakerLayout::Quad;
-    break;
-  case 6:
-    speaker_layout = COpenALStream::SpeakerLayout::Surround6;
-    break;
-  case 8:
-    speaker_layout = COpenALStream::SpeakerLayout::Surround8;
-    break;
-  }
-
-  if (std::any_of(supported_layouts.cbegin(), supported_layouts.cend(),
-    [speaker_layout](COpenALStream::SpeakerLayout layout) { return layout == speaker_layout; }))
-  {
-    m_pFilter->m_openal_device->setSpeakerLayout(speaker_layout);
-    valid_channel_layout = true;
+  SpeakerLayout speaker_layout;
+  if (ambisonic)
+  {
+    switch (wave_format->nChannels)
+    {
+    case 4:
+      speaker_layout = SpeakerLayout::BFormat1;
+      break;
+    case 9:
+      speaker_layout = SpeakerLayout::BFormat2;
+      break;
+    case 16:
+      speaker_layout = SpeakerLayout::BFormat3;
+      break;
+    default:
+      return S_FALSE;
+    }
   }
   else
   {
-    return S_FALSE;
+    switch (wave_format->nChannels)
+    {
+    case 1:
+      speaker_layout = SpeakerLayout::Mono;
+      break;
+    case 2:
+      speaker_layout = SpeakerLayout::Stereo;
+      break;
+    case 4:
+      speaker_layout = SpeakerLayout::Quad;
+      break;
+    case 6:
+      speaker_layout = SpeakerLayout::Surround6;
+      break;
+    case 8:
+      speaker_layout = SpeakerLayout::Surround8;
+      break;
+    default:
+      return S_FALSE;
+    }
   }
 
   // Normalize bitness
-  COpenALStream::MediaBitness media_bitness;
-  if (wave_format->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+  bool valid_sample_type = false;
+  MediaBitness media_bitness = MediaBitness::bit16;
+  if (extensible)
   {
-    auto format = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(wave_format);
-    if (format->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)
+    if (extensible->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT ||
+      extensible->SubFormat == SUBTYPE_AMBISONIC_B_FORMAT_IEEE_FLOAT)
     {
-      media_bitness = COpenALStream::MediaBitness::bitfloat;
+      media_bitness = MediaBitness::bitfloat;
+      valid_sample_type = true;
     }
-    else if (format->SubFormat == KSDATAFORMAT_SUBTYPE_PCM)
+    else if (extensible->SubFormat == KSDATAFORMAT_SUBTYPE_PCM ||
+      extensible->SubFormat == SUBTYPE_AMBISONIC_B_FORMAT_PCM)
     {
-      switch (format->Format.wBitsPerSample)
+      valid_sample_type = true;
+      switch (extensible->Format.wBitsPerSample)
       {
       case 8:
-        media_bitness = COpenALStream::MediaBitness::bit8;
+        media_bitness = MediaBitness::bit8;
         break;
       case 16:
-        media_bitness = COpenALStream::MediaBitness::bit16;
+        media_bitness = MediaBitness::bit16;
         break;
       case 24:
-        media_bitness = COpenALStream::MediaBitness::bit24;
+        media_bitness = MediaBitness::bit24;
         break;
       case 32:
-        media_bitness = COpenALStream::MediaBitness::bit32;
+        media_bitness = MediaBitness::bit32;
+        break;
+      default:
+        valid_sample_type = false;
         break;
       }
     }
   }
   else if (wave_format->wFormatTag == WAVE_FORMAT_PCM)
   {
-    auto format = reinterpret_cast<const PCMWAVEFORMAT*>(wave_format);
-    switch (format->wBitsPerSample)
+    auto pcm = reinterpret_cast<const PCMWAVEFORMAT*>(wave_format);
+    valid_sample_type = true;
+    switch (pcm->wBitsPerSample)
     {
     case 8:
-      media_bitness = COpenALStream::MediaBitness::bit8;
+      media_bitness = MediaBitness::bit8;
       break;
     case 16:
-      media_bitness = COpenALStream::MediaBitness::bit16;
+      media_bitness = MediaBitness::bit16;
       break;
     case 24:
-      media_bitness = COpenALStream::MediaBitness::bit24;
+      media_bitness = MediaBitness::bit24;
       break;
     case 32:
-      media_bitness = COpenALStream::MediaBitness::bit32;
+      media_bitness = MediaBitness::bit32;
+      break;
+    default:
+      valid_sample_type = false;
       break;
     }
   }
-
-  if (std::any_of(supported_bitness.cbegin(), supported_bitness.cend(),
-    [media_bitness](COpenALStream::MediaBitness bitness) { return bitness == media_bitness; }))
+  else if (wave_format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT && wave_format->wBitsPerSample == 32)
   {
-    m_pFilter->m_openal_device->setBitness(media_bitness);
+    media_bitness = MediaBitness::bitfloat;
     valid_sample_type = true;
   }
 
-  if (valid_channel_layout && valid_sample_type)
+  if (!valid_sample_type)
   {
-    return S_OK;
+    return S_FALSE;
+  }
+
+  AudioFormat candidate;
+  candidate.frequency = wave_format->nSamplesPerSec;
+  candidate.speaker_layout = speaker_layout;
+  candidate.bitness = media_bitness;
+  candidate.ambisonic_layout = ambisonic_layout;
+  candidate.ambisonic_scaling = ambisonic_scaling;
+
+  // Check if our OpenAL device plays it, directly or converted
+  if (!output->isFormatSupported(candidate))
+  {
+    return S_FALSE;
   }
 
-  return S_FALSE;
+  *format = candidate;
+  return S_OK;
 }
 
 //
@@ -468,27 +657,9 @@ HRESULT CAudioInputPin::CheckMediaType(const CMediaType *pmt)
     return S_FALSE;
   }
 
-  m_pFilter->m_mixer.m_is_float = (pwfx->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
-  if (m_pFilter->m_mixer.m_is_float == false)
-  {
-    if (pwfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
-    {
-      auto format = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(pwfx);
-      if (format->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)
-      {
-        m_pFilter->m_mixer.m_is_float = true;
-      }
-    }
-  }
-
   // Check if our OpenAL driver supports it
-  auto hr = CheckOpenALMediaType(pwfx);
-  if (SUCCEEDED(hr))
-  {
-    return hr;
-  }
-
-  return S_FALSE;
+  AudioFormat format;
+  return CheckOpenALMediaType(pwfx, &format);
 } // CheckMediaType
 
   //
@@ -508,15 +679,22 @@ HRESULT CAudioInputPin::SetMediaType(const CMediaType *pmt)
   {
     auto pwf = reinterpret_cast<const WAVEFORMATEX*>(pmt->Format());
 
-    m_pFilter->m_mixer.m_nChannels = pwf->nChannels;
-    m_pFilter->m_mixer.m_nSamplesPerSec = pwf->nSamplesPerSec;
-    m_pFilter->m_mixer.m_nBitsPerSample = pwf->wBitsPerSample;
-    m_pFilter->m_mixer.m_nBlockAlign = pwf->nBlockAlign;
-    m_pFilter->m_mixer.m_is_float = (pwf->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
-
-    auto hrr = CheckOpenALMediaType(pwf);
-    if (SUCCEEDED(hrr))
+    // The mixer switches the device format once the data already
+    // queued in the previous format has been played
+    AudioFormat format;
+    auto hrr = CheckOpenALMediaType(pwf, &format);
+    if (hrr == S_OK)
     {
+      m_pFilter->m_mixer.SetFormat(format);
+
+      if (m_pFilter->m_arrival_trace.IsOpen())
+      {
+        ArrivalEvent event;
+        event.type = ArrivalFormat;
+        event.time = m_pFilter->m_arrival_trace.GetTime();
+        event.format = format;
+        m_pFilter->m_arrival_trace.Write(event);
+      }
       return hrr;
     }
   }
@@ -551,6 +729,9 @@ HRESULT CAudioInputPin::Inactive(void)
   //
 HRESULT CAudioInputPin::Receive(IMediaSample * pSample)
 {
+  // When upstream delivered, before we possibly block it
+  int64_t arrival_time = m_pFilter->m_arrival_trace.GetTime();
+
   // Lock this with the filter-wide lock
   CAutoLock receive_lock(&m_receiveMutex);
 
@@ -573,290 +754,198 @@ HRESULT CAudioInputPin::Receive(IMediaSample * pSample)
 
     if (m_SampleProps.dwSampleFlags & AM_SAMPLE_TYPECHANGED)
     {
-      // TODO: don't recreate the device when possible
-      //m_renderer.Finish(false, &m_bufferFilled);
+      // Samples already queued keep playing in the old format, the
+      // mixer switches over when it reaches this sample.
       hr = SetMediaType(static_cast<CMediaType*>(m_SampleProps.pMediaType));
       if (FAILED(hr))
       {
         return hr;
       }
-
-      // Clear queues
-      m_pFilter->m_mixer.m_sample_queue.clear();
     }
 
     //if (m_eosUp)
     //  return S_FALSE;
-  }
-
-  // Send the sample to the video window object for rendering
-  return m_pFilter->m_mixer.Receive(pSample);
-} // Receive
-
-STDMETHODIMP CAudioInputPin::EndOfStream()
-{
-  //m_pFilter->m_flush = true;
-
-  m_pFilter->NotifyEvent(EC_COMPLETE, S_OK, (LONG_PTR)m_pFilter);
-  return S_OK;
-}
-
-STDMETHODIMP CAudioInputPin::BeginFlush()
-{
-  // Parent method locks the object before modifying it, all is good.
-  CBaseInputPin::BeginFlush();
-
-  // Barrier for any present Receive() and EndOfStream() calls.
-  // Subsequent ones will be rejected because m_bFlushing == TRUE.
-  CAutoLock receiveLock(&m_receiveMutex);
-
-  m_pFilter->m_mixer.m_sample_queue.clear();
-
-  return S_OK;
-}
-
-STDMETHODIMP CAudioInputPin::EndFlush()
-{
-  // Parent method locks the object before modifying it, all is good.
-  CBaseInputPin::EndFlush();
-
-  return S_OK;
-}
 
-STDMETHODIMP CAudioInputPin::ReceiveCanBlock()
-{
-  return S_OK;
-}
-
-//
-// CMixer Constructor
-//
-CMixer::CMixer(TCHAR *pName, COpenALFilter *pRenderer, HRESULT *phr) :
-  m_hInstance(g_hInst),
-  m_pRenderer(pRenderer),
-  m_bStreaming(false),
-  m_LastMediaSampleSize(0)
-{
-  ASSERT(m_pRenderer);
-} // (Constructor)
-
-  //
-  // Destructor
-  //
-CMixer::~CMixer()
-{
-  // Ensure we stop streaming and release any samples
-
-  StopStreaming();
-} // (Destructor)
-
-  //
-  // StartStreaming
-  //
-  // This is called when we start running state
-  //
-HRESULT CMixer::StartStreaming()
-{
-  CAutoLock cAutoLock(this);
-
-  // Are we already streaming
+    if (m_pFilter->m_arrival_trace.IsOpen())
+    {
+      ArrivalEvent event;
+      event.type = ArrivalSample;
+      event.time = arrival_time;
+      event.start = m_SampleProps.tStart;
+      event.stop = m_SampleProps.tStop;
+      event.length = static_cast<uint32_t>(pSample->GetActualDataLength());
+      event.flags = m_SampleProps.dwSampleFlags;
+      m_pFilter->m_arrival_trace.Write(event);
+    }
+  }
 
-  if (m_bStreaming == true)
+  // Hand the sample data to the mixer
+  BYTE* data = nullptr;
+  HRESULT hr = pSample->GetPointer(&data);
+  if (FAILED(hr))
   {
-    return NOERROR;
+    return hr;
   }
 
-  m_bStreaming = true;
+  m_pFilter->m_mixer.Receive(data, pSample->GetActualDataLength());
   return NOERROR;
-} // StartStreaming
+} // Receive
 
   //
-  // StopStreaming
+  // ReceiveMultiple
   //
-  // This is called when we stop streaming
+  // Checks a batch of samples under one pin lock and queues them in the
+  // mixer together, which wakes the output once. A format change splits the
+  // batch, the samples before it are queued in the old format first
   //
-HRESULT CMixer::StopStreaming()
-{
-  CAutoLock cAutoLock(this);
-
-  // Have we been stopped already
-
-  if (m_bStreaming == false)
-  {
-    return NOERROR;
-  }
-
-  m_bStreaming = false;
-  return NOERROR;
-} // StopStreaming
-
-bool CMixer::IsStreaming()
-{
-  return m_bStreaming;
-}
-
-//
-// CopyWaveformToBuffer
-//
-// Little endian?
-
-void CMixer::CopyWaveform(IMediaSample *pMediaSample)
+STDMETHODIMP CAudioInputPin::ReceiveMultiple(IMediaSample** pSamples, long nSamples, long* nSamplesProcessed)
 {
-  //waitobject
-  constexpr size_t bits_per_byte = 8;
-  BYTE *pWave;                // Pointer to image data
-  int  nBytes;
+  CheckPointer(pSamples, E_POINTER);
+  CheckPointer(nSamplesProcessed, E_POINTER);
 
-  ASSERT(pMediaSample);
-  if (!pMediaSample)
-    return;
+  int64_t arrival_time = m_pFilter->m_arrival_trace.GetTime();
 
-  pMediaSample->GetPointer(&pWave);
-  ASSERT(pWave != nullptr);
-
-  nBytes = pMediaSample->GetActualDataLength();
-  nBytes = nBytes - nBytes % (m_nChannels * m_nBitsPerSample / bits_per_byte);
+  CAutoLock receive_lock(&m_receiveMutex);
 
-  size_t pushed_bytes = 0;
-  BYTE* pb = pWave;
+  HRESULT hr = S_OK;
+  long queued = 0;
+  // m_SampleProps holds the format change of pSamples[queued], checked but
+  // not yet applied
+  bool type_change_pending = false;
+  while (queued < nSamples)
   {
-    uint8_t value = 0;
-    for (int i = 0; i < nBytes; ++i)
+    m_batch.clear();
+    long next = queued;
     {
-      value = *pb++;
-      m_sample_queue.push(value);
-      ++pushed_bytes;
-    }
-  }
+      CAutoLock object_lock(this);
 
-  // Locking between inbound samples and the mixer
-  m_rendered_samples = pushed_bytes / m_nChannels / m_nBitsPerSample * bits_per_byte;
-
-  //std::ostringstream string;
-  //string << "Size of the queue: " << pushed_bytes / m_nChannels / m_nBitsPerSample * bits_per_byte << " frames.\n";
-  //OutputDebugStringA(string.str().c_str());
+      if (m_pFilter->m_State == State_Stopped)
+      {
+        hr = VFW_E_WRONG_STATE;
+        break;
+      }
 
-  m_samples_ready = true;
-  m_samples_ready_cv.notify_one();
+      for (; next < nSamples; next++)
+      {
+        IMediaSample* pSample = pSamples[next];
+        if (type_change_pending)
+        {
+          type_change_pending = false;
+        }
+        else
+        {
+          // S_FALSE while flushing or stopping, the sample is not taken and
+          // m_SampleProps is not its
+          hr = CBaseInputPin::Receive(pSample);
+          if (hr != S_OK)
+          {
+            break;
+          }
+          if ((m_SampleProps.dwSampleFlags & AM_SAMPLE_TYPECHANGED) && next > queued)
+          {
+            type_change_pending = true;
+            break;
+          }
+        }
+
+        if (m_SampleProps.dwSampleFlags & AM_SAMPLE_TYPECHANGED)
+        {
+          hr = SetMediaType(static_cast<CMediaType*>(m_SampleProps.pMediaType));
+          if (FAILED(hr))
+          {
+            break;
+          }
+        }
+
+        if (m_pFilter->m_arrival_trace.IsOpen())
+        {
+          ArrivalEvent event;
+          event.type = ArrivalSample;
+          event.time = arrival_time;
+          event.start = m_SampleProps.tStart;
+          event.stop = m_SampleProps.tStop;
+          event.length = static_cast<uint32_t>(pSample->GetActualDataLength());
+          event.flags = m_SampleProps.dwSampleFlags;
+          m_pFilter->m_arrival_trace.Write(event);
+        }
+
+        BYTE* data = nullptr;
+        hr = pSample->GetPointer(&data);
+        if (FAILED(hr))
+        {
+          break;
+        }
+        m_batch.push_back({ data, static_cast<size_t>(pSample->GetActualDataLength()) });
+      }
+    }
 
-  {
-    std::unique_lock<std::mutex> lk_rs(m_request_samples_mutex);
-    while (m_request_samples == false)
+    // Hand the sample data to the mixer
+    if (!m_batch.empty())
     {
-      // Wait for only 500 ms, just in case
-      m_request_samples_cv.wait_for(lk_rs, std::chrono::milliseconds(500));
+      m_pFilter->m_mixer.ReceiveMultiple(m_batch.data(), m_batch.size());
     }
+    queued += static_cast<long>(m_batch.size());
 
-    // We already delivered them, set it back to false
-    m_request_samples = false;
+    // Like the base class, stop at the first sample not received
+    if (hr != S_OK)
+    {
+      break;
+    }
   }
-} // CopyWaveform
 
-//
-// Receive
-//
-// Called when the input pin receives another sample.
-// Copy the waveform to our circular 1 second buffer
-//
-HRESULT CMixer::Receive(IMediaSample *pSample)
-{
-  CheckPointer(pSample, E_POINTER);
-  CAutoLock cAutoLock(this);
-  ASSERT(pSample != nullptr);
-
-  REFERENCE_TIME tStart, tStop;
-  pSample->GetTime(&tStart, &tStop);
+  *nSamplesProcessed = queued;
+  return hr;
+} // ReceiveMultiple
 
-  // Ignore zero-length samples
-  if ((m_LastMediaSampleSize = pSample->GetActualDataLength()) == 0)
-    return NOERROR;
+STDMETHODIMP CAudioInputPin::EndOfStream()
+{
+  //m_pFilter->m_flush = true;
 
-  if (m_bStreaming == true)
+  if (m_pFilter->m_arrival_trace.IsOpen())
   {
-    CopyWaveform(pSample);     // Copy data to our circular buffer
-
-    return NOERROR;
+    ArrivalEvent event;
+    event.type = ArrivalEndOfStream;
+    event.time = m_pFilter->m_arrival_trace.GetTime();
+    m_pFilter->m_arrival_trace.Write(event);
   }
 
-  return NOERROR;
-} // Receive
+  m_pFilter->NotifyEvent(EC_COMPLETE, S_OK, (LONG_PTR)m_pFilter);
+  return S_OK;
+}
 
-HRESULT CMixer::WaitForFrames(size_t num_of_bits)
+STDMETHODIMP CAudioInputPin::BeginFlush()
 {
-  if (m_bStreaming)
-  {
-    std::unique_lock<std::mutex> lk(m_samples_ready_mutex);
-    while (!m_samples_ready)
-    {
-      if (!m_bStreaming)
-      {
-        return E_FAIL;
-      }
-
-      // Check of bitness changed
-      if (num_of_bits != m_nBitsPerSample)
-      {
-        return E_FAIL;
-      }
+  // Parent method locks the object before modifying it, all is good.
+  CBaseInputPin::BeginFlush();
 
-      // Re-check everything after 30 ms
-      m_samples_ready_cv.wait_for(lk, std::chrono::milliseconds(30));
-    }
+  // Barrier for any present Receive() and EndOfStream() calls.
+  // Subsequent ones will be rejected because m_bFlushing == TRUE.
+  CAutoLock receiveLock(&m_receiveMutex);
 
-    // We already received them
-    m_samples_ready = false;
+  m_pFilter->m_mixer.Flush();
 
-    return S_OK;
-  }
-  else
+  if (m_pFilter->m_arrival_trace.IsOpen())
   {
-    return E_FAIL;
+    ArrivalEvent event;
+    event.type = ArrivalFlush;
+    event.time = m_pFilter->m_arrival_trace.GetTime();
+    m_pFilter->m_arrival_trace.Write(event);
   }
+
+  return S_OK;
 }
 
-size_t CMixer::Mix(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample)
+STDMETHODIMP CAudioInputPin::EndFlush()
 {
-  if (!samples)
-    return 0;
-
-  // 2 = stereo
-  // 6 = 5.1
-  m_desired_bytes = num_frames * m_nChannels * num_bytes_per_sample;
-  samples->resize(m_desired_bytes);
-
-  // Wait for queue to fill
-  size_t effective_samples = 0;
-
-  // Still need to check EOS
-  bool all_ok = false;
-  while (m_sample_queue.unsafe_size() < m_desired_bytes) //&& m_notEOS)
-  {
-    m_request_samples = true;
-    m_request_samples_cv.notify_one();
-
-    constexpr size_t bits_per_byte = 8;
-    if (WaitForFrames(num_bytes_per_sample * bits_per_byte) == S_OK)
-    {
-      all_ok = true;
-    }
-    else
-    {
-      break;
-    }
-  }
+  // Parent method locks the object before modifying it, all is good.
+  CBaseInputPin::EndFlush();
 
-  for (size_t i = 0; i < m_desired_bytes; ++i)
-  {
-    int8_t value = 0;
-    if (m_sample_queue.try_pop(value))
-    {
-      (*samples)[i] = value;
-    }
-  }
-  // Set EOS samples here
-  effective_samples = m_desired_bytes / num_bytes_per_sample;
+  return S_OK;
+}
 
-  return effective_samples / m_nChannels;
+STDMETHODIMP CAudioInputPin::ReceiveCanBlock()
+{
+  return S_OK;
 }
 
 ////////////////////////////////////////////////////////////////////////
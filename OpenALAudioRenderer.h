@@ -6,31 +6,39 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 //------------------------------------------------------------------------------
 
-#include <concurrent_queue.h>
-#include <vector>
-#include <condition_variable>
+#include <atomic>
 #include <comdef.h>
 
 #include "OpenALStream.h"
+#include "core/ArrivalTrace.h"
+#include "core/ChromeTrace.h"
+#include "core/EventTrace.h"
+#include "core/Mixer.h"
 
 // {25B8D696-1510-49BF-A0C3-E38FAFD54782}
 DEFINE_GUID(CLSID_OALRend,
   0x25b8d696, 0x1510, 0x49bf, 0xa0, 0xc3, 0xe3, 0x8f, 0xaf, 0xd5, 0x47, 0x82);
 
+// Ambisonic B-Format wave subtypes, FuMa ordering and scaling (ksmedia.h)
+// {00000001-0721-11D3-8644-C8C1CA000000}
+DEFINE_GUID(SUBTYPE_AMBISONIC_B_FORMAT_PCM,
+  0x00000001, 0x0721, 0x11d3, 0x86, 0x44, 0xc8, 0xc1, 0xca, 0x00, 0x00, 0x00);
+// {00000003-0721-11D3-8644-C8C1CA000000}
+DEFINE_GUID(SUBTYPE_AMBISONIC_B_FORMAT_IEEE_FLOAT,
+  0x00000003, 0x0721, 0x11d3, 0x86, 0x44, 0xc8, 0xc1, 0xca, 0x00, 0x00, 0x00);
+
 class COpenALFilter;
-class CMixer;
-class COpenALOutput;
 
 class CAudioInputPin : public CCritSec, public CBaseInputPin
 {
   friend class COpenALFilter;
-  friend class CMixer;
 
 private:
 
-  HRESULT CheckOpenALMediaType(const WAVEFORMATEX* wave_format);
+  HRESULT CheckOpenALMediaType(const WAVEFORMATEX* wave_format, AudioFormat* format);
   COpenALFilter *m_pFilter;         // The filter that owns us
   CCritSec m_receiveMutex;
+  std::vector<AudioBlock> m_batch;  // ReceiveMultiple's, under m_receiveMutex
 
   std::atomic<bool> m_startEOS = false;
   std::atomic<bool> m_stopEOS = false;
@@ -53,6 +61,11 @@ public:
 
   // IMemInputPin virtual methods
 
+  // Offer our own allocator with cache line aligned samples
+  STDMETHODIMP GetAllocator(IMemAllocator** ppAllocator) override;
+  // Ask for samples of whole AL buffers
+  STDMETHODIMP GetAllocatorRequirements(ALLOCATOR_PROPERTIES* pProps) override;
+
   // Override so we can show and hide the window
   HRESULT Active(void) override;
   HRESULT Inactive(void) override;
@@ -60,6 +73,7 @@ public:
   // Here's the next block of data from the stream.
   // AddRef it if you are going to hold onto it
   STDMETHODIMP Receive(IMediaSample* pSample) override;
+  STDMETHODIMP ReceiveMultiple(IMediaSample** pSamples, long nSamples, long* nSamplesProcessed) override;
   STDMETHODIMP EndOfStream() override;
   STDMETHODIMP ReceiveCanBlock() override;
   STDMETHODIMP BeginFlush() override;
@@ -67,59 +81,6 @@ public:
 
 }; // CAudioInputPin
 
-class CMixer : public CCritSec
-{
-  friend class CAudioInputPin;
-  friend class COpenALFilter;
-
-private:
-
-  HINSTANCE m_hInstance;          // Global module instance handle
-  COpenALFilter* m_pRenderer;     // The owning renderer object
-
-  std::atomic<bool> m_bStreaming; // Are we currently streaming
-
-  int m_LastMediaSampleSize;      // Size of last MediaSample
-
-  int m_nChannels;                // number of active channels
-  int m_nSamplesPerSec;           // Samples per second
-  int m_nBitsPerSample;           // Number bits per sample
-  bool m_is_float;
-  int m_nBlockAlign;              // Alignment on the samples
-  size_t m_desired_bytes = 0;
-
-  void CopyWaveform(IMediaSample *pMediaSample);
-  HRESULT CMixer::WaitForFrames(size_t num_of_bits);
-
-  concurrency::concurrent_queue<int8_t> m_sample_queue;
-
-  // Locking between inbound samples and the mixer
-  std::atomic<size_t> m_rendered_samples = 0;
-
-  std::atomic<bool> m_samples_ready = false;
-  std::mutex m_samples_ready_mutex;
-  std::condition_variable m_samples_ready_cv;
-
-  std::atomic<bool> m_request_samples = false;
-  std::mutex m_request_samples_mutex;
-  std::condition_variable m_request_samples_cv;
-
-public:
-
-  // Constructors and destructors
-
-  CMixer(TCHAR *pName, COpenALFilter *pRenderer, HRESULT *phr);
-  virtual ~CMixer();
-
-  HRESULT StartStreaming();
-  HRESULT StopStreaming();
-  bool IsStreaming();
-
-  // Called when the input pin receives a sample
-  HRESULT Receive(IMediaSample* pIn);
-  size_t Mix(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample);
-}; // CMixer
-
    // This is the COM object that represents the oscilloscope filter
 
 class COpenALFilter : public CBaseFilter, public CCritSec
@@ -158,11 +119,11 @@ private:
 
   // The nested classes may access our private state
   friend class CAudioInputPin;
-  friend class CMixer;
-  friend class COpenALOutput;
 
   CAudioInputPin *m_pInputPin;   // Handles pin interfaces
-  CMixer m_mixer;                // Looks after the window
+  CMixer m_mixer;                // Queues the samples for the OpenAL output
+  CArrivalTraceWriter m_arrival_trace; // Set OPENAL_RENDERER_TRACE to record
+  bool m_event_sink_set = false;  // Event trace redirected to a file by us
   IUnknownPtr m_seeking;
 
 }; // COpenALFilter
\ No newline at end of file
@@ -5,119 +5,25 @@
 #ifdef _WIN32
 
 #include <windows.h>
-#include <sstream>
-#include <thread>
-#include <vector>
+#include <cmath>
+#include <cstdlib>
 
 #include "OpenALStream.h"
-#include "OpenALAudioRenderer.h"
-
-static HMODULE s_openal_dll = nullptr;
-
-#define OPENAL_API_VISIT(X)                                                                        \
-  X(alBufferData)                                                                                  \
-  X(alcCloseDevice)                                                                                \
-  X(alcCreateContext)                                                                              \
-  X(alcDestroyContext)                                                                             \
-  X(alcGetContextsDevice)                                                                          \
-  X(alcGetCurrentContext)                                                                          \
-  X(alcGetString)                                                                                  \
-  X(alcIsExtensionPresent)                                                                         \
-  X(alcMakeContextCurrent)                                                                         \
-  X(alcOpenDevice)                                                                                 \
-  X(alDeleteBuffers)                                                                               \
-  X(alDeleteSources)                                                                               \
-  X(alGenBuffers)                                                                                  \
-  X(alGenSources)                                                                                  \
-  X(alGetError)                                                                                    \
-  X(alGetSourcei)                                                                                  \
-  X(alGetString)                                                                                   \
-  X(alIsExtensionPresent)                                                                          \
-  X(alSourcef)                                                                                     \
-  X(alSourcei)                                                                                     \
-  X(alSourcePlay)                                                                                  \
-  X(alSourceQueueBuffers)                                                                          \
-  X(alSourceStop)                                                                                  \
-  X(alSourceUnqueueBuffers)                                                                        \
-  X(alGetEnumValue)                                                                                \
-  X(alIsSource)                                                                                    \
-  X(alGetSourcef)
-
-// Create func_t function pointer type and declare a nullptr-initialized static variable of that
-// type named "pfunc".
-#define DYN_FUNC_DECLARE(func)                                                                     \
-  typedef decltype(&func) func##_t;                                                                \
-  static func##_t p##func = nullptr;
-
-// Attempt to load the function from the given module handle.
-#define OPENAL_FUNC_LOAD(func)                                                                     \
-  p##func = (func##_t)::GetProcAddress(s_openal_dll, #func);                                       \
-  if (!p##func)                                                                                    \
-  {                                                                                                \
-    return false;                                                                                  \
-  }
-
-OPENAL_API_VISIT(DYN_FUNC_DECLARE);
-
-static bool InitFunctions()
-{
-  OPENAL_API_VISIT(OPENAL_FUNC_LOAD);
-  return true;
-}
-
-static bool InitLibrary()
-{
-  if (s_openal_dll)
-    return true;
-
-  s_openal_dll = ::LoadLibrary(TEXT("openal32.dll"));
-  if (!s_openal_dll)
-    return false;
-
-  if (!InitFunctions())
-  {
-    ::FreeLibrary(s_openal_dll);
-    s_openal_dll = nullptr;
-    return false;
-  }
-
-  return true;
-}
-
-STDMETHODIMP COpenALStream::isValid()
-{
-  if (InitLibrary())
-  {
-    return S_OK;
-  }
-  else
-  {
-    return E_FAIL;
-  }
-}
 
 COpenALStream::~COpenALStream(void)
 {
+  // Also terminates the sound loop thread
   CloseDevice();
-
-  // Finally Terminate thread
-  if (m_thread.joinable())
-  {
-    m_thread.join();
-  }
 }
 
-COpenALStream::COpenALStream(CMixer* audioMixer, LPUNKNOWN pUnk, HRESULT * phr)
+COpenALStream::COpenALStream(IAudioSource* audioMixer, LPUNKNOWN pUnk, HRESULT * phr)
   : CBaseReferenceClock(NAME("OpenAL Stream Clock"), pUnk, phr),
   CBasicAudio(L"OpenAL Volume Setting", pUnk),
+  m_output(audioMixer),
   m_pCurrentRefClock(0), m_pPrevRefClock(0)
 {
-  EXECUTE_ASSERT(SUCCEEDED(isValid()));
-
   EXECUTE_ASSERT(SUCCEEDED(OpenDevice()));
 
-  m_mixer = audioMixer;
-
   // last time we reported
   m_dwLastMet = 0;
 
@@ -137,7 +43,19 @@ COpenALStream::COpenALStream(CMixer* audioMixer, LPUNKNOWN pUnk, HRESULT * phr)
   m_dwLastTGT = m_dwPrevSystemTime;
 
   // We start off assuming the clock is running at normal speed
-  m_msPerTick = m_latency / num_buffers;
+  m_msPerTick = m_output.getLatency() / OAL_BUFFERS;
+
+  LockStatsName(static_cast<CBaseReferenceClock*>(this), TEXT("Reference clock lock"));
+  LockStatsName(&m_csClock, TEXT("Stream clock lock"));
+
+  // Spin the last microseconds before an advise time, trading CPU for
+  // wake-up accuracy
+  char spin[32];
+  DWORD spin_length = GetEnvironmentVariableA("OPENAL_RENDERER_ADVISE_SPIN_US", spin, sizeof(spin));
+  if (spin_length > 0 && spin_length < sizeof(spin))
+  {
+    SetAdviseSpinTime(_atoi64(spin) * 10);
+  }
 
   DbgLog((LOG_TRACE, 1, TEXT("Creating clock at ref tgt=%d"), m_LastTickTime));
 }
@@ -282,102 +200,26 @@ void COpenALStream::ClockController(HDRVR hdrvr, DWORD_PTR dwUser, DWORD_PTR dw2
   //pFilter->m_SamplesSinceTick += len;
 }
 
-//
-// AyuanX: Spec says OpenAL1.1 is thread safe already
-//
-
-std::vector<std::string> GetAllDevices()
-{
-  std::vector<std::string> devices_names_list;
-  ALint device_index = 0;
-  const ALchar* device_names = palcGetString(nullptr, ALC_ALL_DEVICES_SPECIFIER);
-
-  while (device_names && *device_names)
-  {
-    std::string name = device_names;
-    devices_names_list.push_back(name);
-    device_index++;
-    device_names += strlen(device_names) + 1;
-  }
-
-  return devices_names_list;
-}
-
 STDMETHODIMP COpenALStream::OpenDevice(void)
 {
-  if (!palcIsExtensionPresent(nullptr, "ALC_ENUMERATION_EXT"))
-  {
-    OutputDebugStringA("OpenAL: can't find sound devices\n");
-    return E_FAIL;
-  }
-
-  const char* default_device = palcGetString(nullptr, ALC_DEFAULT_DEVICE_SPECIFIER);
-
-  if (!strlen(default_device))
-  {
-    OutputDebugStringA("No device found.\n");
-    return E_FAIL;
-  }
-
-  std::vector<std::string> devices = GetAllDevices();
-
-  {
-    std::ostringstream string;
-    string << "Found OpenAL device \"" << devices[0].c_str() << "\"." << std::endl;
-    OutputDebugStringA(string.str().c_str());
-  }
-
-  ALCdevice* device = palcOpenDevice(devices[0].c_str());
-  if (!device)
-  {
-    std::ostringstream string;
-    string << "OpenAL: can't open device " << devices[0].c_str() << std::endl;
-    OutputDebugStringA(string.str().c_str());
-    return E_FAIL;
-  }
-
-  ALCcontext* context = palcCreateContext(device, nullptr);
-  if (!context)
-  {
-    palcCloseDevice(device);
-    std::ostringstream string;
-    string << "OpenAL: can't create context for device " << devices[0].c_str() << std::endl;
-    OutputDebugStringA(string.str().c_str());
-    return E_FAIL;
-  }
-
-  palcMakeContextCurrent(context);
-  return S_OK;
+  return m_output.OpenDevice() ? S_OK : E_FAIL;
 }
 
 STDMETHODIMP COpenALStream::CloseDevice(void)
 {
-  StopDevice();
-  Destroy();
+  m_output.CloseDevice();
 
   return S_OK;
 }
 
 STDMETHODIMP COpenALStream::StartDevice(void)
 {
-  if (m_run_thread == false)
-  {
-    // Terminate older thread, if it exists
-    if (m_thread.joinable())
-    {
-      m_thread.join();
-    }
-
-    m_run_thread = true;
-    m_thread = std::thread(&COpenALStream::SoundLoop, this);
-  }
-
-  return S_OK;
+  return m_output.StartDevice() ? S_OK : E_FAIL;
 }
 
 STDMETHODIMP COpenALStream::StopDevice(void)
 {
-  m_run_thread = false;
+  m_output.StopDevice();
 
   return S_OK;
 }
@@ -391,8 +233,7 @@ STDMETHODIMP COpenALStream::put_Volume(long volume)
   float f = (volume == 0) ?
     1.0f : pow(10.0f, (float)volume / 2000.0f);
 
-  m_volume = f;
-  palSourcef(m_source, AL_GAIN, m_volume);
+  m_output.setVolume(f);
 
   return S_OK;
 }
@@ -401,11 +242,7 @@ STDMETHODIMP COpenALStream::get_Volume(long* pVolume)
 {
   CheckPointer(pVolume, E_POINTER);
 
-  float f = m_volume;
-  if (palIsSource(m_source))
-  {
-    palGetSourcef(m_source, AL_GAIN, &f);
-  }
+  float f = m_output.getVolume();
 
   *pVolume = (f == 1.0f) ?
     0 : (long)(log10(f) * 2000.0f);
@@ -438,88 +275,6 @@ STDMETHODIMP COpenALStream::get_Balance(long* pBalance)
   return S_OK;
 }
 
-void COpenALStream::Destroy()
-{
-  ALCcontext* context = palcGetCurrentContext();
-
-  if (context != nullptr)
-  {
-    if (palIsSource(m_source))
-    {
-      palSourceStop(m_source);
-      palSourcei(m_source, AL_BUFFER, 0);
-
-      // Clean up buffers and sources
-      palDeleteSources(1, &m_source);
-      m_source = 0;
-      palDeleteBuffers(num_buffers, m_buffers.data());
-    }
-
-    ALCdevice* device = palcGetContextsDevice(context);
-
-    palcMakeContextCurrent(nullptr);
-    palcDestroyContext(context);
-    palcCloseDevice(device);
-  }
-}
-
-ALenum COpenALStream::CheckALError(std::string desc)
-{
-  ALenum err = palGetError();
-
-  if (err != AL_NO_ERROR)
-  {
-    std::ostringstream string_stream;
-    string_stream << "Error " << desc.c_str() << ": " << palGetString(err) << std::endl;
-    OutputDebugStringA(string_stream.str().c_str());
-  }
-
-  return err;
-}
-
-HRESULT COpenALStream::Stop()
-{
-  palSourceStop(m_source);
-  palSourcei(m_source, AL_BUFFER, 0);
-  m_total_buffered = 0;
-  OutputDebugStringA("Stopped, cleared buffers.\n");
-
-  return S_OK;
-}
-
-HRESULT COpenALStream::setSpeakerLayout(SpeakerLayout layout)
-{
-  m_speaker_layout = layout;
-  return S_OK;
-}
-
-COpenALStream::SpeakerLayout COpenALStream::getSpeakerLayout()
-{
-  return m_speaker_layout;
-}
-
-HRESULT COpenALStream::setFrequency(uint32_t frequency)
-{
-  m_frequency = frequency;
-  return S_OK;
-}
-
-uint32_t COpenALStream::getFrequency()
-{
-  return m_frequency;
-}
-
-HRESULT COpenALStream::setBitness(MediaBitness bitness)
-{
-  m_bitness = bitness;
-  return S_OK;
-}
-
-COpenALStream::MediaBitness COpenALStream::getBitness()
-{
-  return m_bitness;
-}
-
 DWORD COpenALStream::MetGetTime(void)
 {
   // Don't let anybody change our time variables on us while we're using them
@@ -557,354 +312,9 @@ DWORD COpenALStream::MetGetTime(void)
   return dw;
 }
 
-void COpenALStream::SetVolume(int volume)
-{
-  m_volume = (float)volume / 100.0f;
-
-  if (m_source)
-    palSourcef(m_source, AL_GAIN, m_volume);
-}
-
-static bool IsCreativeXFi()
-{
-  return strstr(palGetString(AL_RENDERER), "X-Fi") != nullptr;
-}
-
-std::vector<COpenALStream::MediaBitness> COpenALStream::getSupportedBitness()
-{
-  std::vector<MediaBitness> supported_bitness;
-
-  if (palIsExtensionPresent("AL_EXT_float32"))
-  {
-    supported_bitness.push_back(bitfloat);
-  }
-
-  if (IsCreativeXFi())
-  {
-    supported_bitness.push_back(bit32);
-  }
-
-  // All implementation support 16-bit and 8-bit
-  supported_bitness.push_back(bit16);
-  supported_bitness.push_back(bit8);
-
-  return supported_bitness;
-}
-
-std::vector<COpenALStream::SpeakerLayout> COpenALStream::getSupportedSpeakerLayout()
-{
-  std::vector<SpeakerLayout> supported_layouts;
-  bool surround_capable = palIsExtensionPresent("AL_EXT_MCFORMATS") || IsCreativeXFi();
-
-  if (surround_capable)
-  {
-    supported_layouts.push_back(Surround8);
-    supported_layouts.push_back(Surround6);
-  }
-
-  supported_layouts.push_back(Quad);
-  supported_layouts.push_back(Stereo);
-  supported_layouts.push_back(Mono);
-
-  return supported_layouts;
-}
-
-REFERENCE_TIME COpenALStream::getSampleTime()
-{
-  size_t total_played = m_total_buffered * 1000;
-  total_played /= m_frequency;
-
-  // Subtract played
-  float offset = 0;
-  if (m_source)
-  {
-    palGetSourcef(m_source, AL_SEC_OFFSET, &offset);
-    offset *= 1000;
-    if (offset < total_played)
-      total_played -= static_cast<size_t>(offset);
-  }
-
-  std::ostringstream string;
-  string << "Buffered time in milliseconds: " << total_played << "." << std::endl;
-  OutputDebugStringA(string.str().c_str());
-
-  return total_played;
-}
-
-HRESULT COpenALStream::resetSampleTime()
-{
-  m_total_buffered = 0;
-  return S_OK;
-}
-
-std::string GenerateFormatString(COpenALStream::SpeakerLayout speaker_layout, COpenALStream::MediaBitness bitness)
-{
-  std::string result = "AL_FORMAT_";
-
-  switch (speaker_layout)
-  {
-  case COpenALStream::SpeakerLayout::Mono:
-    result.append("MONO");
-    break;
-  case COpenALStream::SpeakerLayout::Stereo:
-    result.append("STEREO");
-    break;
-  case COpenALStream::SpeakerLayout::Quad:
-    result.append("QUAD");
-    break;
-  case COpenALStream::SpeakerLayout::Surround6:
-    result.append("51CHN");
-    break;
-  case COpenALStream::SpeakerLayout::Surround8:
-    result.append("71CHN");
-    break;
-  }
-
-  switch (bitness)
-  {
-  case COpenALStream::MediaBitness::bit8:
-    result.append("8");
-    break;
-  case COpenALStream::MediaBitness::bit16:
-    result.append("16");
-    break;
-  case COpenALStream::MediaBitness::bit24:
-    //result.append("QUAD");
-    break;
-  case COpenALStream::MediaBitness::bit32:
-    result.append("32");
-    break;
-  case COpenALStream::MediaBitness::bitfloat:
-    if (speaker_layout == COpenALStream::SpeakerLayout::Stereo ||
-      speaker_layout == COpenALStream::SpeakerLayout::Mono)
-    {
-      result.append("_FLOAT32");
-    }
-    else
-    {
-      result.append("32");
-    }
-    break;
-  }
-
-  return result;
-}
-
-size_t GetFrameSize(COpenALStream::SpeakerLayout speaker_layout, COpenALStream::MediaBitness bitness)
+COpenALOutput* COpenALStream::GetOutput()
 {
-  size_t num_channels = 0;
-  size_t element_size = 0;
-  switch (bitness)
-  {
-  case COpenALStream::MediaBitness::bit8:
-    element_size = sizeof(ALbyte);
-    break;
-  case COpenALStream::MediaBitness::bit16:
-    element_size = sizeof(ALshort);
-    break;
-  case COpenALStream::MediaBitness::bit24:
-    element_size = sizeof(ALint);
-    break;
-  case COpenALStream::MediaBitness::bit32:
-    element_size = sizeof(ALint);
-    break;
-  case COpenALStream::MediaBitness::bitfloat:
-    element_size = sizeof(ALfloat);
-    break;
-  }
-
-  switch (speaker_layout)
-  {
-  case COpenALStream::SpeakerLayout::Mono:
-    num_channels = 1;
-    break;
-  case COpenALStream::SpeakerLayout::Stereo:
-    num_channels = 2;
-    break;
-  case COpenALStream::SpeakerLayout::Quad:
-    num_channels = 4;
-    break;
-  case COpenALStream::SpeakerLayout::Surround6:
-    num_channels = 6;
-    break;
-  case COpenALStream::SpeakerLayout::Surround8:
-    num_channels = 8;
-    break;
-  }
-
-  return num_channels * element_size;
-}
-
-void COpenALStream::SoundLoop()
-{
-  uint32_t past_frequency = m_frequency;
-  SpeakerLayout past_speaker_layout = m_speaker_layout;
-  MediaBitness past_bitness = m_bitness;
-
-  bool float32_capable = palIsExtensionPresent("AL_EXT_float32");
-  bool surround_capable = palIsExtensionPresent("AL_EXT_MCFORMATS") || IsCreativeXFi();
-
-  // As there is no extension to check for 32-bit fixed point support
-  // and we know that only a X-Fi with hardware OpenAL supports it,
-  // we just check if one is being used.
-  bool fixed32_capable = IsCreativeXFi();
-
-  uint32_t frames_per_buffer;
-  // Can't have zero samples per buffer
-  if (m_latency > 0)
-  {
-    frames_per_buffer = m_frequency / 1000 * m_latency / num_buffers;
-  }
-  else
-  {
-    frames_per_buffer = m_frequency / 1000 * 1 / num_buffers;
-  }
-
-  std::ostringstream string;
-  string << "Using " << num_buffers << " buffers, each with " << frames_per_buffer <<
-    " audio frames for a total of " << frames_per_buffer * num_buffers << " frames." << std::endl;
-  OutputDebugStringA(string.str().c_str());
-  string.clear();
-
-  // Should we make these larger just in case the mixer ever sends more samples
-  // than what we request?
-  m_buffers.resize(num_buffers);
-  m_source = 0;
-
-  // Clear error state before querying or else we get false positives.
-  ALenum err = palGetError();
-
-  // Generate some AL Buffers for streaming
-  palGenBuffers(num_buffers, (ALuint*)m_buffers.data());
-  err = CheckALError("generating buffers");
-
-  // Generate a Source to playback the Buffers
-  palGenSources(1, &m_source);
-  err = CheckALError("generating sources");
-
-  // Set the default sound volume as saved in the config file.
-  palSourcef(m_source, AL_GAIN, m_volume);
-
-  // TODO: Error handling
-  // ALenum err = alGetError();
-
-  unsigned int next_buffer = 0;
-
-  ALint state = 0;
-
-  std::vector<int8_t> byte_data;
-  while (m_run_thread)
-  {
-    if (m_mixer->IsStreaming())
-    {
-      // Check if stream changed frequency, bitness or channel setup
-      if (past_frequency != m_frequency || past_bitness != m_bitness || past_speaker_layout != m_speaker_layout)
-      {
-        // Stop source and clean-up buffers
-        palSourceStop(m_source);
-        palSourcei(m_source, AL_BUFFER, 0);
-
-        palDeleteBuffers(num_buffers, m_buffers.data());
-        palGenBuffers(num_buffers, (ALuint*)m_buffers.data());
-        err = CheckALError("re-generating buffers");
-
-        next_buffer = 0;
-        num_buffers_queued = 0;
-
-        if (m_latency > 0)
-        {
-          frames_per_buffer = m_frequency / 1000 * m_latency / num_buffers;
-        }
-        else
-        {
-          frames_per_buffer = m_frequency / 1000 * 1 / num_buffers;
-        }
-
-        past_frequency = m_frequency;
-        past_bitness = m_bitness;
-        past_speaker_layout = m_speaker_layout;
-      }
-
-      // Block until we have a free buffer
-      int num_buffers_processed = 0;
-      palGetSourcei(m_source, AL_BUFFERS_PROCESSED, &num_buffers_processed);
-      palGetSourcei(m_source, AL_SOURCE_STATE, &state);
-      if (num_buffers_queued == num_buffers && !num_buffers_processed)
-      {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        continue;
-      }
-
-      // Remove the Buffer from the Queue.
-      if (num_buffers_processed)
-      {
-        std::vector<ALuint> unqueued_buffer_ids(num_buffers);
-        palSourceUnqueueBuffers(m_source, num_buffers_processed, unqueued_buffer_ids.data());
-        err = CheckALError("unqueuing buffers");
-
-        num_buffers_queued -= num_buffers_processed;
-      }
-
-      // Control clock
-      //ClockController();
-
-      size_t available_frames = 0;
-      switch (m_bitness)
-      {
-      case bit8:
-        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 1);
-        break;
-      case bit16:
-        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 2);
-        break;
-      case bit32:
-        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 4);
-        break;
-      case bitfloat:
-        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 4);
-        break;
-      }
-
-      if (!available_frames)
-      {
-        continue;
-      }
-
-      palBufferData(m_buffers[next_buffer],
-        palGetEnumValue(GenerateFormatString(m_speaker_layout, m_bitness).c_str()),
-        byte_data.data(),
-        static_cast<ALsizei>(available_frames) * GetFrameSize(m_speaker_layout, m_bitness),
-        m_frequency);
-
-      err = CheckALError("buffering data");
-
-      palSourceQueueBuffers(m_source, 1, &m_buffers[next_buffer]);
-      err = CheckALError("queuing buffers");
-
-      m_total_buffered += available_frames;
-
-      num_buffers_queued++;
-      next_buffer = (next_buffer + 1) % num_buffers;
-
-      palGetSourcei(m_source, AL_SOURCE_STATE, &state);
-      if (state != AL_PLAYING)
-      {
-        // Buffer underrun occurred, resume playback
-        palSourcePlay(m_source);
-        err = CheckALError("occurred resuming playback");
-        OutputDebugStringA("Buffer underrun\n");
-        {
-          std::ostringstream string;
-          string << "Buffers queued: " << num_buffers_queued << "." << std::endl;
-          OutputDebugStringA(string.str().c_str());
-        }
-      }
-    }
-    else
-    {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
-  }
+  return &m_output;
 }
 
-#endif  // _WIN32
\ No newline at end of file
+#endif  // _WIN32
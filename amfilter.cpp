@@ -29,6 +29,7 @@
 
 #include <streams.h>
 #include <strsafe.h>
+#include <new>
 
 #ifdef DXMPERF
 #include "dxmperf.h"
@@ -4566,6 +4567,7 @@ CBaseAllocator::CBaseAllocator(__in_opt LPCTSTR pName,
     m_lPrefix(0),
     m_hSem(NULL),
     m_lWaiting(0),
+    m_lGetting(0),
     m_fEnableReleaseCallback(fEnableReleaseCallback),
     m_pNotify(NULL)
 {
@@ -4599,6 +4601,7 @@ CBaseAllocator::CBaseAllocator(__in_opt LPCSTR pName,
     m_lPrefix(0),
     m_hSem(NULL),
     m_lWaiting(0),
+    m_lGetting(0),
     m_fEnableReleaseCallback(fEnableReleaseCallback),
     m_pNotify(NULL)
 {
@@ -4742,18 +4745,21 @@ HRESULT CBaseAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
     *ppBuffer = NULL;
     for (;;)
     {
-        {  // scope for lock
-            CAutoLock cObjectLock(this);
-
-            /* Check we are committed */
-            if (!m_bCommitted) {
-                return VFW_E_NOT_COMMITTED;
-            }
-            pSample = (CMediaSample *) m_lFree.RemoveHead();
-            if (pSample == NULL) {
-                SetWaiting();
-            }
+        /* No lock, count ourselves in so that Decommit can wait for us to
+           be done with the free list, then check we are committed */
+        InterlockedIncrement(&m_lGetting);
+        if (!m_bCommitted) {
+            InterlockedDecrement(&m_lGetting);
+            return VFW_E_NOT_COMMITTED;
+        }
+        pSample = m_lFree.RemoveHead();
+        if (pSample == NULL && !(dwFlags & AM_GBF_NOWAIT)) {
+            /* Say we're waiting, then look again: a sample released since
+               the first look is either found now or signals m_hSem */
+            SetWaiting();
+            pSample = m_lFree.RemoveHead();
         }
+        InterlockedDecrement(&m_lGetting);
 
         /* If we didn't get a sample then wait for the list to signal */
 
@@ -4799,19 +4805,19 @@ CBaseAllocator::ReleaseBuffer(IMediaSample * pSample)
 
 
     BOOL bRelease = FALSE;
-    {
-        CAutoLock cal(this);
 
-        /* Put back on the free list */
+    /* Put back on the free list, no lock needed */
 
-        m_lFree.Add((CMediaSample *)pSample);
-        if (m_lWaiting != 0) {
-            NotifySample();
-        }
+    m_lFree.Add((CMediaSample *)pSample);
+    NotifySample();
 
-        // if there is a pending Decommit, then we need to complete it by
-        // calling Free() when the last buffer is placed on the free list
+    // if there is a pending Decommit, then we need to complete it by
+    // calling Free() when the last buffer is placed on the free list.
+    // Decommit sets the flag before counting the free list, so if we
+    // don't see it our sample was counted there
 
+    if (m_bDecommitInProgress) {
+        CAutoLock cal(this);
         LONG l1 = m_lFree.GetCount();
         if (m_bDecommitInProgress && (l1 == m_lAllocated)) {
             Free();
@@ -4873,8 +4879,10 @@ CBaseAllocator::NotifySample()
 {
     if (m_lWaiting != 0) {
         ASSERT(m_hSem != NULL);
-        ReleaseSemaphore(m_hSem, m_lWaiting, 0);
-        m_lWaiting = 0;
+        LONG lWaiting = InterlockedExchange(&m_lWaiting, 0);
+        if (lWaiting != 0) {
+            ReleaseSemaphore(m_hSem, lWaiting, 0);
+        }
     }
 }
 
@@ -4889,14 +4897,13 @@ CBaseAllocator::Commit()
         return NOERROR;
     }
 
-    /* Allow GetBuffer calls */
-
-    m_bCommitted = TRUE;
-
     // is there a pending decommit ? if so, just cancel it
     if (m_bDecommitInProgress) {
         m_bDecommitInProgress = FALSE;
 
+        /* Allow GetBuffer calls */
+        m_bCommitted = TRUE;
+
         // don't call Alloc at this point. He cannot allow SetProperties
         // between Decommit and the last free, so the buffer size cannot have
         // changed. And because some of the buffers are not free yet, he
@@ -4909,9 +4916,12 @@ CBaseAllocator::Commit()
     // actually need to allocate the samples
     HRESULT hr = Alloc();
     if (FAILED(hr)) {
-        m_bCommitted = FALSE;
         return hr;
     }
+
+    /* Allow GetBuffer calls. Only now, GetBuffer doesn't take the lock
+       and mustn't see the free list while Alloc fills it */
+    m_bCommitted = TRUE;
     AddRef();
     return NOERROR;
 }
@@ -4930,14 +4940,22 @@ CBaseAllocator::Decommit()
             }
         }
 
-        /* No more GetBuffer calls will succeed */
+        /* No more GetBuffer calls will succeed. Wait for any already
+           past the check to be done with the free list */
         m_bCommitted = FALSE;
+        MemoryBarrier();
+        while (m_lGetting != 0) {
+            SwitchToThread();
+        }
+
+        // please complete the decommit when last buffer is freed. Set
+        // before counting, so ReleaseBuffer either sees it or its sample
+        // is counted here
+        m_bDecommitInProgress = TRUE;
+        MemoryBarrier();
 
         // are any buffers outstanding?
-        if (m_lFree.GetCount() < m_lAllocated) {
-            // please complete the decommit when last buffer is freed
-            m_bDecommitInProgress = TRUE;
-        } else {
+        if (m_lFree.GetCount() == m_lAllocated) {
             m_bDecommitInProgress = FALSE;
 
             // need to complete the decommit here as there are no
@@ -4985,27 +5003,12 @@ CBaseAllocator::Alloc(void)
         return S_FALSE;
     }
 
-    return NOERROR;
-}
-
-/*  Implement CBaseAllocator::CSampleList::Remove(pSample)
-    Removes pSample from the list
-*/
-void
-CBaseAllocator::CSampleList::Remove(__inout CMediaSample * pSample)
-{
-    CMediaSample **pSearch;
-    for (pSearch = &m_List;
-         *pSearch != NULL;
-         pSearch = &(CBaseAllocator::NextSample(*pSearch))) {
-       if (*pSearch == pSample) {
-           *pSearch = CBaseAllocator::NextSample(pSample);
-           CBaseAllocator::NextSample(pSample) = NULL;
-           m_nOnList--;
-           return;
-       }
+    /* Make room on the free list for the samples the derived class adds */
+    if (!m_lFree.Reserve(m_lCount)) {
+        return E_OUTOFMEMORY;
     }
-    DbgBreak("Couldn't find sample in list");
+
+    return NOERROR;
 }
 
 //=====================================================================
@@ -5027,7 +5030,10 @@ CMemAllocator::CMemAllocator(
     __inout_opt LPUNKNOWN pUnk,
     __inout HRESULT *phr)
     : CBaseAllocator(pName, pUnk, phr, TRUE, TRUE),
-    m_pBuffer(NULL)
+    m_pBuffer(NULL),
+    m_lMinAlignment(1),
+    m_bLargePages(FALSE),
+    m_bSamplesInBuffer(FALSE)
 {
 }
 
@@ -5037,11 +5043,40 @@ CMemAllocator::CMemAllocator(
     __inout_opt LPUNKNOWN pUnk,
     __inout HRESULT *phr)
     : CBaseAllocator(pName, pUnk, phr, TRUE, TRUE),
-    m_pBuffer(NULL)
+    m_pBuffer(NULL),
+    m_lMinAlignment(1),
+    m_bLargePages(FALSE),
+    m_bSamplesInBuffer(FALSE)
 {
 }
 #endif
 
+/* Lay the samples out for the cache, see amfilter.h. Takes effect at the
+   next SetProperties */
+HRESULT
+CMemAllocator::SetCacheFriendlyLayout(LONG lMinAlignment, BOOL bLargePages)
+{
+    CAutoLock cObjectLock(this);
+
+    /*  Must be a power of 2 that divides the allocation granularity, as
+        SetProperties requires of any alignment */
+    SYSTEM_INFO SysInfo;
+    GetSystemInfo(&SysInfo);
+    if (lMinAlignment <= 0 || (lMinAlignment & (lMinAlignment - 1)) != 0 ||
+        (SysInfo.dwAllocationGranularity & (lMinAlignment - 1)) != 0) {
+        return VFW_E_BADALIGN;
+    }
+
+    if (m_bCommitted) {
+        return VFW_E_ALREADY_COMMITTED;
+    }
+
+    m_lMinAlignment = lMinAlignment;
+    m_bLargePages = bLargePages;
+    m_bChanged = TRUE;
+    return NOERROR;
+}
+
 /* This sets the size and count of the required samples. The memory isn't
    actually allocated until Commit() is called, if memory has already been
    allocated then assuming no samples are outstanding the user may call us
@@ -5094,17 +5129,32 @@ CMemAllocator::SetProperties(
     /* There isn't any real need to check the parameters as they
        will just be rejected when the user finally calls Commit */
 
-    // round length up to alignment - remember that prefix is included in
-    // the alignment
-    LONG lSize = pRequest->cbBuffer + pRequest->cbPrefix;
-    LONG lRemainder = lSize % pRequest->cbAlign;
-    if (lRemainder != 0) {
-        lSize = lSize - lRemainder + pRequest->cbAlign;
+    /*  Both powers of 2, the larger is a multiple of the other */
+    LONG lAlign = max(pRequest->cbAlign, m_lMinAlignment);
+
+    LONG lSize;
+    if (m_lMinAlignment > 1) {
+        // the payload itself is aligned and padded, the prefix goes in
+        // front of it
+        lSize = pRequest->cbBuffer;
+        LONG lRemainder = lSize % lAlign;
+        if (lRemainder != 0) {
+            lSize = lSize - lRemainder + lAlign;
+        }
+    } else {
+        // round length up to alignment - remember that prefix is included in
+        // the alignment
+        lSize = pRequest->cbBuffer + pRequest->cbPrefix;
+        LONG lRemainder = lSize % lAlign;
+        if (lRemainder != 0) {
+            lSize = lSize - lRemainder + lAlign;
+        }
+        lSize -= pRequest->cbPrefix;
     }
-    pActual->cbBuffer = m_lSize = (lSize - pRequest->cbPrefix);
+    pActual->cbBuffer = m_lSize = lSize;
 
     pActual->cBuffers = m_lCount = pRequest->cBuffers;
-    pActual->cbAlign = m_lAlignment = pRequest->cbAlign;
+    pActual->cbAlign = m_lAlignment = lAlign;
     pActual->cbPrefix = m_lPrefix = pRequest->cbPrefix;
 
     m_bChanged = TRUE;
@@ -5154,6 +5204,26 @@ CMemAllocator::Alloc(void)
         return E_OUTOFMEMORY;
     }
 
+    /*  With the cache friendly layout each sample's block is the prefix
+        rounded up to the alignment, so the payload after it is aligned,
+        then the payload, which SetProperties padded. The sample objects
+        go first, in cache line slots. */
+    BOOL bCacheLayout = (m_lMinAlignment > 1);
+    LONG lPayloadOffset = m_lPrefix;
+    LONGLONG llHeaders = 0;
+    LONG lHeaderSize = 0;
+    if (bCacheLayout) {
+        lPayloadOffset = (m_lPrefix + m_lAlignment - 1) & ~(m_lAlignment - 1);
+        lAlignedSize = lPayloadOffset + m_lSize;
+        if (lPayloadOffset < m_lPrefix || lAlignedSize < m_lSize) {
+            return E_OUTOFMEMORY;
+        }
+
+        lHeaderSize = (sizeof(CMediaSample) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+        llHeaders = m_lCount * (LONGLONG)lHeaderSize;
+        llHeaders = (llHeaders + m_lAlignment - 1) & ~(LONGLONG)(m_lAlignment - 1);
+    }
+
     if (m_lAlignment > 1) {
         LONG lRemainder = lAlignedSize % m_lAlignment;
         if (lRemainder != 0) {
@@ -5170,26 +5240,47 @@ CMemAllocator::Alloc(void)
     */
     ASSERT(lAlignedSize % m_lAlignment == 0);
 
-    LONGLONG lToAllocate = m_lCount * (LONGLONG)lAlignedSize;
+    LONGLONG lToAllocate = m_lCount * (LONGLONG)lAlignedSize + llHeaders;
 
     /*  Check overflow */
     if (lToAllocate > MAXLONG) {
         return E_OUTOFMEMORY;
     }
 
-    m_pBuffer = (PBYTE)VirtualAlloc(NULL,
-                    (LONG)lToAllocate,
-                    MEM_COMMIT,
-                    PAGE_READWRITE);
+    /*  Large pages need SeLockMemoryPrivilege, without it fall back to
+        normal pages */
+    if (m_bLargePages) {
+        SIZE_T cbLargePage = GetLargePageMinimum();
+        if (cbLargePage != 0) {
+            SIZE_T cbRounded = ((SIZE_T)lToAllocate + cbLargePage - 1) & ~(cbLargePage - 1);
+            m_pBuffer = (PBYTE)VirtualAlloc(NULL,
+                            cbRounded,
+                            MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
+                            PAGE_READWRITE);
+        }
+        if (m_pBuffer == NULL) {
+            DbgLog((LOG_MEMORY, 1, TEXT("Large pages not available (%d), using normal pages"),
+                   GetLastError()));
+        }
+    }
+
+    if (m_pBuffer == NULL) {
+        m_pBuffer = (PBYTE)VirtualAlloc(NULL,
+                        (LONG)lToAllocate,
+                        MEM_COMMIT,
+                        PAGE_READWRITE);
+    }
 
     if (m_pBuffer == NULL) {
         return E_OUTOFMEMORY;
     }
 
-    LPBYTE pNext = m_pBuffer;
+    LPBYTE pNext = m_pBuffer + llHeaders;
+    LPBYTE pNextHeader = m_pBuffer;
     CMediaSample *pSample;
 
     ASSERT(m_lAllocated == 0);
+    m_bSamplesInBuffer = bCacheLayout;
 
     // Create the new samples - we have allocated m_lSize bytes for each sample
     // plus m_lPrefix bytes per sample as a prefix. We set the pointer to
@@ -5197,13 +5288,23 @@ CMemAllocator::Alloc(void)
     // to m_lSize bytes.
     for (; m_lAllocated < m_lCount; m_lAllocated++, pNext += lAlignedSize) {
 
-
-        pSample = new CMediaSample(
-                            NAME("Default memory media sample"),
-                this,
-                            &hr,
-                            pNext + m_lPrefix,      // GetPointer() value
-                            m_lSize);               // not including prefix
+        if (bCacheLayout) {
+            // ReallyFree destroys these without deleting them
+            pSample = new (pNextHeader) CMediaSample(
+                                NAME("Default memory media sample"),
+                                this,
+                                &hr,
+                                pNext + lPayloadOffset, // GetPointer() value
+                                m_lSize);               // not including prefix
+            pNextHeader += lHeaderSize;
+        } else {
+            pSample = new CMediaSample(
+                                NAME("Default memory media sample"),
+                                this,
+                                &hr,
+                                pNext + m_lPrefix,      // GetPointer() value
+                                m_lSize);               // not including prefix
+        }
 
             ASSERT(SUCCEEDED(hr));
         if (pSample == NULL) {
@@ -5250,7 +5351,12 @@ CMemAllocator::ReallyFree(void)
     for (;;) {
         pSample = m_lFree.RemoveHead();
         if (pSample != NULL) {
-            delete pSample;
+            if (m_bSamplesInBuffer) {
+                // constructed in m_pBuffer by Alloc
+                pSample->~CMediaSample();
+            } else {
+                delete pSample;
+            }
         } else {
             break;
         }
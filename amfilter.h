@@ -11,6 +11,8 @@
 #ifndef __FILTER__
 #define __FILTER__
 
+#include "core/FreeList.h"
+
 /* The following classes are declared in this header: */
 
 class CBaseMediaFilter;     // IMediaFilter support
@@ -1340,50 +1342,36 @@ class AM_NOVTABLE CBaseAllocator : public CUnknown,// A non delegating IUnknown
                        public IMemAllocatorCallbackTemp, // The interface we support
                        public CCritSec             // Provides object locking
 {
-    class CSampleList;
-    friend class CSampleList;
-
-    /*  Trick to get at protected member in CMediaSample */
-    static CMediaSample * &NextSample(__in CMediaSample *pSample)
-    {
-        return pSample->m_pNext;
-    };
-
-    /*  Mini list class for the free list */
+    /*  Mini list class for the free list. Lock-free (core/FreeList.h),
+        Add and RemoveHead may be called from any thread without holding
+        the allocator's critical section. Reserve must give it room for
+        every sample before they are added, and like GetCount being exact
+        it needs no GetBuffer or ReleaseBuffer to be in progress */
     class CSampleList
     {
     public:
-        CSampleList() : m_List(NULL), m_nOnList(0) {};
+        CSampleList() {};
 #ifdef DEBUG
         ~CSampleList()
         {
-            ASSERT(m_nOnList == 0);
+            ASSERT(GetCount() == 0);
         };
 #endif
-        CMediaSample *Head() const { return m_List; };
-        CMediaSample *Next(__in CMediaSample *pSample) const { return CBaseAllocator::NextSample(pSample); };
-        int GetCount() const { return m_nOnList; };
+        int GetCount() const { return (int) m_List.Count(); };
+        BOOL Reserve(int nCount) { return m_List.Reserve(nCount); };
         void Add(__inout CMediaSample *pSample)
         {
             ASSERT(pSample != NULL);
-            CBaseAllocator::NextSample(pSample) = m_List;
-            m_List = pSample;
-            m_nOnList++;
+            ASSERT(GetCount() < (int) m_List.Capacity());
+            m_List.Push(pSample);
         };
         CMediaSample *RemoveHead()
         {
-            CMediaSample *pSample = m_List;
-            if (pSample != NULL) {
-                m_List = CBaseAllocator::NextSample(m_List);
-                m_nOnList--;
-            }
-            return pSample;
+            return (CMediaSample *) m_List.Pop();
         };
-        void Remove(__inout CMediaSample *pSample);
 
-    public:
-        CMediaSample *m_List;
-        int           m_nOnList;
+    private:
+        CFreeList m_List;
     };
 protected:
 
@@ -1391,42 +1379,38 @@ protected:
 
     /*  Note to overriders of CBaseAllocator.
 
-        We use a lazy signalling mechanism for waiting for samples.
-        This means we don't call the OS if no waits occur.
+        GetBuffer and ReleaseBuffer do not take the allocator's critical
+        section, samples come and go through the lock-free free list and
+        the OS is only called when a GetBuffer finds it empty and waits.
 
         In order to implement this:
 
         1. When a new sample is added to m_lFree call NotifySample() which
-           calls ReleaseSemaphore on m_hSem with a count of m_lWaiting and
-           sets m_lWaiting to 0.
-           This must all be done holding the allocator's critical section.
+           calls ReleaseSemaphore on m_hSem with a count of m_lWaiting,
+           exchanging it for 0.
 
         2. When waiting for a sample call SetWaiting() which increments
-           m_lWaiting BEFORE leaving the allocator's critical section.
-
-        3. Actually wait by calling WaitForSingleObject(m_hSem, INFINITE)
-           having left the allocator's critical section.  The effect of
-           this is to remove 1 from the semaphore's count.  You MUST call
-           this once having incremented m_lWaiting.
-
-        The following are then true when the critical section is not held :
-            (let nWaiting = number about to wait or waiting)
-
-            (1) if (m_lFree.GetCount() != 0) then (m_lWaiting == 0)
-            (2) m_lWaiting + Semaphore count == nWaiting
-
-        We would deadlock if
-           nWaiting != 0 &&
-           m_lFree.GetCount() != 0 &&
-           Semaphore count == 0
-
-           But from (1) if m_lFree.GetCount() != 0 then m_lWaiting == 0 so
-           from (2) Semaphore count == nWaiting (which is non-0) so the
-           deadlock can't happen.
+           m_lWaiting, then look at m_lFree again.
+
+        3. If that finds nothing, wait by calling
+           WaitForSingleObject(m_hSem, INFINITE).  The effect of this is to
+           remove 1 from the semaphore's count.
+
+        Both sides use interlocked operations, so either the second look
+        sees a sample added before NotifySample read m_lWaiting, or
+        NotifySample sees the waiter and releases the semaphore. A waiter
+        that finds a sample on the second look leaves a count on the
+        semaphore, which only costs a later waiter an extra look.
+
+        GetBuffer counts itself in m_lGetting while it uses the free list.
+        Decommit waits for that to drop to 0 after clearing m_bCommitted,
+        so the free count it sees is exact. Commit sets m_bCommitted only
+        after Alloc has filled the list.
     */
 
     HANDLE m_hSem;              // For signalling
-    long m_lWaiting;            // Waiting for a free element
+    volatile long m_lWaiting;   // Waiting for a free element
+    volatile long m_lGetting;   // GetBuffer calls using the free list
     long m_lCount;              // how many buffers we have agreed to provide
     long m_lAllocated;          // how many buffers are currently allocated
     long m_lSize;               // agreed size of each buffer
@@ -1435,10 +1419,10 @@ protected:
     BOOL m_bChanged;            // Have the buffer requirements changed
 
     // if true, we are decommitted and can't allocate memory
-    BOOL m_bCommitted;
+    volatile BOOL m_bCommitted;
     // if true, the decommit has happened, but we haven't called Free yet
     // as there are still outstanding buffers
-    BOOL m_bDecommitInProgress;
+    volatile BOOL m_bDecommitInProgress;
 
     //  Notification interface
     IMemAllocatorNotifyCallbackTemp *m_pNotify;
@@ -1511,7 +1495,7 @@ public:
     void NotifySample();
 
     // Notify that we're waiting for a sample
-    void SetWaiting() { m_lWaiting++; };
+    void SetWaiting() { InterlockedIncrement(&m_lWaiting); };
 };
 
 
@@ -1541,6 +1525,11 @@ protected:
 
     LPBYTE m_pBuffer;   // combined memory for all buffers
 
+    LONG m_lMinAlignment;       // least alignment of GetPointer(), see
+                                // SetCacheFriendlyLayout
+    BOOL m_bLargePages;         // try large pages for m_pBuffer
+    BOOL m_bSamplesInBuffer;    // the samples are constructed in m_pBuffer
+
     // override to free the memory when decommit completes
     // - we actually do nothing, and save the memory until deletion.
     void Free(void);
@@ -1565,6 +1554,19 @@ public:
     CMemAllocator(__in_opt LPCSTR , __inout_opt LPUNKNOWN, __inout HRESULT *);
 #endif
     ~CMemAllocator();
+
+    // Cache line size the layout below is usually asked for with
+    enum { CACHE_LINE_SIZE = 64 };
+
+    // Call before SetProperties. Aligns every sample's payload (the
+    // GetPointer() value) to at least lMinAlignment bytes, a power of 2,
+    // whatever alignment is negotiated, and pads each payload to a whole
+    // number of them. The sample objects are built in the same block, each
+    // in cache lines of its own, so no two samples, nor a sample and its
+    // neighbour's payload, share a line. With bLargePages the block is
+    // put on large pages when the process may lock memory, on normal
+    // pages otherwise.
+    HRESULT SetCacheFriendlyLayout(LONG lMinAlignment, BOOL bLargePages);
 };
 
 // helper used by IAMovieSetup implementation
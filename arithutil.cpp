@@ -8,6 +8,27 @@
 //------------------------------------------------------------------------------
 
 #include <streams.h>
+#include "core/MulDiv.h"
+
+#ifdef MULDIV_HAS_128
+
+/*  Arithmetic functions to help with time format conversions, on the 128 bit
+    multiply and divide of core/MulDiv.h.  They round exactly as the long
+    hand versions below, which are kept for compilers without them.
+*/
+
+/*   Compute (a * b + d) / c */
+LONGLONG WINAPI llMulDiv(LONGLONG a, LONGLONG b, LONGLONG c, LONGLONG d)
+{
+    return MulDiv128(a, b, c, d);
+}
+
+LONGLONG WINAPI Int64x32Div32(LONGLONG a, LONG b, LONG c, LONG d)
+{
+    return MulDiv128(a, b, c, d);
+}
+
+#else // MULDIV_HAS_128
 
 //
 //  Declare function from largeint.h we need so that PPC can build
@@ -358,3 +379,5 @@ LONGLONG WINAPI Int64x32Div32(LONGLONG a, LONG b, LONG c, LONG d)
     return bSign ? -(LONGLONG)uliResult.QuadPart :
                     (LONGLONG)uliResult.QuadPart;
 }
+
+#endif // MULDIV_HAS_128
@@ -0,0 +1,479 @@
+// Stress benchmark of the reference clock's advise scheduler. Keeps
+// thousands of advises outstanding, one-shot and periodic mixed, and
+// measures adding, cancelling and dispatching them with CAdviseHeap, the
+// store behind CAMSchedule, and with the sorted linked list CAMSchedule
+// used before. Both are first run side by side on random operations and
+// must fire the same advises at every step. Reports, as JSON on stdout:
+//
+//   add_ns        per AddAdvisePacket, at the given number outstanding
+//   unadvise_ns   per Unadvise of a random outstanding advise
+//   dispatch_ns   per advise fired by Advise, periodic ones rescheduled and
+//                 one-shot ones replaced to keep the count steady
+//
+// Usage: advise_bench [--sizes N,N,...] [--ops N] [--list-limit N]
+//
+// The linked list is O(n) per add and cancel, it is skipped for sizes over
+// --list-limit.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AdviseHeap.h"
+#include "BenchOptions.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// 100 ns units, as REFERENCE_TIME
+const int64_t MILLISECOND = 10000;
+
+//
+// The scheduler as it was: packets in a singly linked list sorted by time,
+// between a head and a tail sentry with the maximal time, and a small cache
+// of freed packets.
+//
+class CListSchedule
+{
+public:
+  CListSchedule()
+  {
+    m_head.next = &m_tail;
+    m_tail.time = CAdviseHeap::NO_ADVISE;
+  }
+
+  ~CListSchedule()
+  {
+    Clear();
+    while (m_cache)
+    {
+      Packet* next = m_cache->next;
+      delete m_cache;
+      m_cache = next;
+    }
+  }
+
+  uintptr_t Add(int64_t time, int64_t period, void* notify, bool periodic)
+  {
+    Packet* packet = m_cache;
+    if (packet)
+    {
+      m_cache = packet->next;
+      m_cache_count--;
+    }
+    else
+    {
+      packet = new Packet();
+    }
+
+    packet->packet.time = time;
+    packet->packet.period = period;
+    packet->packet.notify = notify;
+    packet->packet.periodic = periodic;
+    packet->packet.cookie = ++m_next_cookie;
+
+    // Ahead of the packets with the same time, as before
+    Packet* prev = &m_head;
+    while (prev->next->time < time)
+    {
+      prev = prev->next;
+    }
+    packet->time = time;
+    packet->next = prev->next;
+    prev->next = packet;
+    m_size++;
+
+    return packet->packet.cookie;
+  }
+
+  bool Remove(uintptr_t cookie)
+  {
+    for (Packet* prev = &m_head; prev->next != &m_tail; prev = prev->next)
+    {
+      if (prev->next->packet.cookie == cookie)
+      {
+        Packet* packet = prev->next;
+        prev->next = packet->next;
+        Free(packet);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t Size() const
+  {
+    return m_size;
+  }
+
+  int64_t NextTime() const
+  {
+    return m_head.next->time;
+  }
+
+  const AdvisePacket* Top() const
+  {
+    return m_size ? &m_head.next->packet : nullptr;
+  }
+
+  void RescheduleTop()
+  {
+    Packet* packet = m_head.next;
+    packet->time += packet->packet.period;
+    packet->packet.time = packet->time;
+
+    // Behind the packets with the same time
+    Packet* prev = packet;
+    while (prev->next->time <= packet->time)
+    {
+      prev = prev->next;
+    }
+    if (prev != packet)
+    {
+      m_head.next = packet->next;
+      packet->next = prev->next;
+      prev->next = packet;
+    }
+  }
+
+  void RemoveTop()
+  {
+    Packet* packet = m_head.next;
+    m_head.next = packet->next;
+    Free(packet);
+  }
+
+  void Clear()
+  {
+    while (m_size)
+    {
+      RemoveTop();
+    }
+  }
+
+private:
+  static const size_t CACHE_MAX = 5;
+
+  struct Packet
+  {
+    AdvisePacket packet = {};
+    int64_t time = 0;
+    Packet* next = nullptr;
+  };
+
+  void Free(Packet* packet)
+  {
+    m_size--;
+    if (m_cache_count >= CACHE_MAX)
+    {
+      delete packet;
+      return;
+    }
+    packet->next = m_cache;
+    m_cache = packet;
+    m_cache_count++;
+  }
+
+  Packet m_head;
+  Packet m_tail;
+  Packet* m_cache = nullptr;
+  size_t m_cache_count = 0;
+  size_t m_size = 0;
+  uintptr_t m_next_cookie = 0;
+};
+
+// CAMSchedule::Advise, without the events. Calls fired(notify, periodic)
+// for each advise due at now.
+template <class Schedule, class F> static void Dispatch(Schedule& schedule, int64_t now, F fired)
+{
+  while (schedule.Size() > 0 && now >= schedule.NextTime())
+  {
+    const AdvisePacket* packet = schedule.Top();
+    void* notify = packet->notify;
+    bool periodic = packet->periodic;
+    if (periodic)
+    {
+      schedule.RescheduleTop();
+    }
+    else
+    {
+      schedule.RemoveTop();
+    }
+    fired(notify, periodic);
+  }
+}
+
+// Ids of the advises, passed as the notify handle
+static void* Id(size_t id)
+{
+  return reinterpret_cast<void*>(id + 1);
+}
+
+//
+// Runs both schedules on the same random adds, cancels and dispatches and
+// compares what fires. Equal times fire in a different order, so each
+// dispatch compares the set fired.
+//
+static bool CheckAgainstList(uint32_t seed, size_t ops)
+{
+  std::mt19937_64 random(seed);
+  CAdviseHeap heap;
+  CListSchedule list;
+
+  struct Outstanding
+  {
+    uintptr_t heap_cookie;
+    uintptr_t list_cookie;
+    size_t id;
+  };
+  std::vector<Outstanding> outstanding;
+  std::vector<size_t> heap_fired;
+  std::vector<size_t> list_fired;
+
+  int64_t now = 0;
+  size_t next_id = 0;
+  for (size_t op = 0; op < ops; op++)
+  {
+    uint64_t choice = random() % 10;
+    if (choice < 4)
+    {
+      // Coarse times so that many share one
+      int64_t time = now + static_cast<int64_t>(random() % 64) * MILLISECOND;
+      bool periodic = random() % 4 == 0;
+      int64_t period = static_cast<int64_t>(1 + random() % 64) * MILLISECOND;
+      size_t id = next_id++;
+      uintptr_t heap_cookie = heap.Add(time, period, Id(id), periodic);
+      uintptr_t list_cookie = list.Add(time, period, Id(id), periodic);
+      if (heap_cookie == 0)
+      {
+        std::fprintf(stderr, "check: add failed at %zu outstanding\n", heap.Size());
+        return false;
+      }
+      outstanding.push_back({ heap_cookie, list_cookie, id });
+    }
+    else if (choice < 7 && !outstanding.empty())
+    {
+      size_t index = random() % outstanding.size();
+      Outstanding advise = outstanding[index];
+      outstanding[index] = outstanding.back();
+      outstanding.pop_back();
+
+      // One-shot advises may have fired already, both must agree
+      bool heap_removed = heap.Remove(advise.heap_cookie);
+      bool list_removed = list.Remove(advise.list_cookie);
+      if (heap_removed != list_removed || heap.Remove(advise.heap_cookie))
+      {
+        std::fprintf(stderr, "check: unadvise of %zu differs\n", advise.id);
+        return false;
+      }
+    }
+    else
+    {
+      now += static_cast<int64_t>(random() % 8) * MILLISECOND;
+      heap_fired.clear();
+      list_fired.clear();
+      Dispatch(heap, now, [&heap_fired](void* notify, bool) { heap_fired.push_back(reinterpret_cast<size_t>(notify)); });
+      Dispatch(list, now, [&list_fired](void* notify, bool) { list_fired.push_back(reinterpret_cast<size_t>(notify)); });
+      std::sort(heap_fired.begin(), heap_fired.end());
+      std::sort(list_fired.begin(), list_fired.end());
+      if (heap_fired != list_fired)
+      {
+        std::fprintf(stderr, "check: dispatch at %lld fired %zu advises, expected %zu\n",
+          static_cast<long long>(now), heap_fired.size(), list_fired.size());
+        return false;
+      }
+    }
+
+    if (heap.Size() != list.Size() || heap.NextTime() != list.NextTime())
+    {
+      std::fprintf(stderr, "check: schedules differ after %zu operations\n", op + 1);
+      return false;
+    }
+  }
+
+  // The cookie of a fired or cancelled advise must not find its reused slot
+  for (const Outstanding& advise : outstanding)
+  {
+    heap.Remove(advise.heap_cookie);
+  }
+  for (const Outstanding& advise : outstanding)
+  {
+    if (heap.Remove(advise.heap_cookie))
+    {
+      std::fprintf(stderr, "check: stale cookie removed an advise\n");
+      return false;
+    }
+  }
+
+  return heap.Size() == 0 && heap.NextTime() == CAdviseHeap::NO_ADVISE;
+}
+
+// Advises added before they are cancelled again
+const size_t BATCH = 1024;
+
+struct Result
+{
+  double add_ns = 0.0;
+  double unadvise_ns = 0.0;
+  double dispatch_ns = 0.0;
+  uint64_t fired = 0;
+};
+
+static double NanosecondsPer(Clock::duration elapsed, size_t count)
+{
+  return count ? std::chrono::duration<double, std::nano>(elapsed).count() / count : 0.0;
+}
+
+//
+// One size. Fills the schedule with size advises spread over a second, a
+// quarter of them periodic, then times, at that size:
+//   - adding ops advises and cancelling them again, in random order, BATCH
+//     at a time
+//   - advancing the clock in 1 ms steps until ops advises have fired, one-
+//     shot advises being replaced one second ahead as a clock's clients do
+//
+template <class Schedule> static Result Run(size_t size, size_t ops, uint32_t seed)
+{
+  Result result;
+  std::mt19937_64 random(seed);
+  Schedule schedule;
+
+  const int64_t span = 1000 * MILLISECOND;
+  auto time = [&random, span](int64_t now) { return now + 1 + static_cast<int64_t>(random() % span); };
+  auto period = [&random]() { return static_cast<int64_t>(5 + random() % 20) * MILLISECOND; };
+
+  std::vector<uintptr_t> cookies;
+  cookies.reserve(ops);
+  for (size_t i = 0; i < size; i++)
+  {
+    schedule.Add(time(0), period(), Id(i), i % 4 == 0);
+  }
+
+  // Adds and cancels in batches, the schedule grows to size + BATCH and back
+  size_t batch = std::min(ops, BATCH);
+  Clock::duration add_time = Clock::duration::zero();
+  Clock::duration unadvise_time = Clock::duration::zero();
+  size_t done = 0;
+  while (done < ops)
+  {
+    size_t count = std::min(batch, ops - done);
+    std::vector<int64_t> times(count);
+    for (int64_t& t : times)
+    {
+      t = time(0);
+    }
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; i++)
+    {
+      cookies.push_back(schedule.Add(times[i], 0, Id(size + i), false));
+    }
+    add_time += Clock::now() - start;
+
+    std::shuffle(cookies.begin(), cookies.end(), random);
+
+    start = Clock::now();
+    for (uintptr_t cookie : cookies)
+    {
+      schedule.Remove(cookie);
+    }
+    unadvise_time += Clock::now() - start;
+
+    cookies.clear();
+    done += count;
+  }
+  result.add_ns = NanosecondsPer(add_time, ops);
+  result.unadvise_ns = NanosecondsPer(unadvise_time, ops);
+
+  // Dispatch, the replacements are part of the cost as they are for a clock
+  int64_t now = 0;
+  Clock::time_point start = Clock::now();
+  while (result.fired < ops)
+  {
+    now += MILLISECOND;
+    size_t replace = 0;
+    Dispatch(schedule, now, [&result, &replace](void*, bool periodic)
+    {
+      result.fired++;
+      replace += periodic ? 0 : 1;
+    });
+    for (size_t i = 0; i < replace; i++)
+    {
+      schedule.Add(time(now), 0, Id(i), false);
+    }
+  }
+  result.dispatch_ns = NanosecondsPer(Clock::now() - start, result.fired);
+
+  return result;
+}
+
+struct Options
+{
+  std::vector<size_t> sizes = { 1024, 4096, 16384, 60000 };
+  size_t ops = 100000;
+  size_t list_limit = 4096;
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--sizes", &options->sizes);
+  parser.Add("--ops", &options->ops);
+  parser.Add("--list-limit", &options->list_limit);
+
+  return parser.Parse(argc, argv) && options->ops > 0;
+}
+
+static void PrintResult(bool first, const char* schedule, size_t size, const Result& result)
+{
+  std::printf("%s\n    {\"schedule\": \"%s\", \"outstanding\": %zu, \"add_ns\": %.1f, \"unadvise_ns\": %.1f, "
+    "\"dispatch_ns\": %.1f, \"fired\": %llu}",
+    first ? "" : ",", schedule, size, result.add_ns, result.unadvise_ns, result.dispatch_ns,
+    static_cast<unsigned long long>(result.fired));
+  std::fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--sizes N,N,...] [--ops N] [--list-limit N]\n", argv[0]);
+    return 2;
+  }
+
+  for (uint32_t seed = 1; seed <= 8; seed++)
+  {
+    if (!CheckAgainstList(seed, 10000))
+    {
+      std::fprintf(stderr, "advise heap check failed, seed %u\n", seed);
+      return 1;
+    }
+  }
+
+  std::printf("{\n  \"benchmark\": \"advise_bench\", \"ops\": %zu, \"results\": [", options.ops);
+
+  bool first = true;
+  for (size_t size : options.sizes)
+  {
+    // The heap must keep room for the advises added on top of size
+    if (size + BATCH <= 65536)
+    {
+      PrintResult(first, "heap", size, Run<CAdviseHeap>(size, options.ops, 1));
+      first = false;
+    }
+    if (size <= options.list_limit)
+    {
+      PrintResult(first, "list", size, Run<CListSchedule>(size, options.ops, 1));
+      first = false;
+    }
+  }
+
+  std::printf("\n  ]\n}\n");
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+// Allocation audit of the data path. Streams every format the null output
+// supports through CMixer::Receive and the output's sound loop, passthrough
+// and device format mode, with the core built in ALLOCATION_AUDIT mode, and
+// fails if either hot path allocates after warm-up. Prints a JSON summary
+// on stdout and exits with 1 on any steady state allocation. With --batch
+// the chunks go in through CMixer::ReceiveMultiple, N at a time.
+//
+// Usage: alloc_audit [--seconds N] [--chunk-ms N] [--batch N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "AllocationAudit.h"
+#include "AudioFormat.h"
+#include "BenchOptions.h"
+#include "EventTrace.h"
+#include "Mixer.h"
+#include "NullOutput.h"
+
+#ifndef ALLOCATION_AUDIT
+#error alloc_audit needs the core built with ALLOCATION_AUDIT
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t FREQUENCIES[] = { 8000, 22050, 44100, 48000, 96000, 192000 };
+const MediaBitness BITNESS[] = { bit8, bit16, bit24, bit32, bitfloat };
+const SpeakerLayout LAYOUTS[] = { Mono, Stereo, Quad, Surround6, Surround8 };
+
+// CNullOutput's buffer duration
+const uint32_t DEFAULT_BUFFER_MS = 8;
+
+static const char* BitnessName(MediaBitness bitness)
+{
+  switch (bitness)
+  {
+  case bit8:
+    return "u8";
+  case bit16:
+    return "s16";
+  case bit24:
+    return "s24";
+  case bit32:
+    return "s32";
+  case bitfloat:
+    return "f32";
+  default:
+    return "unknown";
+  }
+}
+
+static const char* LayoutName(SpeakerLayout layout)
+{
+  switch (layout)
+  {
+  case Mono:
+    return "mono";
+  case Stereo:
+    return "stereo";
+  case Quad:
+    return "quad";
+  case Surround6:
+    return "5.1";
+  case Surround8:
+    return "7.1";
+  default:
+    return "unknown";
+  }
+}
+
+struct Options
+{
+  double seconds = 3.0;
+  uint32_t chunk_ms = 10;
+  uint32_t batch = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--seconds", &options->seconds);
+  parser.Add("--chunk-ms", &options->chunk_ms);
+  parser.Add("--batch", &options->batch);
+
+  return parser.Parse(argc, argv) &&
+    options->seconds > 0.0 && options->chunk_ms > 0 && options->batch > 0;
+}
+
+struct CaseResult
+{
+  bool completed = false;
+  uint64_t allocations = 0;
+  uint64_t buffers = 0;
+  size_t receives = 0;
+  // The first allocation flagged, from the event trace
+  const char* hot_path = nullptr;
+  int64_t bytes = 0;
+};
+
+static CaseResult RunCase(const AudioFormat& format, bool device_format, const Options& options)
+{
+  CaseResult result;
+
+  CMixer mixer;
+  CNullOutput output(&mixer);
+  mixer.SetOutput(&output);
+  output.setDeviceFormatMode(device_format);
+  output.setRealtime(false, 0);
+
+  size_t frame_size = GetFrameSize(format.speaker_layout, format.bitness);
+  size_t chunk_frames = std::max<size_t>(1, format.frequency * options.chunk_ms / 1000);
+  size_t num_chunks = static_cast<size_t>(options.seconds * 1000 / options.chunk_ms);
+  std::vector<int8_t> chunk(chunk_frames * frame_size);
+  std::vector<AudioBlock> batch(options.batch, AudioBlock{ chunk.data(), chunk.size() });
+
+  // Only what this case records
+  CEventTrace::Get().Drain(nullptr);
+  uint64_t allocations = GetHotPathAllocations();
+
+  output.OpenDevice();
+  mixer.SetFormat(format);
+  mixer.StartStreaming();
+  output.StartDevice();
+
+  for (size_t i = 0; i < num_chunks; i += batch.size())
+  {
+    if (batch.size() == 1)
+    {
+      mixer.Receive(chunk.data(), chunk.size());
+    }
+    else
+    {
+      mixer.ReceiveMultiple(batch.data(), std::min(batch.size(), num_chunks - i));
+    }
+  }
+  // Everything but the last partial buffer, which waits for more data
+  uint64_t bytes = static_cast<uint64_t>(num_chunks) * chunk.size();
+  uint64_t slack = 2 * format.frequency * DEFAULT_BUFFER_MS / 1000 * frame_size;
+  uint64_t expected = bytes > slack ? bytes - slack : 0;
+
+  Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+  while (mixer.GetBytesMixed() < expected && Clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  result.completed = mixer.GetBytesMixed() >= expected;
+
+  mixer.StopStreaming();
+  output.StopDevice();
+
+  result.allocations = GetHotPathAllocations() - allocations;
+  result.buffers = output.getFramesSubmitted();
+  result.receives = num_chunks;
+
+  CEventTrace::Get().Drain([&result](const TraceEvent& event)
+  {
+    if (event.id == TraceHotPathAllocation && !result.hot_path)
+    {
+      result.hot_path = event.text;
+      result.bytes = event.args[0];
+    }
+  });
+
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--seconds N] [--chunk-ms N] [--batch N]\n", argv[0]);
+    return 2;
+  }
+
+  std::printf("{\n  \"benchmark\": \"alloc_audit\", \"batch\": %u, \"results\": [", options.batch);
+
+  bool first = true;
+  size_t cases = 0;
+  size_t failed = 0;
+  for (bool device_format : { false, true })
+  {
+    for (uint32_t frequency : FREQUENCIES)
+    {
+      for (MediaBitness bitness : BITNESS)
+      {
+        for (SpeakerLayout layout : LAYOUTS)
+        {
+          AudioFormat format = { frequency, layout, bitness };
+
+          CNullOutput probe(nullptr);
+          probe.setDeviceFormatMode(device_format);
+          if (!probe.isFormatSupported(format))
+          {
+            continue;
+          }
+
+          CaseResult result = RunCase(format, device_format, options);
+          bool ok = result.completed && result.allocations == 0;
+          cases++;
+          failed += ok ? 0 : 1;
+
+          std::printf("%s\n    {\"frequency\": %u, \"layout\": \"%s\", \"bitness\": \"%s\", \"mode\": \"%s\", "
+            "\"receives\": %zu, \"frames\": %llu, \"hot_path_allocations\": %llu",
+            first ? "" : ",", frequency, LayoutName(layout), BitnessName(bitness),
+            device_format ? "device" : "passthrough", result.receives,
+            static_cast<unsigned long long>(result.buffers), static_cast<unsigned long long>(result.allocations));
+          if (result.hot_path)
+          {
+            std::printf(", \"first\": {\"hot_path\": \"%s\", \"bytes\": %lld}",
+              result.hot_path, static_cast<long long>(result.bytes));
+          }
+          if (!result.completed)
+          {
+            std::printf(", \"error\": \"stream did not complete\"");
+          }
+          std::printf("}");
+          std::fflush(stdout);
+          first = false;
+        }
+      }
+    }
+  }
+
+  std::printf("\n  ],\n  \"cases\": %zu, \"failed\": %zu\n}\n", cases, failed);
+
+  return failed == 0 ? 0 : 1;
+}
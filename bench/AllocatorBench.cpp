@@ -0,0 +1,407 @@
+// Contention benchmark of the allocator's free list, CBaseAllocator's
+// GetBuffer and ReleaseBuffer. Producer threads get a sample, write to it
+// and release it, as fast as they can, with the free list
+//
+//   locked     as it was: a linked list under the allocator's lock, and
+//              the semaphore when it is empty
+//   lockfree   as CBaseAllocator now does: CFreeList, the semaphore only
+//              when it is empty
+//
+// Each run ends with a Decommit while the producers are still getting
+// samples, which must make them all return not committed and free the
+// samples exactly once, after the last is back. Reports, as JSON on stdout,
+// samples got per second for each thread count and pool size, how often a
+// producer had to wait, and errors: a sample handed to two producers at
+// once, samples lost, or a wrong number of frees, which must be 0.
+//
+// Usage: allocator_bench [--seconds N] [--threads N,N,...] [--buffers N,N,...]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BenchOptions.h"
+#include "FreeList.h"
+
+struct Sample
+{
+  Sample* next = nullptr;
+  std::atomic<int> owners{0};
+  int data = 0;
+};
+
+// A Win32 semaphore
+class CSemaphore
+{
+public:
+  void Release(long count)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_count += count;
+    m_available.notify_all();
+  }
+
+  void Wait()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_available.wait(lock, [this]() { return m_count > 0; });
+    m_count--;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_available;
+  long m_count = 0;
+};
+
+// Shared by both allocators: the samples, the frees and the waits
+class CPoolBase
+{
+public:
+  explicit CPoolBase(size_t count)
+    : m_samples(count)
+  {
+  }
+
+  // Calls to Free, must be 1 after a Decommit
+  int Frees() const
+  {
+    return m_frees;
+  }
+
+  uint64_t Waits() const
+  {
+    return m_waits;
+  }
+
+  size_t Allocated() const
+  {
+    return m_samples.size();
+  }
+
+protected:
+  void Free()
+  {
+    m_frees++;
+  }
+
+  std::vector<Sample> m_samples;
+  std::atomic<int> m_frees{0};
+  std::atomic<uint64_t> m_waits{0};
+  CSemaphore m_semaphore;
+};
+
+// CBaseAllocator as it was
+class CLockedPool : public CPoolBase
+{
+public:
+  explicit CLockedPool(size_t count)
+    : CPoolBase(count)
+  {
+    for (Sample& sample : m_samples)
+    {
+      sample.next = m_free;
+      m_free = &sample;
+      m_free_count++;
+    }
+  }
+
+  // False when not committed
+  bool GetBuffer(Sample** buffer)
+  {
+    for (;;)
+    {
+      Sample* sample;
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_committed)
+        {
+          return false;
+        }
+        sample = m_free;
+        if (sample)
+        {
+          m_free = sample->next;
+          m_free_count--;
+        }
+        else
+        {
+          m_waiting++;
+        }
+      }
+
+      if (sample)
+      {
+        *buffer = sample;
+        return true;
+      }
+      m_waits++;
+      m_semaphore.Wait();
+    }
+  }
+
+  void ReleaseBuffer(Sample* sample)
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    sample->next = m_free;
+    m_free = sample;
+    m_free_count++;
+    NotifySample();
+
+    if (m_decommit_in_progress && m_free_count == Allocated())
+    {
+      Free();
+      m_decommit_in_progress = false;
+    }
+  }
+
+  void Decommit()
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_committed = false;
+    if (m_free_count < Allocated())
+    {
+      m_decommit_in_progress = true;
+    }
+    else
+    {
+      Free();
+    }
+    NotifySample();
+  }
+
+  size_t FreeCount() const
+  {
+    return m_free_count;
+  }
+
+private:
+  void NotifySample()
+  {
+    if (m_waiting != 0)
+    {
+      m_semaphore.Release(m_waiting);
+      m_waiting = 0;
+    }
+  }
+
+  std::mutex m_lock;
+  Sample* m_free = nullptr;
+  size_t m_free_count = 0;
+  long m_waiting = 0;
+  bool m_committed = true;
+  bool m_decommit_in_progress = false;
+};
+
+// CBaseAllocator now, the interlocked operations as std::atomic
+class CLockFreePool : public CPoolBase
+{
+public:
+  explicit CLockFreePool(size_t count)
+    : CPoolBase(count)
+  {
+    m_free.Reserve(count);
+    for (Sample& sample : m_samples)
+    {
+      m_free.Push(&sample);
+    }
+  }
+
+  bool GetBuffer(Sample** buffer)
+  {
+    for (;;)
+    {
+      m_getting++;
+      if (!m_committed)
+      {
+        m_getting--;
+        return false;
+      }
+      Sample* sample = static_cast<Sample*>(m_free.Pop());
+      if (!sample)
+      {
+        m_waiting++;
+        sample = static_cast<Sample*>(m_free.Pop());
+      }
+      m_getting--;
+
+      if (sample)
+      {
+        *buffer = sample;
+        return true;
+      }
+      m_waits++;
+      m_semaphore.Wait();
+    }
+  }
+
+  void ReleaseBuffer(Sample* sample)
+  {
+    m_free.Push(sample);
+    NotifySample();
+
+    if (m_decommit_in_progress)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      if (m_decommit_in_progress && static_cast<size_t>(m_free.Count()) == Allocated())
+      {
+        Free();
+        m_decommit_in_progress = false;
+      }
+    }
+  }
+
+  void Decommit()
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_committed = false;
+    while (m_getting != 0)
+    {
+      std::this_thread::yield();
+    }
+
+    m_decommit_in_progress = true;
+    if (static_cast<size_t>(m_free.Count()) == Allocated())
+    {
+      m_decommit_in_progress = false;
+      Free();
+    }
+    NotifySample();
+  }
+
+  size_t FreeCount() const
+  {
+    return static_cast<size_t>(m_free.Count());
+  }
+
+private:
+  void NotifySample()
+  {
+    if (m_waiting != 0)
+    {
+      long waiting = m_waiting.exchange(0);
+      if (waiting != 0)
+      {
+        m_semaphore.Release(waiting);
+      }
+    }
+  }
+
+  std::mutex m_lock;
+  CFreeList m_free;
+  std::atomic<long> m_waiting{0};
+  std::atomic<long> m_getting{0};
+  std::atomic<bool> m_committed{true};
+  std::atomic<bool> m_decommit_in_progress{false};
+};
+
+struct Result
+{
+  double samples_per_second = 0.0;
+  uint64_t waits = 0;
+  uint64_t errors = 0;
+};
+
+template <class P> static Result Run(size_t num_threads, size_t buffers, double seconds)
+{
+  P pool(buffers);
+  std::atomic<uint64_t> got{0};
+  std::atomic<uint64_t> errors{0};
+
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < num_threads; i++)
+  {
+    producers.emplace_back([&]()
+    {
+      uint64_t count = 0;
+      uint64_t shared = 0;
+      Sample* sample;
+      // Until the Decommit
+      while (pool.GetBuffer(&sample))
+      {
+        shared += sample->owners.fetch_add(1) != 0 ? 1 : 0;
+        sample->data++;
+        sample->owners.fetch_sub(1);
+        pool.ReleaseBuffer(sample);
+        count++;
+      }
+      got += count;
+      errors += shared;
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  pool.Decommit();
+  for (std::thread& producer : producers)
+  {
+    producer.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  Result result;
+  result.samples_per_second = got / elapsed;
+  result.waits = pool.Waits();
+  result.errors = errors + (pool.Frees() != 1 ? 1 : 0) + (pool.FreeCount() != pool.Allocated() ? 1 : 0);
+  return result;
+}
+
+struct Options
+{
+  double seconds = 0.5;
+  std::vector<size_t> threads = { 1, 2, 4, 8 };
+  std::vector<size_t> buffers = { 2, 16 };
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--seconds", &options->seconds);
+  parser.Add("--threads", &options->threads);
+  parser.Add("--buffers", &options->buffers);
+
+  return parser.Parse(argc, argv) && options->seconds > 0.0;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--seconds N] [--threads N,N,...] [--buffers N,N,...]\n", argv[0]);
+    return 2;
+  }
+
+  std::printf("{\n  \"benchmark\": \"allocator_bench\", \"hardware_threads\": %u, \"results\": [",
+    std::thread::hardware_concurrency());
+
+  bool first = true;
+  uint64_t errors = 0;
+  for (size_t buffers : options.buffers)
+  {
+    for (size_t threads : options.threads)
+    {
+      Result locked = Run<CLockedPool>(threads, buffers, options.seconds);
+      Result lockfree = Run<CLockFreePool>(threads, buffers, options.seconds);
+      errors += locked.errors + lockfree.errors;
+
+      std::printf("%s\n    {\"buffers\": %zu, \"threads\": %zu, \"locked_per_second\": %.0f, "
+        "\"lockfree_per_second\": %.0f, \"locked_waits\": %llu, \"lockfree_waits\": %llu, \"errors\": %llu}",
+        first ? "" : ",", buffers, threads, locked.samples_per_second, lockfree.samples_per_second,
+        static_cast<unsigned long long>(locked.waits), static_cast<unsigned long long>(lockfree.waits),
+        static_cast<unsigned long long>(locked.errors + lockfree.errors));
+      std::fflush(stdout);
+      first = false;
+    }
+  }
+
+  std::printf("\n  ]\n}\n");
+
+  return errors == 0 ? 0 : 1;
+}
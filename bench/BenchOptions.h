@@ -0,0 +1,175 @@
+// Command line and measurement helpers shared by the benchmarks. A benchmark
+// declares its options on a CBenchOptions, parses, then checks the values:
+//
+//   CBenchOptions parser;
+//   parser.Add("--seconds", &options->seconds);
+//   parser.Add("--threads", &options->threads);
+//   return parser.Parse(argc, argv) && options->seconds > 0.0;
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Comma separated positive integers, replaces the defaults in values
+template <class T>
+bool ParseList(const char* list, std::vector<T>* values)
+{
+  values->clear();
+  for (const char* p = list; *p; )
+  {
+    char* end = nullptr;
+    long long value = std::strtoll(p, &end, 10);
+    if (end == p || value <= 0 || (*end != ',' && *end != '\0'))
+    {
+      return false;
+    }
+    values->push_back(static_cast<T>(value));
+    p = *end == ',' ? end + 1 : end;
+  }
+  return !values->empty();
+}
+
+class CBenchOptions
+{
+public:
+  // --name followed by a value, which has to parse in full
+  void Add(const char* name, double* value)
+  {
+    AddValue(name, [value](const char* text)
+    {
+      char* end = nullptr;
+      *value = std::strtod(text, &end);
+      return end != text && *end == '\0';
+    });
+  }
+
+  void Add(const char* name, std::string* value)
+  {
+    AddValue(name, [value](const char* text) { *value = text; return true; });
+  }
+
+  template <class T>
+  void Add(const char* name, std::vector<T>* values)
+  {
+    AddValue(name, [values](const char* text) { return ParseList(text, values); });
+  }
+
+  template <class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+  void Add(const char* name, T* value)
+  {
+    AddValue(name, [value](const char* text)
+    {
+      // strtoull would take a minus sign and wrap around
+      char* end = nullptr;
+      *value = static_cast<T>(std::strtoull(text, &end, 10));
+      return text[0] != '-' && end != text && *end == '\0';
+    });
+  }
+
+  // --name on its own sets value
+  void AddFlag(const char* name, bool* value)
+  {
+    m_options.push_back({ name, false, [value](const char*) { *value = true; return true; } });
+  }
+
+  // The one argument that isn't an option
+  void AddPositional(std::string* value)
+  {
+    m_positional = value;
+  }
+
+  // False on an unknown option, a missing or malformed value, or a second
+  // positional argument
+  bool Parse(int argc, char** argv) const
+  {
+    bool positional_seen = false;
+    for (int i = 1; i < argc; i++)
+    {
+      const char* arg = argv[i];
+      auto option = std::find_if(m_options.cbegin(), m_options.cend(),
+        [arg](const Option& o) { return std::strcmp(o.name, arg) == 0; });
+
+      if (option == m_options.cend())
+      {
+        if (!m_positional || arg[0] == '-' || positional_seen)
+        {
+          return false;
+        }
+        *m_positional = arg;
+        positional_seen = true;
+      }
+      else if (!option->takes_value)
+      {
+        option->parse(nullptr);
+      }
+      else if (i + 1 >= argc || !option->parse(argv[++i]))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+private:
+  struct Option
+  {
+    const char* name;
+    bool takes_value;
+    std::function<bool(const char*)> parse;
+  };
+
+  void AddValue(const char* name, std::function<bool(const char*)> parse)
+  {
+    m_options.push_back({ name, true, std::move(parse) });
+  }
+
+  std::vector<Option> m_options;
+  std::string* m_positional = nullptr;
+};
+
+// Value at fraction of the sorted values, reorders them
+inline double Percentile(std::vector<double>* values, double fraction)
+{
+  if (values->empty())
+  {
+    return 0.0;
+  }
+
+  size_t index = std::min(values->size() - 1, static_cast<size_t>(fraction * values->size()));
+  std::nth_element(values->begin(), values->begin() + index, values->end());
+  return (*values)[index];
+}
+
+// User and kernel time of the whole process so far
+inline double ProcessCpuSeconds()
+{
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+  auto to_seconds = [](const FILETIME& time)
+  {
+    return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+  };
+  return to_seconds(kernel) + to_seconds(user);
+#else
+  rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
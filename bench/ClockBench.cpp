@@ -0,0 +1,247 @@
+// The reference clock's time base and GetTime throughput. First the
+// resolution and cost of the system clocks, then threads call GetTime in a loop
+// while a writer adjusts the clock every millisecond, as SetTimeDelta does,
+// with GetTime implemented
+//
+//   mutex     as it was: the private time advanced and the last time
+//             returned checked under one lock
+//   seqlock   as CBaseReferenceClock now does: a snapshot read through
+//             CClockSeqlock and CMonotonicTime, no lock
+//
+// and reports, as JSON on stdout, the smallest step and ns per call of each
+// system clock, GetTime calls per second for each thread count, and the
+// number of times a thread saw time go backwards, which must be 0.
+//
+// Usage: clock_bench [--seconds N] [--threads N,N,...]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchOptions.h"
+#include "Clock.h"
+#include "ClockSeqlock.h"
+
+// The clock before, CBaseReferenceClock::GetTime and GetPrivateTime
+class CLockedClock
+{
+public:
+  CLockedClock()
+  {
+    m_previous_system_time = m_system_clock.GetTime();
+    m_private_time = m_previous_system_time;
+  }
+
+  int64_t GetTime()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int64_t now = m_system_clock.GetTime();
+    m_private_time += now - m_previous_system_time;
+    m_previous_system_time = now;
+    if (m_private_time > m_last_got_time)
+    {
+      m_last_got_time = m_private_time;
+    }
+    return m_last_got_time;
+  }
+
+  void SetTimeDelta(int64_t delta)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_private_time += delta;
+  }
+
+private:
+  CPerformanceClock m_system_clock;
+  std::mutex m_mutex;
+  int64_t m_private_time;
+  int64_t m_previous_system_time;
+  int64_t m_last_got_time = 0;
+};
+
+// The clock now
+class CSeqlockClock
+{
+public:
+  // Starts at the system time
+  CSeqlockClock()
+    : m_snapshot(0, 0, 1.0)
+  {
+  }
+
+  int64_t GetTime()
+  {
+    ClockSnapshot snapshot = m_snapshot.Read();
+    int64_t time = CClockSeqlock::Extrapolate(snapshot, m_system_clock.GetTime());
+    bool advanced;
+    return m_last_got_time.Advance(time, &advanced);
+  }
+
+  // The only writer
+  void SetTimeDelta(int64_t delta)
+  {
+    ClockSnapshot snapshot = m_snapshot.Read();
+    int64_t now = m_system_clock.GetTime();
+    m_snapshot.Publish(CClockSeqlock::Extrapolate(snapshot, now) + delta, now, snapshot.rate);
+  }
+
+private:
+  CPerformanceClock m_system_clock;
+  CClockSeqlock m_snapshot;
+  CMonotonicTime m_last_got_time;
+};
+
+struct ClockResult
+{
+  int64_t resolution = 0;   // smallest step seen, 100 ns units
+  double ns_per_call = 0.0;
+};
+
+template <class C> static ClockResult MeasureClock()
+{
+  const int CALLS = 1000000;
+  C clock;
+  ClockResult result;
+
+  int64_t last = clock.GetTime();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CALLS; i++)
+  {
+    int64_t time = clock.GetTime();
+    if (time != last && (result.resolution == 0 || time - last < result.resolution))
+    {
+      result.resolution = time - last;
+    }
+    last = time;
+  }
+  result.ns_per_call = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / CALLS;
+
+  return result;
+}
+
+struct Result
+{
+  double calls_per_second = 0.0;
+  uint64_t backwards = 0;
+};
+
+template <class C> static Result Run(size_t num_threads, double seconds)
+{
+  C clock;
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> backwards{0};
+
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < num_threads; i++)
+  {
+    readers.emplace_back([&]()
+    {
+      uint64_t count = 0;
+      uint64_t back = 0;
+      int64_t last = 0;
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        // Batches, so the stop flag is not what is measured
+        for (int j = 0; j < 256; j++)
+        {
+          int64_t time = clock.GetTime();
+          back += time < last ? 1 : 0;
+          last = time;
+        }
+        count += 256;
+      }
+      calls += count;
+      backwards += back;
+    });
+  }
+
+  // Small adjustments both ways, the last time returned keeps forward ones
+  // from being seen backwards
+  std::thread writer([&]()
+  {
+    int64_t delta = 50;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      clock.SetTimeDelta(delta);
+      delta = -delta;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (std::thread& reader : readers)
+  {
+    reader.join();
+  }
+  writer.join();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  Result result;
+  result.calls_per_second = calls / elapsed;
+  result.backwards = backwards;
+  return result;
+}
+
+struct Options
+{
+  double seconds = 1.0;
+  std::vector<size_t> threads = { 1, 2, 4, 8 };
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--seconds", &options->seconds);
+  parser.Add("--threads", &options->threads);
+
+  return parser.Parse(argc, argv) && options->seconds > 0.0;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--seconds N] [--threads N,N,...]\n", argv[0]);
+    return 2;
+  }
+
+  ClockResult steady = MeasureClock<CMonotonicClock>();
+  ClockResult performance = MeasureClock<CPerformanceClock>();
+  std::printf("{\n  \"benchmark\": \"clock_bench\", \"hardware_threads\": %u,\n"
+    "  \"system_clocks\": [\n"
+    "    {\"clock\": \"monotonic\", \"resolution_ns\": %lld, \"ns_per_call\": %.1f},\n"
+    "    {\"clock\": \"performance\", \"resolution_ns\": %lld, \"ns_per_call\": %.1f}\n"
+    "  ],\n  \"results\": [",
+    std::thread::hardware_concurrency(), static_cast<long long>(steady.resolution * 100), steady.ns_per_call,
+    static_cast<long long>(performance.resolution * 100), performance.ns_per_call);
+
+  bool first = true;
+  uint64_t backwards = 0;
+  for (size_t threads : options.threads)
+  {
+    Result locked = Run<CLockedClock>(threads, options.seconds);
+    Result seqlock = Run<CSeqlockClock>(threads, options.seconds);
+    backwards += locked.backwards + seqlock.backwards;
+
+    std::printf("%s\n    {\"threads\": %zu, \"mutex_calls_per_second\": %.0f, \"seqlock_calls_per_second\": %.0f, "
+      "\"backwards\": %llu}",
+      first ? "" : ",", threads, locked.calls_per_second, seqlock.calls_per_second,
+      static_cast<unsigned long long>(locked.backwards + seqlock.backwards));
+    std::fflush(stdout);
+    first = false;
+  }
+
+  std::printf("\n  ]\n}\n");
+
+  return backwards == 0 ? 0 : 1;
+}
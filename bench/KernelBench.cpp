@@ -0,0 +1,296 @@
+// Microbenchmarks of the sample queue copies and the conversion kernels.
+// Every kernel runs over 64 to 65536 frames of 1 to 8 channels and reports
+// GB/s of input plus output, nanoseconds and TSC cycles per sample, as JSON
+// on stdout.
+//
+// The same sources are built several times by CMake, without vectorization,
+// for the x86-64 baseline (SSE2) and for AVX2, so the results show what the
+// compiler makes of the kernels at each level. KERNEL_BENCH_ISA names the
+// build.
+//
+// The input the kernels read starts on a cache line, as the renderer's
+// allocator hands out samples, or --input-offset bytes past one, to see
+// what misaligned samples from another allocator cost.
+//
+// Usage: kernel_bench_<isa> [--min-ms N] [--input-offset N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "AudioConverter.h"
+#include "SampleQueue.h"
+
+#ifndef KERNEL_BENCH_ISA
+#define KERNEL_BENCH_ISA "native"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t CHANNELS[] = { 1, 2, 4, 6, 8 };
+const size_t MIN_FRAMES = 64;
+const size_t MAX_FRAMES = 65536;
+
+// Timed batches per measurement, the fastest one is reported
+const int BATCHES = 5;
+
+static bool HasTimestampCounter()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+static uint64_t ReadTimestampCounter()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Timing
+{
+  double seconds;
+  uint64_t cycles;
+};
+
+//
+// Measure
+//
+// Runs kernel in batches of at least min_seconds / BATCHES and returns the
+// time and cycles per call of the fastest batch.
+//
+template <class Kernel>
+static Timing Measure(Kernel kernel, double min_seconds)
+{
+  // Warm the caches and find a batch size
+  size_t iterations = 1;
+  for (;;)
+  {
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+      kernel();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (elapsed >= min_seconds / BATCHES || iterations >= (size_t(1) << 30))
+    {
+      break;
+    }
+    iterations *= 2;
+  }
+
+  Timing best = { 1e30, 0 };
+  for (int batch = 0; batch < BATCHES; batch++)
+  {
+    uint64_t cycles_start = ReadTimestampCounter();
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+      kernel();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t cycles = ReadTimestampCounter() - cycles_start;
+
+    if (elapsed / iterations < best.seconds)
+    {
+      best = { elapsed / iterations, cycles / iterations };
+    }
+  }
+
+  return best;
+}
+
+static void PrintResult(bool* first, const char* kernel, size_t input_channels, size_t output_channels,
+  size_t frames, size_t bytes, const Timing& timing)
+{
+  size_t samples = frames * input_channels;
+
+  std::printf("%s\n    {\"kernel\": \"%s\", \"channels\": %zu, ", *first ? "" : ",", kernel, input_channels);
+  if (output_channels)
+  {
+    std::printf("\"output_channels\": %zu, ", output_channels);
+  }
+  std::printf("\"frames\": %zu, \"gb_per_second\": %.3f, \"ns_per_sample\": %.4f",
+    frames, bytes / timing.seconds / 1e9, timing.seconds * 1e9 / samples);
+  if (HasTimestampCounter())
+  {
+    std::printf(", \"cycles_per_sample\": %.4f", static_cast<double>(timing.cycles) / samples);
+  }
+  std::printf("}");
+  std::fflush(stdout);
+
+  *first = false;
+}
+
+// Filled with a ramp so no kernel sees only zeros
+static std::vector<int8_t> MakeInput(size_t bytes)
+{
+  std::vector<int8_t> data(bytes);
+  for (size_t i = 0; i < bytes; i++)
+  {
+    data[i] = static_cast<int8_t>(i * 7);
+  }
+  return data;
+}
+
+int main(int argc, char** argv)
+{
+  double min_seconds = 0.01;
+  size_t input_offset = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc)
+    {
+      min_seconds = std::atof(argv[++i]) / 1000.0;
+    }
+    else if (std::strcmp(argv[i], "--input-offset") == 0 && i + 1 < argc)
+    {
+      input_offset = std::strtoul(argv[++i], nullptr, 10) % 64;
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: %s [--min-ms N] [--input-offset N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+#if defined(__GNUC__) && defined(__AVX2__)
+  if (!__builtin_cpu_supports("avx2"))
+  {
+    std::fprintf(stderr, "This build needs a CPU with AVX2\n");
+    return 1;
+  }
+#endif
+
+  std::printf("{\n  \"benchmark\": \"kernels\", \"isa\": \"%s\", \"input_offset\": %zu,\n  \"results\": [",
+    KERNEL_BENCH_ISA, input_offset);
+
+  // Largest buffers any kernel needs, 8 channels of 4 byte samples, with
+  // room to move the input to the offset from a cache line
+  std::vector<int8_t> input_buffer = MakeInput(MAX_FRAMES * 8 * sizeof(float) + 128);
+  int8_t* input = input_buffer.data() + (64 - reinterpret_cast<uintptr_t>(input_buffer.data()) % 64) % 64
+    + input_offset;
+  std::vector<float> floats(MAX_FRAMES * 8);
+  std::vector<float> converted(MAX_FRAMES * 8);
+  for (size_t i = 0; i < floats.size(); i++)
+  {
+    floats[i] = (static_cast<int>(i % 200) - 100) / 100.0f;
+  }
+  std::vector<int8_t> output(MAX_FRAMES * 8 * sizeof(float));
+
+  bool first = true;
+  for (size_t channels : CHANNELS)
+  {
+    std::fprintf(stderr, "%zu channels\n", channels);
+
+    for (size_t frames = MIN_FRAMES; frames <= MAX_FRAMES; frames *= 2)
+    {
+      size_t samples = frames * channels;
+
+      // CopyWaveform, 16-bit frames into the queue
+      CSampleQueue queue;
+      size_t length = samples * sizeof(int16_t);
+      Timing timing = Measure([&]()
+      {
+        queue.Push(input, length);
+        queue.Discard(length);
+      }, min_seconds);
+      PrintResult(&first, "queue_push", channels, 0, frames, length * 2, timing);
+
+      // Followed by the pop in Mix
+      timing = Measure([&]()
+      {
+        queue.Push(input, length);
+        queue.Pop(output.data(), length);
+      }, min_seconds);
+      PrintResult(&first, "queue_push_pop", channels, 0, frames, length * 4, timing);
+
+      timing = Measure([&]()
+      {
+        ConvertU8ToFloat(reinterpret_cast<const uint8_t*>(input), converted.data(), samples);
+      }, min_seconds);
+      PrintResult(&first, "u8_to_float", channels, 0, frames, samples * 5, timing);
+
+      timing = Measure([&]()
+      {
+        ConvertS16ToFloat(reinterpret_cast<const int16_t*>(input), converted.data(), samples);
+      }, min_seconds);
+      PrintResult(&first, "s16_to_float", channels, 0, frames, samples * 6, timing);
+
+      timing = Measure([&]()
+      {
+        ConvertS24ToFloat(reinterpret_cast<const uint8_t*>(input), converted.data(), samples);
+      }, min_seconds);
+      PrintResult(&first, "s24_to_float", channels, 0, frames, samples * 7, timing);
+
+      timing = Measure([&]()
+      {
+        ConvertS32ToFloat(reinterpret_cast<const int32_t*>(input), converted.data(), samples);
+      }, min_seconds);
+      PrintResult(&first, "s32_to_float", channels, 0, frames, samples * 8, timing);
+
+      timing = Measure([&]()
+      {
+        ConvertFloatToS16(floats.data(), reinterpret_cast<int16_t*>(output.data()), samples);
+      }, min_seconds);
+      PrintResult(&first, "float_to_s16", channels, 0, frames, samples * 6, timing);
+
+      // Up and downmix to every other channel count, with a full matrix
+      for (size_t output_channels : CHANNELS)
+      {
+        if (output_channels == channels)
+        {
+          continue;
+        }
+
+        std::vector<float> matrix(output_channels * channels, 0.5f);
+        timing = Measure([&]()
+        {
+          MixChannels(floats.data(), channels, converted.data(), output_channels, matrix.data(), frames);
+        }, min_seconds);
+        PrintResult(&first, "mix_channels", channels, output_channels, frames,
+          frames * (channels + output_channels) * sizeof(float), timing);
+      }
+    }
+  }
+
+  // The whole device format mode chain, 44.1 kHz 16-bit to 48 kHz float
+  // stereo: decode, mix and resample
+  const SpeakerLayout layouts[] = { Mono, Stereo, Quad, Surround6, Surround8 };
+  for (SpeakerLayout layout : layouts)
+  {
+    size_t channels = GetChannelCount(layout);
+    for (size_t frames = MIN_FRAMES; frames <= MAX_FRAMES; frames *= 2)
+    {
+      CAudioConverter converter;
+      converter.SetFormats({ 44100, layout, bit16 }, { 48000, Stereo, bitfloat });
+
+      Timing timing = Measure([&]()
+      {
+        size_t input_frames = std::min(converter.InputFramesNeeded(frames), MAX_FRAMES);
+        converter.Convert(input, input_frames, output.data(), frames);
+      }, min_seconds);
+      size_t input_frames = frames * 44100 / 48000;
+      PrintResult(&first, "convert_s16_44100_to_f32_48000_stereo", channels, 2, input_frames,
+        input_frames * channels * sizeof(int16_t) + frames * 2 * sizeof(float), timing);
+    }
+  }
+
+  std::printf("\n  ]\n}\n");
+  return 0;
+}
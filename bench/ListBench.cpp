@@ -0,0 +1,368 @@
+// Node churn of the base classes' lists, CBaseList, with nodes from the heap
+// as it was against nodes from CBlockPool as CNode now allocates them. Both
+// keep CBaseList's per-list cache of DEFAULTCACHE nodes, so only lists
+// growing past it allocate. Two patterns:
+//
+//   output_queue   COutputQueue: one thread adds bursts of samples to the
+//                  tail of a locked list, the queue thread removes them from
+//                  the head, so nodes are made on one thread and freed on
+//                  the other
+//   lists          every thread fills a list of its own and empties it again,
+//                  as the allocators and pin lists do
+//
+// Reports, as JSON on stdout, list operations per second for each thread
+// count and burst depth, the blocks the pool carved, and errors: items out
+// of order or lost, which must be 0.
+//
+// Usage: list_bench [--seconds N] [--threads N,N,...] [--depths N,N,...]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "BenchOptions.h"
+#include "BlockPool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// CBaseList's
+const int DEFAULTCACHE = 10;
+
+struct HeapNode
+{
+  HeapNode* prev;
+  HeapNode* next;
+  uintptr_t data;
+};
+
+// CBaseList::CNode now
+struct PooledNode
+{
+  PooledNode* prev;
+  PooledNode* next;
+  uintptr_t data;
+
+  static CBlockPool* Pool()
+  {
+    static CBlockPool* pool = CBlockPool::Get(sizeof(PooledNode));
+    return pool;
+  }
+
+  void* operator new(size_t size) throw()
+  {
+    CBlockPool* pool = Pool();
+    if (!pool || size > pool->BlockSize())
+    {
+      return ::operator new(size, std::nothrow);
+    }
+    return pool->Allocate();
+  }
+
+  void operator delete(void* block, size_t size)
+  {
+    CBlockPool* pool = Pool();
+    if (!pool || size > pool->BlockSize())
+    {
+      ::operator delete(block);
+      return;
+    }
+    pool->Free(block);
+  }
+};
+
+// The node handling of CBaseList: AddTail, RemoveHead and the node cache
+template <class N> class CList
+{
+public:
+  ~CList()
+  {
+    while (m_first)
+    {
+      N* node = m_first;
+      m_first = node->next;
+      delete node;
+    }
+    while (m_cache)
+    {
+      N* node = m_cache;
+      m_cache = node->next;
+      delete node;
+    }
+  }
+
+  bool AddTail(uintptr_t data)
+  {
+    N* node = m_cache;
+    if (node)
+    {
+      m_cache = node->next;
+      m_cached--;
+    }
+    else
+    {
+      node = new N;
+      if (!node)
+      {
+        return false;
+      }
+    }
+
+    node->data = data;
+    node->next = nullptr;
+    node->prev = m_last;
+    if (m_last)
+    {
+      m_last->next = node;
+    }
+    else
+    {
+      m_first = node;
+    }
+    m_last = node;
+    m_count++;
+    return true;
+  }
+
+  // false when empty
+  bool RemoveHead(uintptr_t* data)
+  {
+    N* node = m_first;
+    if (!node)
+    {
+      return false;
+    }
+
+    m_first = node->next;
+    if (m_first)
+    {
+      m_first->prev = nullptr;
+    }
+    else
+    {
+      m_last = nullptr;
+    }
+    m_count--;
+    *data = node->data;
+
+    if (m_cached < DEFAULTCACHE)
+    {
+      node->next = m_cache;
+      m_cache = node;
+      m_cached++;
+    }
+    else
+    {
+      delete node;
+    }
+    return true;
+  }
+
+  long GetCount() const
+  {
+    return m_count;
+  }
+
+private:
+  N* m_first = nullptr;
+  N* m_last = nullptr;
+  long m_count = 0;
+  N* m_cache = nullptr;
+  int m_cached = 0;
+};
+
+struct Result
+{
+  double operations_per_second = 0.0;
+  uint64_t errors = 0;
+};
+
+// A producer adding bursts of depth items, a queue thread taking them off
+// in order, both under the queue's lock
+template <class N> static Result RunOutputQueue(size_t depth, double seconds)
+{
+  CList<N> list;
+  std::mutex lock;
+  std::condition_variable has_items;
+  std::condition_variable has_room;
+  std::atomic<bool> run{true};
+  uint64_t operations = 0;
+  uint64_t errors = 0;
+
+  std::thread queue([&]()
+  {
+    uintptr_t expected = 0;
+    uint64_t removed = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;)
+    {
+      has_items.wait(guard, [&]() { return list.GetCount() != 0 || !run; });
+      uintptr_t data;
+      while (list.RemoveHead(&data))
+      {
+        errors += data != expected ? 1 : 0;
+        expected = data + 1;
+        removed++;
+      }
+      has_room.notify_one();
+      if (!run)
+      {
+        break;
+      }
+    }
+    operations += removed;
+  });
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>(seconds));
+  uintptr_t next = 0;
+  while (Clock::now() < deadline)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    // Wait for the queue thread to catch up, as COutputQueue's batches do
+    has_room.wait(guard, [&]() { return list.GetCount() < static_cast<long>(depth); });
+    for (size_t i = 0; i < depth; i++)
+    {
+      errors += list.AddTail(next++) ? 0 : 1;
+    }
+    has_items.notify_one();
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    run = false;
+  }
+  has_items.notify_one();
+  queue.join();
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // Everything added was removed
+  errors += operations != next ? 1 : 0;
+
+  Result result;
+  result.operations_per_second = 2.0 * operations / elapsed;
+  result.errors = errors;
+  return result;
+}
+
+// Every thread filling and emptying a list of its own
+template <class N> static Result RunLists(size_t num_threads, size_t depth, double seconds)
+{
+  std::atomic<uint64_t> operations{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<bool> run{true};
+
+  std::vector<std::thread> threads;
+  Clock::time_point start = Clock::now();
+  for (size_t t = 0; t < num_threads; t++)
+  {
+    threads.emplace_back([&]()
+    {
+      CList<N> list;
+      uint64_t count = 0;
+      uint64_t wrong = 0;
+      while (run)
+      {
+        for (size_t i = 0; i < depth; i++)
+        {
+          wrong += list.AddTail(i) ? 0 : 1;
+        }
+        uintptr_t data;
+        uintptr_t expected = 0;
+        while (list.RemoveHead(&data))
+        {
+          wrong += data != expected++ ? 1 : 0;
+        }
+        wrong += expected != depth ? 1 : 0;
+        count += 2 * depth;
+      }
+      operations += count;
+      errors += wrong;
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  run = false;
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  Result result;
+  result.operations_per_second = operations / elapsed;
+  result.errors = errors;
+  return result;
+}
+
+struct Options
+{
+  double seconds = 0.5;
+  std::vector<size_t> threads = { 1, 2, 4 };
+  std::vector<size_t> depths = { 8, 64, 512 };
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--seconds", &options->seconds);
+  parser.Add("--threads", &options->threads);
+  parser.Add("--depths", &options->depths);
+
+  return parser.Parse(argc, argv) && options->seconds > 0.0;
+}
+
+static void PrintResult(bool* first, const char* pattern, size_t threads, size_t depth,
+  const Result& heap, const Result& pool)
+{
+  std::printf("%s\n    {\"pattern\": \"%s\", \"threads\": %zu, \"depth\": %zu, \"heap_per_second\": %.0f, "
+    "\"pool_per_second\": %.0f, \"errors\": %llu}",
+    *first ? "" : ",", pattern, threads, depth, heap.operations_per_second, pool.operations_per_second,
+    static_cast<unsigned long long>(heap.errors + pool.errors));
+  std::fflush(stdout);
+  *first = false;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--seconds N] [--threads N,N,...] [--depths N,N,...]\n", argv[0]);
+    return 2;
+  }
+
+  std::printf("{\n  \"benchmark\": \"list_bench\", \"hardware_threads\": %u, \"results\": [",
+    std::thread::hardware_concurrency());
+
+  bool first = true;
+  uint64_t errors = 0;
+  for (size_t depth : options.depths)
+  {
+    Result heap = RunOutputQueue<HeapNode>(depth, options.seconds);
+    Result pool = RunOutputQueue<PooledNode>(depth, options.seconds);
+    errors += heap.errors + pool.errors;
+    PrintResult(&first, "output_queue", 2, depth, heap, pool);
+
+    for (size_t threads : options.threads)
+    {
+      heap = RunLists<HeapNode>(threads, depth, options.seconds);
+      pool = RunLists<PooledNode>(threads, depth, options.seconds);
+      errors += heap.errors + pool.errors;
+      PrintResult(&first, "lists", threads, depth, heap, pool);
+    }
+  }
+
+  CBlockPool* pool = PooledNode::Pool();
+  std::printf("\n  ],\n  \"pool_blocks\": %zu, \"errors\": %llu\n}\n", pool ? pool->Capacity() : 0,
+    static_cast<unsigned long long>(errors));
+
+  return errors == 0 ? 0 : 1;
+}
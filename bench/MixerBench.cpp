@@ -0,0 +1,480 @@
+// End-to-end benchmark of the mixer path. Feeds a synthetic sine through
+// CMixer::Receive for every supported combination of rate, bitness and
+// speaker layout, lets an output backend pull it through Mix as fast as it
+// can and reports, as JSON on stdout:
+//
+//   frames_per_second        input frames processed per wall clock second
+//   cpu_per_audio_second     process CPU seconds spent per second of audio
+//   allocations_per_buffer   heap allocations on the output thread per
+//                            buffer, after warm-up
+//   allocations_per_receive  heap allocations per Receive, after warm-up
+//   latency_us               p50/p99/p999 from the Receive call of a chunk
+//                            to the buffer submission holding its last byte
+//
+// Usage: mixer_bench [--backend null|loopback] [--mode passthrough|device|all]
+//                    [--seconds N] [--chunk-ms N]
+//
+// The null backend needs nothing. The loopback backend runs the real
+// COpenALOutput sound loop on an OpenAL Soft loopback device, with and
+// without AL_SOFT_direct_channels, so alBufferData and OpenAL's own mixing
+// are part of the measurement.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocationAudit.h"
+#include "AudioFormat.h"
+#include "BenchOptions.h"
+#include "Mixer.h"
+#include "NullOutput.h"
+#include "OpenALLoopbackOutput.h"
+
+//
+// Allocation counting. Every allocation of the process goes through here,
+// each thread counts its own. A core built with ALLOCATION_AUDIT has these
+// hooks already.
+//
+#ifdef ALLOCATION_AUDIT
+static uint64_t ThreadAllocations()
+{
+  return GetThreadAllocations();
+}
+#else
+static thread_local uint64_t t_allocations = 0;
+
+static uint64_t ThreadAllocations()
+{
+  return t_allocations;
+}
+
+void* operator new(size_t size)
+{
+  t_allocations++;
+  if (void* p = std::malloc(size ? size : 1))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  std::free(p);
+}
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t FREQUENCIES[] = { 8000, 22050, 44100, 48000, 96000, 192000 };
+const MediaBitness BITNESS[] = { bit8, bit16, bit24, bit32, bitfloat };
+const SpeakerLayout LAYOUTS[] = { Mono, Stereo, Quad, Surround6, Surround8 };
+
+// Buffers and receives ignored while queues and vectors reach their size
+const size_t WARMUP = 16;
+
+static const char* BitnessName(MediaBitness bitness)
+{
+  switch (bitness)
+  {
+  case bit8:
+    return "u8";
+  case bit16:
+    return "s16";
+  case bit24:
+    return "s24";
+  case bit32:
+    return "s32";
+  case bitfloat:
+    return "f32";
+  default:
+    return "unknown";
+  }
+}
+
+static const char* LayoutName(SpeakerLayout layout)
+{
+  switch (layout)
+  {
+  case Mono:
+    return "mono";
+  case Stereo:
+    return "stereo";
+  case Quad:
+    return "quad";
+  case Surround6:
+    return "5.1";
+  case Surround8:
+    return "7.1";
+  default:
+    return "unknown";
+  }
+}
+
+//
+// Interleaved 440 Hz sine at -6 dB, a slightly different phase per channel
+//
+static std::vector<int8_t> GenerateSine(const AudioFormat& format, size_t frames)
+{
+  size_t channels = GetChannelCount(format.speaker_layout);
+  size_t sample_size = GetSampleSize(format.bitness);
+  std::vector<int8_t> data(frames * channels * sample_size);
+  int8_t* out = data.data();
+
+  for (size_t frame = 0; frame < frames; frame++)
+  {
+    for (size_t channel = 0; channel < channels; channel++)
+    {
+      double value = 0.5 * std::sin(2.0 * 3.14159265358979 * 440.0 * frame / format.frequency + channel * 0.1);
+      switch (format.bitness)
+      {
+      case bit8:
+        *reinterpret_cast<uint8_t*>(out) = static_cast<uint8_t>(128 + value * 127);
+        break;
+      case bit16:
+      {
+        int16_t sample = static_cast<int16_t>(value * 32767);
+        std::memcpy(out, &sample, sizeof(sample));
+        break;
+      }
+      case bit24:
+      {
+        int32_t sample = static_cast<int32_t>(value * 8388607);
+        out[0] = static_cast<int8_t>(sample);
+        out[1] = static_cast<int8_t>(sample >> 8);
+        out[2] = static_cast<int8_t>(sample >> 16);
+        break;
+      }
+      case bit32:
+      {
+        int32_t sample = static_cast<int32_t>(value * 2147483647.0);
+        std::memcpy(out, &sample, sizeof(sample));
+        break;
+      }
+      case bitfloat:
+      {
+        float sample = static_cast<float>(value);
+        std::memcpy(out, &sample, sizeof(sample));
+        break;
+      }
+      default:
+        break;
+      }
+      out += sample_size;
+    }
+  }
+
+  return data;
+}
+
+struct Options
+{
+  std::string backend = "null";
+  std::string mode = "all";
+  double seconds = 10.0;
+  uint32_t chunk_ms = 10;
+};
+
+struct CaseResult
+{
+  bool ok = false;
+  double frames_per_second = 0.0;
+  double cpu_per_audio_second = 0.0;
+  double allocations_per_buffer = 0.0;
+  double allocations_per_receive = 0.0;
+  double latency_p50 = 0.0;
+  double latency_p99 = 0.0;
+  double latency_p999 = 0.0;
+  uint64_t buffers = 0;
+  uint64_t receives = 0;
+};
+
+//
+// RunCase
+//
+// Streams options.seconds of format through the mixer into output. Output
+// is opened, configured for the mode and has its submit callback set here.
+//
+template <class Output>
+static CaseResult RunCase(CMixer* mixer, Output* output, const AudioFormat& format, const Options& options)
+{
+  CaseResult result;
+
+  size_t frame_size = GetFrameSize(format.speaker_layout, format.bitness);
+  size_t chunk_frames = std::max<size_t>(1, format.frequency * options.chunk_ms / 1000);
+  size_t chunk_size = chunk_frames * frame_size;
+  size_t num_chunks = static_cast<size_t>(options.seconds * format.frequency / chunk_frames) + 1;
+
+  // One second worth of whole chunks, fed in a loop
+  size_t cycle_chunks = format.frequency / chunk_frames + 1;
+  std::vector<int8_t> source = GenerateSine(format, cycle_chunks * chunk_frames);
+
+  // Written by the receiving thread before each Receive, read by the output
+  // thread once the mixer has taken the chunk's last byte
+  struct Arrival
+  {
+    uint64_t end_position;
+    Clock::time_point time;
+  };
+  std::vector<Arrival> arrivals(num_chunks);
+  std::atomic<size_t> arrivals_published = 0;
+  std::atomic<size_t> arrivals_done = 0;
+  std::vector<double> latencies;
+  latencies.reserve(num_chunks);
+
+  uint64_t buffers = 0;
+  uint64_t warm_allocations = 0;
+  uint64_t last_allocations = 0;
+  Clock::time_point last_submit;
+
+  output->setSubmitCallback([&](size_t /*frames*/)
+  {
+    Clock::time_point now = Clock::now();
+    uint64_t mixed = mixer->GetBytesMixed();
+    size_t published = arrivals_published.load(std::memory_order_acquire);
+    size_t done = arrivals_done.load(std::memory_order_relaxed);
+
+    while (done < published && arrivals[done].end_position <= mixed)
+    {
+      latencies.push_back(std::chrono::duration<double, std::micro>(now - arrivals[done].time).count());
+      done++;
+    }
+    arrivals_done.store(done, std::memory_order_release);
+
+    if (++buffers == WARMUP)
+    {
+      warm_allocations = ThreadAllocations();
+    }
+    last_allocations = ThreadAllocations();
+    last_submit = now;
+  });
+
+  mixer->SetFormat(format);
+  mixer->StartStreaming();
+  if (!output->StartDevice())
+  {
+    mixer->StopStreaming();
+    return result;
+  }
+
+  double cpu_start = ProcessCpuSeconds();
+  Clock::time_point start = Clock::now();
+  uint64_t receive_allocations = 0;
+  uint64_t position = 0;
+
+  for (size_t chunk = 0; chunk < num_chunks; chunk++)
+  {
+    if (chunk == WARMUP)
+    {
+      receive_allocations = ThreadAllocations();
+    }
+
+    position += chunk_size;
+    arrivals[chunk] = { position, Clock::now() };
+    arrivals_published.store(chunk + 1, std::memory_order_release);
+
+    mixer->Receive(source.data() + (chunk % cycle_chunks) * chunk_size, chunk_size);
+  }
+  receive_allocations = ThreadAllocations() - receive_allocations;
+
+  // Lets Mix pad and hand over the last partial buffer
+  mixer->StopStreaming();
+
+  Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+  while (arrivals_done.load(std::memory_order_acquire) < num_chunks && Clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  double cpu_seconds = ProcessCpuSeconds() - cpu_start;
+  output->StopDevice();
+
+  if (arrivals_done < num_chunks)
+  {
+    return result;
+  }
+
+  double wall_seconds = std::chrono::duration<double>(last_submit - start).count();
+  double audio_seconds = static_cast<double>(num_chunks * chunk_frames) / format.frequency;
+
+  result.ok = true;
+  result.frames_per_second = num_chunks * chunk_frames / wall_seconds;
+  result.cpu_per_audio_second = cpu_seconds / audio_seconds;
+  if (buffers > WARMUP)
+  {
+    result.allocations_per_buffer = static_cast<double>(last_allocations - warm_allocations) / (buffers - WARMUP);
+  }
+  if (num_chunks > WARMUP)
+  {
+    result.allocations_per_receive = static_cast<double>(receive_allocations) / (num_chunks - WARMUP);
+  }
+  result.latency_p50 = Percentile(&latencies, 0.5);
+  result.latency_p99 = Percentile(&latencies, 0.99);
+  result.latency_p999 = Percentile(&latencies, 0.999);
+  result.buffers = buffers;
+  result.receives = num_chunks;
+
+  return result;
+}
+
+static void PrintResult(bool* first, const AudioFormat& format, const char* mode, int direct_channels, const CaseResult& result)
+{
+  std::printf("%s\n    {\"frequency\": %u, \"layout\": \"%s\", \"bitness\": \"%s\", \"mode\": \"%s\", ",
+    *first ? "" : ",", format.frequency, LayoutName(format.speaker_layout), BitnessName(format.bitness), mode);
+  *first = false;
+
+  if (direct_channels >= 0)
+  {
+    std::printf("\"direct_channels\": %s, ", direct_channels ? "true" : "false");
+  }
+
+  if (!result.ok)
+  {
+    std::printf("\"error\": \"stream did not complete\"}");
+    return;
+  }
+
+  std::printf("\"frames_per_second\": %.0f, \"cpu_per_audio_second\": %.6f, "
+    "\"allocations_per_buffer\": %.3f, \"allocations_per_receive\": %.3f, "
+    "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f}, "
+    "\"buffers\": %llu, \"receives\": %llu}",
+    result.frames_per_second, result.cpu_per_audio_second,
+    result.allocations_per_buffer, result.allocations_per_receive,
+    result.latency_p50, result.latency_p99, result.latency_p999,
+    static_cast<unsigned long long>(result.buffers), static_cast<unsigned long long>(result.receives));
+  std::fflush(stdout);
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--backend", &options->backend);
+  parser.Add("--mode", &options->mode);
+  parser.Add("--seconds", &options->seconds);
+  parser.Add("--chunk-ms", &options->chunk_ms);
+
+  return parser.Parse(argc, argv) &&
+    (options->backend == "null" || options->backend == "loopback") &&
+    (options->mode == "passthrough" || options->mode == "device" || options->mode == "all") &&
+    options->seconds > 0.0 && options->chunk_ms > 0;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--backend null|loopback] [--mode passthrough|device|all] "
+      "[--seconds N] [--chunk-ms N]\n", argv[0]);
+    return 2;
+  }
+
+  bool loopback = options.backend == "loopback";
+  if (loopback)
+  {
+    CMixer mixer;
+    COpenALLoopbackOutput output(&mixer);
+    if (!output.OpenDevice())
+    {
+      std::fprintf(stderr, "Can't open an OpenAL Soft loopback device\n");
+      return 1;
+    }
+  }
+
+  std::printf("{\n  \"benchmark\": \"mixer\", \"backend\": \"%s\", \"seconds\": %g, \"chunk_ms\": %u,\n  \"results\": [",
+    options.backend.c_str(), options.seconds, options.chunk_ms);
+
+  bool first = true;
+  bool failed = false;
+  for (int device_format_mode = 0; device_format_mode < 2; device_format_mode++)
+  {
+    const char* mode = device_format_mode ? "device" : "passthrough";
+    if (options.mode != "all" && options.mode != mode)
+    {
+      continue;
+    }
+
+    for (uint32_t frequency : FREQUENCIES)
+    {
+      for (MediaBitness bitness : BITNESS)
+      {
+        for (SpeakerLayout layout : LAYOUTS)
+        {
+          AudioFormat format = { frequency, layout, bitness };
+          std::fprintf(stderr, "%s %u Hz %s %s\n", mode, frequency, LayoutName(layout), BitnessName(bitness));
+
+          if (!loopback)
+          {
+            CMixer mixer;
+            CNullOutput output(&mixer);
+            mixer.SetOutput(&output);
+            output.setDeviceFormatMode(device_format_mode != 0);
+            if (!output.OpenDevice() || !output.isFormatSupported(format))
+            {
+              continue;
+            }
+
+            CaseResult result = RunCase(&mixer, &output, format, options);
+            PrintResult(&first, format, mode, -1, result);
+            failed |= !result.ok;
+            continue;
+          }
+
+          // Direct channels only differ for multichannel passthrough
+          int direct_variants = !device_format_mode && layout != Mono ? 2 : 1;
+          for (int direct_channels = 1; direct_channels > 1 - direct_variants; direct_channels--)
+          {
+            CMixer mixer;
+            COpenALLoopbackOutput output(&mixer);
+            mixer.SetOutput(&output);
+            output.setDirectChannels(direct_channels != 0);
+            if (!output.OpenDevice())
+            {
+              continue;
+            }
+            output.setDeviceFormatMode(device_format_mode != 0);
+            if (!output.isFormatSupported(format))
+            {
+              continue;
+            }
+
+            CaseResult result = RunCase(&mixer, &output, format, options);
+            PrintResult(&first, format, mode, direct_variants > 1 ? direct_channels : -1, result);
+            failed |= !result.ok;
+          }
+        }
+      }
+    }
+  }
+
+  std::printf("\n  ]\n}\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,437 @@
+// The base classes' time format arithmetic, llMulDiv and Int64x32Div32,
+// (a * b + d) / c with a 128 bit intermediate. MulDiv128 (core/MulDiv.h),
+// one hardware multiply and divide, is first checked against a portable copy
+// of the long hand versions in arithutil.cpp on every combination of edge
+// values (0, +-1, the 32 and 64 bit limits, c == 0, results that overflow,
+// d of either sign) and on random operands of every width, then both are
+// timed. Reports, as JSON on stdout, the mismatches, which must be 0, and
+// ns per call of each for
+//
+//   timestamp   REFERENCE_TIME scaled by a sample rate, rounded, as
+//               renbase.cpp and the time format conversions do
+//   wide        64 bit operands and divisors, the long division loop of
+//               llMulDiv
+//
+// Usage: muldiv_bench [--random N] [--calls N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "BenchOptions.h"
+#include "MulDiv.h"
+
+#ifndef MULDIV_HAS_128
+#error muldiv_bench needs a compiler with a 128 bit multiply and divide
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+//
+// arithutil.cpp as it was, with its DWORD halves spelled out. Negation goes
+// through unsigned arithmetic where the original relied on two's complement
+// wrapping, for INT64_MIN and INT32_MIN.
+//
+static uint32_t Low(uint64_t value)
+{
+  return static_cast<uint32_t>(value);
+}
+
+static uint32_t High(uint64_t value)
+{
+  return static_cast<uint32_t>(value >> 32);
+}
+
+static uint64_t Make(uint32_t high, uint32_t low)
+{
+  return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+static uint64_t Magnitude(int64_t value)
+{
+  return value >= 0 ? static_cast<uint64_t>(value) : 0 - static_cast<uint64_t>(value);
+}
+
+static int64_t Signed(uint64_t magnitude, bool sign)
+{
+  return static_cast<int64_t>(sign ? 0 - magnitude : magnitude);
+}
+
+static int64_t LegacyMulDiv(int64_t a, int64_t b, int64_t c, int64_t d)
+{
+  uint64_t ua = Magnitude(a);
+  uint64_t ub = Magnitude(b);
+  uint64_t uc = Magnitude(c);
+  bool sign = (a < 0) != (b < 0);
+
+  // Long multiplication
+  uint64_t p0 = static_cast<uint64_t>(Low(ua)) * Low(ub);
+  uint64_t x = static_cast<uint64_t>(Low(ua)) * High(ub) + static_cast<uint64_t>(High(ua)) * Low(ub) + High(p0);
+  p0 = Make(Low(x), Low(p0));
+  uint64_t p1 = static_cast<uint64_t>(High(ua)) * High(ub) + High(x);
+
+  if (d != 0)
+  {
+    uint64_t ud0;
+    uint64_t ud1;
+    if (sign)
+    {
+      ud0 = 0 - static_cast<uint64_t>(d);
+      ud1 = d > 0 ? UINT64_MAX : 0;
+    }
+    else
+    {
+      ud0 = static_cast<uint64_t>(d);
+      ud1 = d < 0 ? UINT64_MAX : 0;
+    }
+
+    // Extended addition, a DWORD at a time
+    uint64_t total = static_cast<uint64_t>(Low(ud0)) + Low(p0);
+    p0 = Make(High(p0), Low(total));
+    total = High(total);
+    total += static_cast<uint64_t>(High(ud0)) + High(p0);
+    p0 = Make(Low(total), Low(p0));
+    total = High(total);
+    p1 += ud1 + total;
+
+    if (static_cast<int32_t>(High(p1)) < 0)
+    {
+      sign = !sign;
+      p0 = ~p0;
+      p1 = ~p1;
+      p0 += 1;
+      p1 += p0 == 0 ? 1 : 0;
+    }
+  }
+
+  if (c < 0)
+  {
+    sign = !sign;
+  }
+
+  if (uc <= p1)
+  {
+    return sign ? INT64_MIN : INT64_MAX;
+  }
+
+  if (p1 == 0)
+  {
+    return Signed(p0 / uc, sign);
+  }
+
+  if (High(uc) == 0)
+  {
+    uint32_t divisor = Low(uc);
+    uint64_t dividend = Make(Low(p1), High(p0));
+    uint32_t result_high = static_cast<uint32_t>(dividend / divisor);
+    p0 = Make(static_cast<uint32_t>(dividend % divisor), Low(p0));
+    return Signed(p0 / divisor + Make(result_high, 0), sign);
+  }
+
+  // Long division
+  uint64_t result = 0;
+  for (int i = 0; i < 64; i++)
+  {
+    result <<= 1;
+    p1 <<= 1;
+    if (High(p0) & 0x80000000)
+    {
+      p1 = Make(High(p1), Low(p1) + 1);
+    }
+    p0 <<= 1;
+
+    if (uc <= p1)
+    {
+      p1 -= uc;
+      result += 1;
+    }
+  }
+
+  return Signed(result, sign);
+}
+
+static int64_t LegacyInt64x32Div32(int64_t a, int32_t b, int32_t c, int32_t d)
+{
+  uint64_t ua = Magnitude(a);
+  uint32_t ub = static_cast<uint32_t>(Magnitude(b));
+  uint32_t uc = static_cast<uint32_t>(Magnitude(c));
+  bool sign = (a < 0) != (b < 0);
+
+  // Long multiplication, 96 bits
+  uint64_t p0 = static_cast<uint64_t>(Low(ua)) * ub;
+  uint32_t p1 = 0;
+  if (High(ua) != 0)
+  {
+    uint64_t x = static_cast<uint64_t>(High(ua)) * ub + High(p0);
+    p0 = Make(Low(x), Low(p0));
+    p1 = High(x);
+  }
+
+  if (d != 0)
+  {
+    uint64_t ud0;
+    uint32_t ud1;
+    if (sign)
+    {
+      ud0 = static_cast<uint64_t>(-static_cast<int64_t>(d));
+      ud1 = d > 0 ? UINT32_MAX : 0;
+    }
+    else
+    {
+      ud0 = static_cast<uint64_t>(static_cast<int64_t>(d));
+      ud1 = d < 0 ? UINT32_MAX : 0;
+    }
+
+    uint64_t total = static_cast<uint64_t>(Low(ud0)) + Low(p0);
+    p0 = Make(High(p0), Low(total));
+    total = High(total);
+    total += static_cast<uint64_t>(High(ud0)) + High(p0);
+    p0 = Make(Low(total), Low(p0));
+    p1 += ud1 + High(total);
+
+    if (static_cast<int32_t>(p1) < 0)
+    {
+      sign = !sign;
+      p0 = ~p0;
+      p1 = ~p1;
+      p0 += 1;
+      p1 += p0 == 0 ? 1 : 0;
+    }
+  }
+
+  if (c < 0)
+  {
+    sign = !sign;
+  }
+
+  if (uc <= p1)
+  {
+    return sign ? INT64_MIN : INT64_MAX;
+  }
+
+  // EnlargedUnsignedDivide twice
+  uint64_t dividend = Make(p1, High(p0));
+  uint32_t result_high = 0;
+  if (dividend >= uc)
+  {
+    result_high = static_cast<uint32_t>(dividend / uc);
+    p0 = Make(static_cast<uint32_t>(dividend % uc), Low(p0));
+  }
+  uint32_t result_low = static_cast<uint32_t>(p0 / uc);
+
+  return Signed(Make(result_high, result_low), sign);
+}
+
+// Edge values of 64 and 32 bits, and the operands time conversions use
+static const int64_t EDGES_64[] = {
+  0, 1, -1, 2, -2, 3, -7, 1000, 44100, -48000, 10000000, -10000000,
+  INT32_MAX, INT32_MIN, int64_t(UINT32_MAX), int64_t(1) << 32, -(int64_t(1) << 32), (int64_t(1) << 32) + 1,
+  int64_t(1) << 53, -(int64_t(1) << 53) - 3, int64_t(1) << 62, INT64_MAX, INT64_MAX - 1, INT64_MIN, INT64_MIN + 1
+};
+
+static const int32_t EDGES_32[] = {
+  0, 1, -1, 2, -2, 3, -7, 1000, 44100, -48000, 10000000, -10000000, 1 << 30, INT32_MAX, INT32_MAX - 1,
+  INT32_MIN, INT32_MIN + 1
+};
+
+struct Mismatches
+{
+  uint64_t checked = 0;
+  uint64_t failed = 0;
+};
+
+static void Check(int64_t a, int64_t b, int64_t c, int64_t d, Mismatches* mismatches)
+{
+  int64_t expected = LegacyMulDiv(a, b, c, d);
+  int64_t result = MulDiv128(a, b, c, d);
+  mismatches->checked++;
+  if (result != expected)
+  {
+    if (mismatches->failed++ < 10)
+    {
+      std::fprintf(stderr, "llMulDiv(%lld, %lld, %lld, %lld): %lld, expected %lld\n", static_cast<long long>(a),
+        static_cast<long long>(b), static_cast<long long>(c), static_cast<long long>(d),
+        static_cast<long long>(result), static_cast<long long>(expected));
+    }
+  }
+}
+
+static void Check32(int64_t a, int32_t b, int32_t c, int32_t d, Mismatches* mismatches)
+{
+  int64_t expected = LegacyInt64x32Div32(a, b, c, d);
+  int64_t result = MulDiv128(a, b, c, d);
+  mismatches->checked++;
+  if (result != expected)
+  {
+    if (mismatches->failed++ < 10)
+    {
+      std::fprintf(stderr, "Int64x32Div32(%lld, %d, %d, %d): %lld, expected %lld\n", static_cast<long long>(a), b, c,
+        d, static_cast<long long>(result), static_cast<long long>(expected));
+    }
+  }
+}
+
+// Random bits of a random width and sign, so that every path is taken
+static int64_t RandomOperand(std::mt19937_64& random, int max_bits)
+{
+  int bits = static_cast<int>(random() % (max_bits + 1));
+  uint64_t value = bits == 0 ? 0 : random() >> (64 - bits);
+  return random() & 1 ? static_cast<int64_t>(0 - value) : static_cast<int64_t>(value);
+}
+
+static void CheckAll(uint64_t random_count, Mismatches* muldiv, Mismatches* int64x32)
+{
+  for (int64_t a : EDGES_64)
+  {
+    for (int64_t b : EDGES_64)
+    {
+      for (int64_t c : EDGES_64)
+      {
+        for (int64_t d : EDGES_64)
+        {
+          Check(a, b, c, d, muldiv);
+        }
+      }
+    }
+
+    for (int32_t b : EDGES_32)
+    {
+      for (int32_t c : EDGES_32)
+      {
+        for (int32_t d : EDGES_32)
+        {
+          Check32(a, b, c, d, int64x32);
+        }
+      }
+    }
+  }
+
+  std::mt19937_64 random(1);
+  for (uint64_t i = 0; i < random_count; i++)
+  {
+    Check(RandomOperand(random, 64), RandomOperand(random, 64), RandomOperand(random, 64),
+      RandomOperand(random, 64), muldiv);
+    Check32(RandomOperand(random, 64), static_cast<int32_t>(RandomOperand(random, 32)),
+      static_cast<int32_t>(RandomOperand(random, 32)), static_cast<int32_t>(RandomOperand(random, 32)), int64x32);
+  }
+}
+
+struct Operands
+{
+  int64_t a, b, c, d;
+};
+
+template <class F> static double Time(const std::vector<Operands>& operands, uint64_t calls, F function)
+{
+  int64_t sum = 0;
+  auto start = Clock::now();
+  for (uint64_t i = 0; i < calls; i++)
+  {
+    const Operands& o = operands[i % operands.size()];
+    sum += function(o.a, o.b, o.c, o.d);
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / calls;
+
+  // Keeps the calls from being optimized away
+  if (sum == 42)
+  {
+    std::fprintf(stderr, "\n");
+  }
+  return ns;
+}
+
+struct Options
+{
+  uint64_t random = 2000000;
+  uint64_t calls = 2000000;
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--random", &options->random);
+  parser.Add("--calls", &options->calls);
+
+  return parser.Parse(argc, argv) && options->calls > 0;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--random N] [--calls N]\n", argv[0]);
+    return 2;
+  }
+
+  Mismatches muldiv;
+  Mismatches int64x32;
+  CheckAll(options.random, &muldiv, &int64x32);
+
+  std::printf("{\n  \"benchmark\": \"muldiv_bench\",\n  \"check\": [\n"
+    "    {\"function\": \"llMulDiv\", \"checked\": %llu, \"mismatches\": %llu},\n"
+    "    {\"function\": \"Int64x32Div32\", \"checked\": %llu, \"mismatches\": %llu}\n  ],\n  \"results\": [",
+    static_cast<unsigned long long>(muldiv.checked), static_cast<unsigned long long>(muldiv.failed),
+    static_cast<unsigned long long>(int64x32.checked), static_cast<unsigned long long>(int64x32.failed));
+  std::fflush(stdout);
+
+  // Stream times of up to a day scaled to and from sample rates, rounded
+  std::mt19937_64 random(2);
+  const int64_t RATES[] = { 22050, 44100, 48000, 96000, 192000 };
+  std::vector<Operands> timestamp;
+  std::vector<Operands> timestamp32;
+  std::vector<Operands> wide;
+  for (int i = 0; i < 4096; i++)
+  {
+    int64_t time = static_cast<int64_t>(random() % (864000000000LL));
+    int64_t rate = RATES[random() % 5];
+    timestamp.push_back(i & 1 ? Operands{ time, rate, 10000000, 5000000 } : Operands{ time, 10000000, rate, rate / 2 });
+    timestamp32.push_back({ time, static_cast<int32_t>(rate), 10000000, 5000000 });
+    wide.push_back({ static_cast<int64_t>(random() >> 2), static_cast<int64_t>(random() >> 3),
+      static_cast<int64_t>(random() >> 1) | (int64_t(1) << 40), static_cast<int64_t>(random() >> 20) });
+  }
+
+  struct Case
+  {
+    const char* name;
+    const char* function;
+    const std::vector<Operands>* operands;
+    bool int64x32;
+  };
+  const Case CASES[] = {
+    { "timestamp", "llMulDiv", &timestamp, false },
+    { "wide", "llMulDiv", &wide, false },
+    { "timestamp", "Int64x32Div32", &timestamp32, true },
+  };
+
+  bool first = true;
+  for (const Case& test : CASES)
+  {
+    double legacy_ns;
+    double ns;
+    if (test.int64x32)
+    {
+      legacy_ns = Time(*test.operands, options.calls, [](int64_t a, int64_t b, int64_t c, int64_t d)
+      {
+        return LegacyInt64x32Div32(a, static_cast<int32_t>(b), static_cast<int32_t>(c), static_cast<int32_t>(d));
+      });
+    }
+    else
+    {
+      legacy_ns = Time(*test.operands, options.calls, LegacyMulDiv);
+    }
+    ns = Time(*test.operands, options.calls, MulDiv128);
+
+    std::printf("%s\n    {\"function\": \"%s\", \"operands\": \"%s\", \"long_hand_ns\": %.2f, \"muldiv128_ns\": %.2f}",
+      first ? "" : ",", test.function, test.name, legacy_ns, ns);
+    std::fflush(stdout);
+    first = false;
+  }
+
+  std::printf("\n  ]\n}\n");
+
+  return muldiv.failed == 0 && int64x32.failed == 0 ? 0 : 1;
+}
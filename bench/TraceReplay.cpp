@@ -0,0 +1,198 @@
+// Replays an arrival trace recorded by the renderer (OPENAL_RENDERER_TRACE)
+// into the mixer with the original timing. The output plays at the stream
+// rate like a sound card would, so underruns caused by the decoder's burst
+// pattern show up here the way they did in the filter. Prints a JSON
+// summary on stdout.
+//
+// Usage: trace_replay <trace> [--fast] [--device-format] [--buffer-ms N]
+//                     [--buffers N] [--chrome-trace <file>] [--measure]
+//
+//   --fast           feed and play as fast as possible, to benchmark the
+//                    mixer on a real stream instead of reproducing it
+//   --device-format  convert everything to the output format like the
+//                    filter does in device format mode
+//   --chrome-trace   write the Receive, Mix and output events of the
+//                    replay as Chrome trace JSON to the given file
+//   --measure        print the Receive and Mix timing statistics to stderr
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ArrivalTrace.h"
+#include "BenchOptions.h"
+#include "ChromeTrace.h"
+#include "Measure.h"
+#include "Mixer.h"
+#include "NullOutput.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+  std::string trace;
+  bool fast = false;
+  bool device_format = false;
+  uint32_t buffer_ms = 8;
+  uint32_t buffers = 8;
+  std::string chrome_trace;
+  bool measure = false;
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.AddPositional(&options->trace);
+  parser.AddFlag("--fast", &options->fast);
+  parser.AddFlag("--device-format", &options->device_format);
+  parser.Add("--buffer-ms", &options->buffer_ms);
+  parser.Add("--buffers", &options->buffers);
+  parser.Add("--chrome-trace", &options->chrome_trace);
+  parser.AddFlag("--measure", &options->measure);
+
+  return parser.Parse(argc, argv) &&
+    !options->trace.empty() && options->buffer_ms > 0 && options->buffers >= 2;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s <trace> [--fast] [--device-format] [--buffer-ms N] [--buffers N] "
+      "[--chrome-trace <file>] [--measure]\n", argv[0]);
+    return 2;
+  }
+
+  // Load it all first, no file reads while replaying
+  CArrivalTraceReader reader;
+  if (!reader.Open(options.trace))
+  {
+    std::fprintf(stderr, "Can't read arrival trace %s\n", options.trace.c_str());
+    return 1;
+  }
+
+  std::vector<ArrivalEvent> events;
+  size_t max_length = 0;
+  ArrivalEvent event;
+  while (reader.Read(&event))
+  {
+    events.push_back(event);
+    if (event.type == ArrivalSample)
+    {
+      max_length = std::max<size_t>(max_length, event.length);
+    }
+  }
+  reader.Close();
+
+  // The content doesn't matter to the data path, only its size and timing
+  std::vector<int8_t> data(max_length);
+
+  CMixer mixer;
+  CNullOutput output(&mixer);
+  mixer.SetOutput(&output);
+  output.setDeviceFormatMode(options.device_format);
+  output.setBufferDuration(options.buffer_ms);
+  output.setRealtime(!options.fast, options.buffers);
+
+  if (!options.chrome_trace.empty())
+  {
+    if (!SetChromeTraceOutput(options.chrome_trace))
+    {
+      std::fprintf(stderr, "Can't write %s\n", options.chrome_trace.c_str());
+      return 1;
+    }
+    CEventTrace::Get().StartDrain();
+  }
+
+  output.OpenDevice();
+  mixer.StartStreaming();
+  output.StartDevice();
+
+  uint64_t samples = 0;
+  uint64_t bytes = 0;
+  uint64_t formats = 0;
+  uint64_t unsupported_formats = 0;
+  uint64_t flushes = 0;
+  double max_lateness = 0.0;
+  std::vector<double> receive_times;
+  receive_times.reserve(events.size());
+
+  Clock::time_point start = Clock::now();
+  for (const ArrivalEvent& replayed : events)
+  {
+    Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<int64_t, std::ratio<1, 10000000>>(replayed.time));
+    if (!options.fast)
+    {
+      std::this_thread::sleep_until(due);
+      max_lateness = std::max(max_lateness, std::chrono::duration<double, std::micro>(Clock::now() - due).count());
+    }
+
+    switch (replayed.type)
+    {
+    case ArrivalSample:
+    {
+      Clock::time_point receive_start = Clock::now();
+      mixer.Receive(data.data(), replayed.length);
+      receive_times.push_back(std::chrono::duration<double, std::micro>(Clock::now() - receive_start).count());
+      samples++;
+      bytes += replayed.length;
+      break;
+    }
+    case ArrivalFormat:
+      if (!output.isFormatSupported(replayed.format))
+      {
+        unsupported_formats++;
+      }
+      mixer.SetFormat(replayed.format);
+      formats++;
+      break;
+    case ArrivalFlush:
+      mixer.Flush();
+      flushes++;
+      break;
+    default:
+      break;
+    }
+  }
+
+  mixer.StopStreaming();
+  Clock::time_point end = Clock::now();
+  output.StopDevice();
+
+  if (!options.chrome_trace.empty())
+  {
+    CEventTrace::Get().StopDrain();
+    CEventTrace::Get().SetSink(nullptr);
+  }
+
+  double trace_seconds = events.empty() ? 0.0 : events.back().time / 1e7;
+  double replay_seconds = std::chrono::duration<double>(end - start).count();
+  double receive_max = receive_times.empty() ? 0.0 : *std::max_element(receive_times.begin(), receive_times.end());
+
+  std::printf("{\n  \"benchmark\": \"trace_replay\", \"trace\": \"%s\", \"mode\": \"%s\", \"device_format\": %s,\n",
+    options.trace.c_str(), options.fast ? "fast" : "realtime", options.device_format ? "true" : "false");
+  std::printf("  \"events\": %zu, \"samples\": %llu, \"bytes\": %llu, \"format_changes\": %llu, "
+    "\"unsupported_formats\": %llu, \"flushes\": %llu,\n",
+    events.size(), static_cast<unsigned long long>(samples), static_cast<unsigned long long>(bytes),
+    static_cast<unsigned long long>(formats), static_cast<unsigned long long>(unsupported_formats),
+    static_cast<unsigned long long>(flushes));
+  std::printf("  \"trace_seconds\": %.3f, \"replay_seconds\": %.3f, \"frames_played\": %llu, \"underruns\": %llu,\n",
+    trace_seconds, replay_seconds, static_cast<unsigned long long>(output.getFramesSubmitted()),
+    static_cast<unsigned long long>(output.getUnderruns()));
+  std::printf("  \"receive_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}, \"max_lateness_us\": %.1f\n}\n",
+    Percentile(&receive_times, 0.5), Percentile(&receive_times, 0.99), receive_max, max_lateness);
+
+  if (options.measure)
+  {
+    std::fputs(CMeasure::Get().DumpStats().c_str(), stderr);
+  }
+
+  return 0;
+}
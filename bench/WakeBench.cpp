@@ -0,0 +1,217 @@
+// Wake-up lateness of the reference clock's advise thread. Runs the advise
+// loop of CBaseReferenceClock::AdviseThread on CAdviseHeap, with a periodic
+// advise and a client thread adding one-shot advises a few milliseconds
+// ahead, under each wait policy:
+//
+//   millisecond   the loop as it was: waits of whole milliseconds, and the
+//                 advises due within the next millisecond fired at once
+//   timer         CDeadlineWait to the advise time
+//   spin_<N>us    CDeadlineWait spinning the last N microseconds
+//
+// and reports, as JSON on stdout, percentiles of how late each advise fired
+// (CMeasure histograms), how many fired early, and the process CPU use.
+//
+// Usage: wake_bench [--seconds N] [--spin-us N,N,...]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AdviseHeap.h"
+#include "BenchOptions.h"
+#include "Clock.h"
+#include "DeadlineWait.h"
+#include "Measure.h"
+
+// 100 ns units
+const int64_t MICROSECOND = 10;
+const int64_t MILLISECOND = 10000;
+const int64_t PERIOD = 3 * MILLISECOND + 333 * MICROSECOND;
+
+struct Policy
+{
+  std::string name;
+  bool millisecond;
+  int64_t spin;
+};
+
+struct Result
+{
+  MeasureStats late;
+  uint64_t early = 0;
+  double cpu_percent = 0.0;
+};
+
+static Result Run(const Policy& policy, double seconds)
+{
+  CMonotonicClock clock;
+  CDeadlineWait wait;
+  wait.SetSpin(policy.spin);
+
+  std::mutex mutex;
+  CAdviseHeap schedule;
+  bool stop = false;
+
+  std::string name = policy.name + " lateness (ns)";
+  int late_id = CMeasure::Get().Register(name.c_str());
+  CMeasure::Get().Reset(late_id);
+  Result result;
+
+  int64_t start = clock.GetTime();
+  int64_t end = start + static_cast<int64_t>(seconds * 1e7);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    schedule.Add(start + PERIOD, PERIOD, nullptr, true);
+  }
+
+  // One-shot advises 0.5 to 20 ms ahead, waking the loop when one is next,
+  // as CAMSchedule::AddAdvisePacket sets the event
+  std::thread client([&]()
+  {
+    std::mt19937 random(1);
+    while (clock.GetTime() < end)
+    {
+      int64_t now = clock.GetTime();
+      int64_t time = now + 5000 + static_cast<int64_t>(random() % (195 * 1000));
+      bool next;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        schedule.Add(time, 0, nullptr, false);
+        next = schedule.NextTime() == time;
+      }
+      if (next)
+      {
+        wait.Wake();
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(1000 + random() % 4000));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+    wait.Wake();
+  });
+
+  double cpu_start = ProcessCpuSeconds();
+  int64_t slop = policy.millisecond ? MILLISECOND : 0;
+  int64_t wait_time = CDeadlineWait::NO_DEADLINE;
+  for (;;)
+  {
+    if (wait_time == CDeadlineWait::NO_DEADLINE)
+    {
+      wait.WaitUntil(CDeadlineWait::NO_DEADLINE);
+    }
+    else if (policy.millisecond)
+    {
+      // WaitForSingleObject's timeout, rounded down
+      wait.WaitFor(wait_time / MILLISECOND * MILLISECOND);
+    }
+    else
+    {
+      wait.WaitFor(wait_time);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stop)
+    {
+      break;
+    }
+
+    // CAMSchedule::Advise
+    int64_t now = clock.GetTime();
+    while (schedule.Size() > 0 && now + slop >= schedule.NextTime())
+    {
+      int64_t lateness = now - schedule.NextTime();
+      if (lateness >= 0)
+      {
+        CMeasure::Get().Integer(late_id, lateness * 100);
+      }
+      else
+      {
+        result.early++;
+      }
+
+      if (schedule.Top()->periodic)
+      {
+        schedule.RescheduleTop();
+      }
+      else
+      {
+        schedule.RemoveTop();
+      }
+    }
+
+    wait_time = schedule.Size() > 0 ? schedule.NextTime() - now : CDeadlineWait::NO_DEADLINE;
+  }
+  double cpu_seconds = ProcessCpuSeconds() - cpu_start;
+
+  client.join();
+
+  for (const MeasureStats& stats : CMeasure::Get().GetStats())
+  {
+    if (stats.name == name)
+    {
+      result.late = stats;
+    }
+  }
+  result.cpu_percent = 100.0 * cpu_seconds / seconds;
+
+  return result;
+}
+
+struct Options
+{
+  double seconds = 2.0;
+  std::vector<int64_t> spins_us = { 50, 200 };
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+  CBenchOptions parser;
+  parser.Add("--seconds", &options->seconds);
+  parser.Add("--spin-us", &options->spins_us);
+
+  return parser.Parse(argc, argv) && options->seconds > 0.0;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--seconds N] [--spin-us N,N,...]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Policy> policies = { { "millisecond", true, 0 }, { "timer", false, 0 } };
+  for (int64_t spin : options.spins_us)
+  {
+    policies.push_back({ "spin_" + std::to_string(spin) + "us", false, spin * MICROSECOND });
+  }
+
+  std::printf("{\n  \"benchmark\": \"wake_bench\", \"high_resolution_timer\": %s, \"results\": [",
+    CDeadlineWait().IsHighResolution() ? "true" : "false");
+
+  bool first = true;
+  for (const Policy& policy : policies)
+  {
+    Result result = Run(policy, options.seconds);
+    const MeasureStats& late = result.late;
+    std::printf("%s\n    {\"policy\": \"%s\", \"fired\": %llu, \"early\": %llu, "
+      "\"late_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}, \"cpu_percent\": %.1f}",
+      first ? "" : ",", policy.name.c_str(), static_cast<unsigned long long>(late.count + result.early),
+      static_cast<unsigned long long>(result.early), late.p50 / 1000, late.p99 / 1000, late.p999 / 1000,
+      late.max / 1000, result.cpu_percent);
+    std::fflush(stdout);
+    first = false;
+  }
+
+  std::printf("\n  ]\n}\n");
+
+  return 0;
+}
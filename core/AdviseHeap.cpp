@@ -0,0 +1,170 @@
+// Advise packets of a reference clock in a binary min-heap.
+
+#include <new>
+
+#include "AdviseHeap.h"
+
+uintptr_t CAdviseHeap::Add(int64_t time, int64_t period, void* notify, bool periodic)
+{
+  // Grow everything first, a failure leaves the heap as it was
+  try
+  {
+    if (m_free_slots.empty())
+    {
+      if (m_slots.size() == MAX_SLOTS)
+      {
+        return 0;
+      }
+
+      if (m_slots.size() == m_slots.capacity())
+      {
+        size_t capacity = m_slots.size() < 16 ? 16 : m_slots.size() * 2;
+        m_slots.reserve(capacity);
+        m_heap.reserve(capacity);
+        // Room to free every slot without allocating
+        m_free_slots.reserve(capacity);
+      }
+
+      m_slots.push_back(Slot());
+      m_free_slots.push_back(static_cast<uint32_t>(m_slots.size() - 1));
+    }
+  }
+  catch (const std::bad_alloc&)
+  {
+    return 0;
+  }
+
+  uint32_t slot = m_free_slots.back();
+  m_free_slots.pop_back();
+
+  // Never 0, which is the failure value
+  uintptr_t sequence = m_next_sequence++ & (UINTPTR_MAX >> SLOT_BITS);
+  if (sequence == 0)
+  {
+    sequence = m_next_sequence++ & (UINTPTR_MAX >> SLOT_BITS);
+  }
+
+  Slot& entry = m_slots[slot];
+  entry.packet.time = time;
+  entry.packet.period = period;
+  entry.packet.notify = notify;
+  entry.packet.periodic = periodic;
+  entry.packet.cookie = (sequence << SLOT_BITS) | slot;
+  entry.order = m_next_order++;
+  entry.used = true;
+
+  m_heap.push_back(slot);
+  entry.heap_index = static_cast<uint32_t>(m_heap.size() - 1);
+  SiftUp(entry.heap_index);
+
+  return entry.packet.cookie;
+}
+
+bool CAdviseHeap::Remove(uintptr_t cookie)
+{
+  uint32_t slot = static_cast<uint32_t>(cookie & (MAX_SLOTS - 1));
+  if (slot >= m_slots.size() || !m_slots[slot].used || m_slots[slot].packet.cookie != cookie)
+  {
+    return false;
+  }
+
+  RemoveAt(m_slots[slot].heap_index);
+  return true;
+}
+
+void CAdviseHeap::RescheduleTop()
+{
+  Slot& entry = m_slots[m_heap[0]];
+  entry.packet.time += entry.packet.period;
+  // Behind the advises already due at the new time
+  entry.order = m_next_order++;
+  SiftDown(0);
+}
+
+void CAdviseHeap::RemoveTop()
+{
+  RemoveAt(0);
+}
+
+bool CAdviseHeap::Before(uint32_t a, uint32_t b) const
+{
+  const Slot& first = m_slots[a];
+  const Slot& second = m_slots[b];
+  if (first.packet.time != second.packet.time)
+  {
+    return first.packet.time < second.packet.time;
+  }
+  return first.order < second.order;
+}
+
+void CAdviseHeap::Place(uint32_t index, uint32_t slot)
+{
+  m_heap[index] = slot;
+  m_slots[slot].heap_index = index;
+}
+
+void CAdviseHeap::SiftUp(uint32_t index)
+{
+  uint32_t slot = m_heap[index];
+  while (index > 0)
+  {
+    uint32_t parent = (index - 1) / 2;
+    if (!Before(slot, m_heap[parent]))
+    {
+      break;
+    }
+    Place(index, m_heap[parent]);
+    index = parent;
+  }
+  Place(index, slot);
+}
+
+void CAdviseHeap::SiftDown(uint32_t index)
+{
+  uint32_t slot = m_heap[index];
+  uint32_t size = static_cast<uint32_t>(m_heap.size());
+  for (;;)
+  {
+    uint32_t child = index * 2 + 1;
+    if (child >= size)
+    {
+      break;
+    }
+    if (child + 1 < size && Before(m_heap[child + 1], m_heap[child]))
+    {
+      child++;
+    }
+    if (!Before(m_heap[child], slot))
+    {
+      break;
+    }
+    Place(index, m_heap[child]);
+    index = child;
+  }
+  Place(index, slot);
+}
+
+void CAdviseHeap::RemoveAt(uint32_t index)
+{
+  uint32_t slot = m_heap[index];
+  m_slots[slot].used = false;
+  m_free_slots.push_back(slot);
+
+  uint32_t last = m_heap.back();
+  m_heap.pop_back();
+  if (index == m_heap.size())
+  {
+    return;
+  }
+
+  // The last packet fills the hole and moves whichever way it belongs
+  Place(index, last);
+  if (index > 0 && Before(last, m_heap[(index - 1) / 2]))
+  {
+    SiftUp(index);
+  }
+  else
+  {
+    SiftDown(index);
+  }
+}
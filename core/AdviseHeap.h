@@ -0,0 +1,89 @@
+// Advise packets of a reference clock, ordered by the time they fire. A
+// binary min-heap of slots, so adding, removing and rescheduling are
+// O(log n), and cookies carry their slot so Remove finds the packet
+// without a search. Packets live in the slot array by value and the
+// arrays never shrink, so once a clock has seen its peak number of
+// advises nothing is allocated. Not thread safe, CAMSchedule serializes
+// the calls.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct AdvisePacket
+{
+  int64_t time;         // when to notify, 100 ns units
+  int64_t period;       // added to time after each periodic notification
+  void* notify;         // event or semaphore handle
+  bool periodic;
+  uintptr_t cookie;
+};
+
+class CAdviseHeap
+{
+public:
+  // Time of an empty heap, never a valid advise time
+  static const int64_t NO_ADVISE = INT64_MAX;
+
+  // Returns the cookie, 0 when the heap is full or out of memory
+  uintptr_t Add(int64_t time, int64_t period, void* notify, bool periodic);
+  // False if the cookie is unknown or already fired
+  bool Remove(uintptr_t cookie);
+
+  size_t Size() const
+  {
+    return m_heap.size();
+  }
+
+  int64_t NextTime() const
+  {
+    return m_heap.empty() ? NO_ADVISE : m_slots[m_heap[0]].packet.time;
+  }
+
+  // The packet to fire next, nullptr when empty
+  const AdvisePacket* Top() const
+  {
+    return m_heap.empty() ? nullptr : &m_slots[m_heap[0]].packet;
+  }
+
+  // Moves the top packet one period on, for periodic advises
+  void RescheduleTop();
+  void RemoveTop();
+
+  // All packets in heap order, for debug dumps
+  template <class F> void ForEach(F f) const
+  {
+    for (uint32_t slot : m_heap)
+    {
+      f(m_slots[slot].packet);
+    }
+  }
+
+private:
+  // The low bits of a cookie are its slot, the rest a sequence number that
+  // tells a stale cookie from the current user of a slot
+  static const int SLOT_BITS = 16;
+  static const uint32_t MAX_SLOTS = 1u << SLOT_BITS;
+
+  struct Slot
+  {
+    AdvisePacket packet;
+    uint64_t order;       // breaks ties between equal times, first added fires first
+    uint32_t heap_index;
+    bool used;
+  };
+
+  bool Before(uint32_t a, uint32_t b) const;
+  void SiftUp(uint32_t index);
+  void SiftDown(uint32_t index);
+  void RemoveAt(uint32_t index);
+  void Place(uint32_t index, uint32_t slot);
+
+  std::vector<Slot> m_slots;
+  std::vector<uint32_t> m_free_slots;
+  std::vector<uint32_t> m_heap;   // slot numbers
+  uintptr_t m_next_sequence = 1;
+  uint64_t m_next_order = 0;
+};
@@ -0,0 +1,230 @@
+// Heap allocation audit.
+//
+// Replaces the global allocation functions of the binary it is linked into,
+// the DLL on Windows. The per-thread state is plain data so it needs no
+// thread_local initialization, operator new can run before main and during
+// thread exit.
+
+#ifdef ALLOCATION_AUDIT
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "AllocationAudit.h"
+#include "EventTrace.h"
+
+// Passes through a hot path before its allocations count as steady state
+static const uint64_t WARMUP = 64;
+
+static std::atomic<uint32_t> g_warmup_epoch{0};
+static std::atomic<uint64_t> g_hot_path_allocations{0};
+
+struct AuditThread
+{
+  uint64_t allocations;
+  const char* hot_path;     // inside this hot path scope, or nullptr
+  const char* last_path;    // the hot path passes counts
+  uint64_t passes;
+  uint32_t epoch;
+  bool recording;           // recording the event, which may allocate
+};
+
+static thread_local AuditThread t_audit = {};
+
+CHotPathScope::CHotPathScope(const char* name)
+  : m_outer(t_audit.hot_path)
+{
+  uint32_t epoch = g_warmup_epoch.load(std::memory_order_relaxed);
+  if (t_audit.last_path != name || t_audit.epoch != epoch)
+  {
+    t_audit.last_path = name;
+    t_audit.epoch = epoch;
+    t_audit.passes = 0;
+  }
+
+  t_audit.passes++;
+  t_audit.hot_path = name;
+}
+
+CHotPathScope::~CHotPathScope()
+{
+  t_audit.hot_path = m_outer;
+}
+
+void RestartHotPathWarmup()
+{
+  g_warmup_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t GetThreadAllocations()
+{
+  return t_audit.allocations;
+}
+
+uint64_t GetHotPathAllocations()
+{
+  return g_hot_path_allocations.load(std::memory_order_relaxed);
+}
+
+static void CountAllocation(size_t size)
+{
+  t_audit.allocations++;
+
+  if (!t_audit.hot_path || t_audit.recording || t_audit.passes <= WARMUP ||
+    t_audit.epoch != g_warmup_epoch.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+
+  t_audit.recording = true;
+  g_hot_path_allocations.fetch_add(1, std::memory_order_relaxed);
+  TraceRecord(TraceHotPathAllocation, static_cast<int64_t>(size), static_cast<int64_t>(t_audit.passes), 0,
+    t_audit.hot_path);
+  t_audit.recording = false;
+}
+
+static void* Allocate(size_t size)
+{
+  CountAllocation(size);
+  return std::malloc(size ? size : 1);
+}
+
+static void* AllocateAligned(size_t size, std::align_val_t alignment)
+{
+  CountAllocation(size);
+#ifdef _WIN32
+  return _aligned_malloc(size ? size : 1, static_cast<size_t>(alignment));
+#else
+  void* p = nullptr;
+  if (posix_memalign(&p, std::max(sizeof(void*), static_cast<size_t>(alignment)), size ? size : 1) != 0)
+  {
+    return nullptr;
+  }
+  return p;
+#endif
+}
+
+static void FreeAligned(void* p)
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void* operator new(size_t size)
+{
+  if (void* p = Allocate(size))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+  if (void* p = AllocateAligned(size, alignment))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+  return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  FreeAligned(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+  FreeAligned(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+  FreeAligned(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+  FreeAligned(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  FreeAligned(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  FreeAligned(p);
+}
+
+#endif
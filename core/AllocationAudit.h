@@ -0,0 +1,64 @@
+// Heap allocation audit, a profiling build mode. With ALLOCATION_AUDIT
+// defined, global operator new counts the allocations of each thread, and
+// the sound loop and Receive mark their work as hot path scopes. Once a
+// thread has passed through its hot path WARMUP times, every allocation
+// made inside the scope is recorded as a TraceHotPathAllocation event
+// naming the hot path. Without ALLOCATION_AUDIT nothing is hooked and the
+// calls below are empty.
+
+#pragma once
+
+#include <cstdint>
+
+#ifdef ALLOCATION_AUDIT
+
+// Marks one pass through a hot path on the calling thread, name is a string
+// literal
+class CHotPathScope
+{
+public:
+  explicit CHotPathScope(const char* name);
+  ~CHotPathScope();
+
+  CHotPathScope(const CHotPathScope&) = delete;
+  CHotPathScope& operator=(const CHotPathScope&) = delete;
+
+private:
+  const char* m_outer;
+};
+
+// Restarts the warm-up of every hot path, for format changes that
+// legitimately resize buffers
+void RestartHotPathWarmup();
+
+// Allocations of the calling thread so far
+uint64_t GetThreadAllocations();
+
+// Steady state allocations inside hot paths so far, all threads
+uint64_t GetHotPathAllocations();
+
+#else
+
+class CHotPathScope
+{
+public:
+  explicit CHotPathScope(const char* /*name*/)
+  {
+  }
+};
+
+inline void RestartHotPathWarmup()
+{
+}
+
+inline uint64_t GetThreadAllocations()
+{
+  return 0;
+}
+
+inline uint64_t GetHotPathAllocations()
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,222 @@
+// Arrival traces, recorded by the pin and replayed into the mixer.
+
+#include <cstring>
+
+#include "ArrivalTrace.h"
+
+static const char TRACE_MAGIC[8] = { 'O', 'A', 'L', 'T', 'R', 'C', '0', '1' };
+
+// Largest record, a sample
+static const size_t MAX_RECORD_SIZE = 1 + 8 + 8 + 8 + 4 + 4;
+
+static std::FILE* OpenFile(const std::string& path, const char* mode)
+{
+#ifdef _MSC_VER
+  std::FILE* file = nullptr;
+  if (fopen_s(&file, path.c_str(), mode) != 0)
+  {
+    return nullptr;
+  }
+  return file;
+#else
+  return std::fopen(path.c_str(), mode);
+#endif
+}
+
+static uint8_t* PutLE(uint8_t* out, uint64_t value, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; i++)
+  {
+    *out++ = static_cast<uint8_t>(value >> (i * 8));
+  }
+  return out;
+}
+
+static const uint8_t* GetLE(const uint8_t* in, uint64_t* value, size_t bytes)
+{
+  *value = 0;
+  for (size_t i = 0; i < bytes; i++)
+  {
+    *value |= static_cast<uint64_t>(*in++) << (i * 8);
+  }
+  return in;
+}
+
+//
+// CArrivalTraceWriter
+//
+CArrivalTraceWriter::~CArrivalTraceWriter()
+{
+  Close();
+}
+
+bool CArrivalTraceWriter::Open(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_file)
+  {
+    std::fclose(m_file);
+  }
+
+  m_file = OpenFile(path, "wb");
+  if (!m_file)
+  {
+    return false;
+  }
+
+  // Records are small, let stdio batch them
+  std::setvbuf(m_file, nullptr, _IOFBF, 64 * 1024);
+  std::fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), m_file);
+  m_start_time = m_clock.GetTime();
+  m_open = true;
+
+  return true;
+}
+
+void CArrivalTraceWriter::Close()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_open = false;
+  if (m_file)
+  {
+    std::fclose(m_file);
+    m_file = nullptr;
+  }
+}
+
+bool CArrivalTraceWriter::IsOpen()
+{
+  return m_open;
+}
+
+int64_t CArrivalTraceWriter::GetTime()
+{
+  return m_clock.GetTime() - m_start_time;
+}
+
+void CArrivalTraceWriter::Write(const ArrivalEvent& event)
+{
+  uint8_t record[MAX_RECORD_SIZE];
+  uint8_t* out = record;
+
+  *out++ = event.type;
+  out = PutLE(out, static_cast<uint64_t>(event.time), 8);
+
+  switch (event.type)
+  {
+  case ArrivalSample:
+    out = PutLE(out, static_cast<uint64_t>(event.start), 8);
+    out = PutLE(out, static_cast<uint64_t>(event.stop), 8);
+    out = PutLE(out, event.length, 4);
+    out = PutLE(out, event.flags, 4);
+    break;
+  case ArrivalFormat:
+    out = PutLE(out, event.format.frequency, 4);
+    *out++ = static_cast<uint8_t>(event.format.speaker_layout);
+    *out++ = static_cast<uint8_t>(event.format.bitness);
+    *out++ = static_cast<uint8_t>(event.format.ambisonic_layout);
+    *out++ = static_cast<uint8_t>(event.format.ambisonic_scaling);
+    break;
+  default:
+    break;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_file)
+  {
+    std::fwrite(record, 1, out - record, m_file);
+  }
+}
+
+//
+// CArrivalTraceReader
+//
+CArrivalTraceReader::~CArrivalTraceReader()
+{
+  Close();
+}
+
+bool CArrivalTraceReader::Open(const std::string& path)
+{
+  Close();
+
+  m_file = OpenFile(path, "rb");
+  if (!m_file)
+  {
+    return false;
+  }
+
+  char magic[sizeof(TRACE_MAGIC)];
+  if (std::fread(magic, 1, sizeof(magic), m_file) != sizeof(magic) ||
+    std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+  {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void CArrivalTraceReader::Close()
+{
+  if (m_file)
+  {
+    std::fclose(m_file);
+    m_file = nullptr;
+  }
+}
+
+bool CArrivalTraceReader::Read(ArrivalEvent* event)
+{
+  uint8_t header[1 + 8];
+  if (!m_file || std::fread(header, 1, sizeof(header), m_file) != sizeof(header))
+  {
+    return false;
+  }
+
+  *event = ArrivalEvent();
+  uint64_t value = 0;
+  event->type = static_cast<ArrivalEventType>(header[0]);
+  GetLE(header + 1, &value, 8);
+  event->time = static_cast<int64_t>(value);
+
+  uint8_t body[MAX_RECORD_SIZE];
+  const uint8_t* in = body;
+  switch (event->type)
+  {
+  case ArrivalSample:
+    if (std::fread(body, 1, 8 + 8 + 4 + 4, m_file) != 8 + 8 + 4 + 4)
+    {
+      return false;
+    }
+    in = GetLE(in, &value, 8);
+    event->start = static_cast<int64_t>(value);
+    in = GetLE(in, &value, 8);
+    event->stop = static_cast<int64_t>(value);
+    in = GetLE(in, &value, 4);
+    event->length = static_cast<uint32_t>(value);
+    GetLE(in, &value, 4);
+    event->flags = static_cast<uint32_t>(value);
+    return true;
+  case ArrivalFormat:
+    if (std::fread(body, 1, 4 + 4, m_file) != 4 + 4)
+    {
+      return false;
+    }
+    in = GetLE(in, &value, 4);
+    event->format.frequency = static_cast<uint32_t>(value);
+    event->format.speaker_layout = static_cast<SpeakerLayout>(in[0]);
+    event->format.bitness = static_cast<MediaBitness>(in[1]);
+    event->format.ambisonic_layout = static_cast<AmbisonicLayout>(in[2]);
+    event->format.ambisonic_scaling = static_cast<AmbisonicScaling>(in[3]);
+    return true;
+  case ArrivalFlush:
+  case ArrivalEndOfStream:
+    return true;
+  default:
+    return false;
+  }
+}
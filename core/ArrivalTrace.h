@@ -0,0 +1,85 @@
+// Arrival traces. Records what the renderer received from upstream and when
+// into a compact binary file, so the burst pattern of a decoder can be fed
+// back into the mixer later with the original timing.
+//
+// The file starts with the 8 byte magic "OALTRC01", followed by records of
+// a type byte and little endian fields:
+//
+//   ArrivalSample       time:i64 start:i64 stop:i64 length:u32 flags:u32
+//   ArrivalFormat       time:i64 frequency:u32 layout:u8 bitness:u8
+//                       ambisonic_layout:u8 ambisonic_scaling:u8
+//   ArrivalFlush        time:i64
+//   ArrivalEndOfStream  time:i64
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "AudioFormat.h"
+#include "Clock.h"
+
+enum ArrivalEventType : uint8_t
+{
+  ArrivalSample = 1,
+  ArrivalFormat,
+  ArrivalFlush,
+  ArrivalEndOfStream
+};
+
+struct ArrivalEvent
+{
+  ArrivalEventType type = ArrivalSample;
+  int64_t time = 0;       // 100 ns units since the trace was opened
+
+  // ArrivalSample, stream times as set on the sample and its AM_SAMPLE_* flags
+  int64_t start = 0;
+  int64_t stop = 0;
+  uint32_t length = 0;
+  uint32_t flags = 0;
+
+  // ArrivalFormat
+  AudioFormat format = {};
+};
+
+// Thread safe, samples and flushes arrive on different threads
+class CArrivalTraceWriter
+{
+public:
+  ~CArrivalTraceWriter();
+
+  bool Open(const std::string& path);
+  void Close();
+  // Lock free, cheap enough to check on every sample
+  bool IsOpen();
+
+  // Time to stamp an event with
+  int64_t GetTime();
+
+  void Write(const ArrivalEvent& event);
+
+private:
+  std::mutex m_mutex;
+  std::FILE* m_file = nullptr;
+  std::atomic<bool> m_open = false;
+  CMonotonicClock m_clock;
+  int64_t m_start_time = 0;
+};
+
+class CArrivalTraceReader
+{
+public:
+  ~CArrivalTraceReader();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  // False at the end of the trace or on a damaged record
+  bool Read(ArrivalEvent* event);
+
+private:
+  std::FILE* m_file = nullptr;
+};
@@ -0,0 +1,445 @@
+// Sample format, channel layout and sample rate conversion for the mixer.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "AudioConverter.h"
+
+enum SpeakerRole
+{
+  FrontLeft,
+  FrontRight,
+  FrontCenter,
+  LowFrequency,
+  BackLeft,
+  BackRight,
+  SideLeft,
+  SideRight
+};
+
+// Channel order of the wave formats we accept, which is also the OpenAL order
+static std::vector<SpeakerRole> GetSpeakerRoles(SpeakerLayout layout)
+{
+  switch (layout)
+  {
+  case SpeakerLayout::Mono:
+    return { FrontCenter };
+  case SpeakerLayout::Stereo:
+    return { FrontLeft, FrontRight };
+  case SpeakerLayout::Quad:
+    return { FrontLeft, FrontRight, BackLeft, BackRight };
+  case SpeakerLayout::Surround6:
+    return { FrontLeft, FrontRight, FrontCenter, LowFrequency, BackLeft, BackRight };
+  case SpeakerLayout::Surround8:
+    return { FrontLeft, FrontRight, FrontCenter, LowFrequency, BackLeft, BackRight, SideLeft, SideRight };
+  default:
+    // B-Format has no speakers, it is decoded by OpenAL
+    break;
+  }
+
+  return {};
+}
+
+void ConvertU8ToFloat(const uint8_t* input, float* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    output[i] = (static_cast<int>(input[i]) - 128) * (1.0f / 128.0f);
+  }
+}
+
+void ConvertS16ToFloat(const int16_t* input, float* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    output[i] = input[i] * (1.0f / 32768.0f);
+  }
+}
+
+void ConvertS24ToFloat(const uint8_t* input, float* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    // Little endian, sign extended through the top byte
+    int32_t value = static_cast<int32_t>(
+      (static_cast<uint32_t>(input[0]) << 8) |
+      (static_cast<uint32_t>(input[1]) << 16) |
+      (static_cast<uint32_t>(input[2]) << 24)) >> 8;
+    output[i] = value * (1.0f / 8388608.0f);
+    input += 3;
+  }
+}
+
+void ConvertS32ToFloat(const int32_t* input, float* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    output[i] = static_cast<float>(input[i] * (1.0 / 2147483648.0));
+  }
+}
+
+void ConvertFloatToU8(const float* input, uint8_t* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    float value = input[i] * 128.0f + 128.0f;
+    value = std::min(std::max(value, 0.0f), 255.0f);
+    output[i] = static_cast<uint8_t>(std::lrint(value));
+  }
+}
+
+void ConvertFloatToS16(const float* input, int16_t* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    float value = input[i] * 32768.0f;
+    value = std::min(std::max(value, -32768.0f), 32767.0f);
+    output[i] = static_cast<int16_t>(std::lrint(value));
+  }
+}
+
+void ConvertFloatToS24(const float* input, uint8_t* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    float value = input[i] * 8388608.0f;
+    value = std::min(std::max(value, -8388608.0f), 8388607.0f);
+    uint32_t bits = static_cast<uint32_t>(static_cast<int32_t>(std::lrint(value)));
+    // Little endian, the low three bytes
+    output[0] = static_cast<uint8_t>(bits);
+    output[1] = static_cast<uint8_t>(bits >> 8);
+    output[2] = static_cast<uint8_t>(bits >> 16);
+    output += 3;
+  }
+}
+
+void ConvertFloatToS32(const float* input, int32_t* output, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    // Float can't hold 2^31 - 1, clamp in double
+    double value = input[i] * 2147483648.0;
+    value = std::min(std::max(value, -2147483648.0), 2147483647.0);
+    output[i] = static_cast<int32_t>(std::llrint(value));
+  }
+}
+
+void MixChannels(const float* input, size_t input_channels, float* output, size_t output_channels,
+  const float* matrix, size_t frames)
+{
+  for (size_t frame = 0; frame < frames; ++frame)
+  {
+    const float* gains = matrix;
+    for (size_t out = 0; out < output_channels; ++out)
+    {
+      float sum = 0.0f;
+      for (size_t in = 0; in < input_channels; ++in)
+      {
+        sum += input[in] * gains[in];
+      }
+      output[out] = sum;
+      gains += input_channels;
+    }
+
+    input += input_channels;
+    output += output_channels;
+  }
+}
+
+void CAudioConverter::SetFormats(const AudioFormat& input, const AudioFormat& output)
+{
+  // When only the input changes, the resampler carries its last frame over
+  // so the output continues from it instead of restarting with a click
+  bool same_output = m_output_channels != 0 && output.speaker_layout == m_output.speaker_layout &&
+    output.frequency == m_output.frequency && output.bitness == m_output.bitness;
+
+  m_input = input;
+  m_output = output;
+  m_input_channels = GetChannelCount(input.speaker_layout);
+  m_output_channels = GetChannelCount(output.speaker_layout);
+  m_input_frame_size = GetFrameSize(input.speaker_layout, input.bitness);
+  m_output_frame_size = GetFrameSize(output.speaker_layout, output.bitness);
+  m_step = static_cast<double>(input.frequency) / output.frequency;
+
+  BuildChannelMatrix();
+  if (!same_output || input.frequency == output.frequency)
+  {
+    Reset();
+  }
+}
+
+void CAudioConverter::Reset()
+{
+  m_position = 0.0;
+  m_resample_history.clear();
+}
+
+void CAudioConverter::BuildChannelMatrix()
+{
+  m_matrix.clear();
+  if (m_input.speaker_layout == m_output.speaker_layout)
+  {
+    return;
+  }
+
+  constexpr float minus_3db = 0.70710678f;
+  auto input_roles = GetSpeakerRoles(m_input.speaker_layout);
+  auto output_roles = GetSpeakerRoles(m_output.speaker_layout);
+  m_matrix.assign(m_output_channels * m_input_channels, 0.0f);
+
+  auto find_output = [&output_roles](SpeakerRole role) -> int
+  {
+    auto it = std::find(output_roles.cbegin(), output_roles.cend(), role);
+    return it == output_roles.cend() ? -1 : static_cast<int>(it - output_roles.cbegin());
+  };
+
+  auto route = [this](size_t in, int out, float gain)
+  {
+    if (out >= 0)
+      m_matrix[out * m_input_channels + in] += gain;
+  };
+
+  for (size_t in = 0; in < m_input_channels; ++in)
+  {
+    SpeakerRole role = input_roles[in];
+    int out = find_output(role);
+    if (out >= 0)
+    {
+      route(in, out, 1.0f);
+      continue;
+    }
+
+    int left = find_output(FrontLeft);
+    int right = find_output(FrontRight);
+    int center = find_output(FrontCenter);
+
+    switch (role)
+    {
+    case FrontLeft:
+    case FrontRight:
+      // Only a mono output lacks the front pair
+      route(in, center, minus_3db);
+      break;
+    case FrontCenter:
+      route(in, left, minus_3db);
+      route(in, right, minus_3db);
+      break;
+    case LowFrequency:
+      // Dropped when the output has no subwoofer channel
+      break;
+    case BackLeft:
+    case SideLeft:
+    case BackRight:
+    case SideRight:
+    {
+      bool is_left = role == BackLeft || role == SideLeft;
+      SpeakerRole sibling = role == BackLeft ? SideLeft : role == SideLeft ? BackLeft :
+        role == BackRight ? SideRight : BackRight;
+      int surround = find_output(sibling);
+      if (surround >= 0)
+        route(in, surround, 1.0f);
+      else if (left >= 0)
+        route(in, is_left ? left : right, minus_3db);
+      else
+        route(in, center, minus_3db * minus_3db);
+      break;
+    }
+    }
+  }
+
+  // A downmix folds several channels into one, scale every output down to
+  // a gain sum of at most 1 so full scale input can't clip
+  for (size_t out = 0; out < m_output_channels; ++out)
+  {
+    float* gains = m_matrix.data() + out * m_input_channels;
+    float sum = 0.0f;
+    for (size_t in = 0; in < m_input_channels; ++in)
+    {
+      sum += gains[in];
+    }
+    if (sum > 1.0f)
+    {
+      for (size_t in = 0; in < m_input_channels; ++in)
+      {
+        gains[in] /= sum;
+      }
+    }
+  }
+}
+
+size_t CAudioConverter::InputFramesNeeded(size_t output_frames) const
+{
+  if (output_frames == 0)
+  {
+    return 0;
+  }
+
+  if (m_input.frequency == m_output.frequency)
+  {
+    return output_frames;
+  }
+
+  // Interpolating the last output frame reads the input frame after it
+  size_t history_frames = m_output_channels ? m_resample_history.size() / m_output_channels : 0;
+  size_t total = static_cast<size_t>(m_position + (output_frames - 1) * m_step) + 2;
+  return total > history_frames ? total - history_frames : 0;
+}
+
+size_t CAudioConverter::Resample(const float* input, size_t input_frames, float* output, size_t max_output_frames)
+{
+  // The frames left over from the last call come before the input, read
+  // both in place rather than appending the input to the history
+  const size_t channels = m_output_channels;
+  const size_t history_frames = m_resample_history.size() / channels;
+  const size_t frames = history_frames + input_frames;
+  auto frame = [&](size_t index) -> const float*
+  {
+    return index < history_frames ? m_resample_history.data() + index * channels :
+      input + (index - history_frames) * channels;
+  };
+
+  size_t produced = 0;
+  while (produced < max_output_frames)
+  {
+    size_t index = static_cast<size_t>(m_position);
+    if (index + 1 >= frames)
+      break;
+
+    float fraction = static_cast<float>(m_position - index);
+    const float* a = frame(index);
+    const float* b = frame(index + 1);
+    for (size_t c = 0; c < channels; ++c)
+    {
+      output[c] = a[c] + (b[c] - a[c]) * fraction;
+    }
+
+    output += channels;
+    m_position += m_step;
+    ++produced;
+  }
+
+  // Keep the frames the next interpolation starts from. That is one frame
+  // unless max_output_frames cut the loop short, so this copies a frame and
+  // reuses the history's storage.
+  size_t consumed = std::min(static_cast<size_t>(m_position), frames ? frames - 1 : 0);
+  m_position -= consumed;
+  if (consumed < history_frames)
+  {
+    m_resample_history.erase(m_resample_history.begin(), m_resample_history.begin() + consumed * channels);
+    m_resample_history.insert(m_resample_history.end(), input, input + input_frames * channels);
+  }
+  else
+  {
+    const float* keep = input + (consumed - history_frames) * channels;
+    m_resample_history.assign(keep, input + input_frames * channels);
+  }
+
+  return produced;
+}
+
+size_t CAudioConverter::Convert(const int8_t* input, size_t input_frames, int8_t* output, size_t max_output_frames)
+{
+  if (!m_input_channels || !m_output_channels)
+  {
+    return 0;
+  }
+
+  const bool same_layout = m_matrix.empty();
+  const bool same_rate = m_input.frequency == m_output.frequency;
+
+  // Nothing to do but a copy
+  if (same_layout && same_rate && m_input.bitness == m_output.bitness)
+  {
+    size_t frames = std::min(input_frames, max_output_frames);
+    memcpy(output, input, frames * m_input_frame_size);
+    return frames;
+  }
+
+  // Decode to float
+  size_t input_samples = input_frames * m_input_channels;
+  const float* samples = nullptr;
+  if (m_input.bitness == MediaBitness::bitfloat)
+  {
+    samples = reinterpret_cast<const float*>(input);
+  }
+  else
+  {
+    if (m_float_input.size() < input_samples)
+      m_float_input.resize(input_samples);
+
+    switch (m_input.bitness)
+    {
+    case MediaBitness::bit8:
+      ConvertU8ToFloat(reinterpret_cast<const uint8_t*>(input), m_float_input.data(), input_samples);
+      break;
+    case MediaBitness::bit16:
+      ConvertS16ToFloat(reinterpret_cast<const int16_t*>(input), m_float_input.data(), input_samples);
+      break;
+    case MediaBitness::bit24:
+      ConvertS24ToFloat(reinterpret_cast<const uint8_t*>(input), m_float_input.data(), input_samples);
+      break;
+    case MediaBitness::bit32:
+      ConvertS32ToFloat(reinterpret_cast<const int32_t*>(input), m_float_input.data(), input_samples);
+      break;
+    default:
+      break;
+    }
+    samples = m_float_input.data();
+  }
+
+  // Up or downmix
+  if (!same_layout)
+  {
+    size_t mapped_samples = input_frames * m_output_channels;
+    if (m_float_mapped.size() < mapped_samples)
+      m_float_mapped.resize(mapped_samples);
+
+    MixChannels(samples, m_input_channels, m_float_mapped.data(), m_output_channels,
+      m_matrix.data(), input_frames);
+    samples = m_float_mapped.data();
+  }
+
+  // Resample, straight to the output when it is float
+  const bool float_output = m_output.bitness == MediaBitness::bitfloat;
+  size_t frames = std::min(input_frames, max_output_frames);
+  if (!same_rate)
+  {
+    float* destination = reinterpret_cast<float*>(output);
+    if (!float_output)
+    {
+      if (m_float_output.size() < max_output_frames * m_output_channels)
+        m_float_output.resize(max_output_frames * m_output_channels);
+      destination = m_float_output.data();
+    }
+
+    frames = Resample(samples, input_frames, destination, max_output_frames);
+    if (float_output)
+      return frames;
+
+    samples = destination;
+  }
+
+  // Encode the output
+  size_t output_samples = frames * m_output_channels;
+  switch (m_output.bitness)
+  {
+  case MediaBitness::bit8:
+    ConvertFloatToU8(samples, reinterpret_cast<uint8_t*>(output), output_samples);
+    break;
+  case MediaBitness::bit16:
+    ConvertFloatToS16(samples, reinterpret_cast<int16_t*>(output), output_samples);
+    break;
+  case MediaBitness::bit24:
+    ConvertFloatToS24(samples, reinterpret_cast<uint8_t*>(output), output_samples);
+    break;
+  case MediaBitness::bit32:
+    ConvertFloatToS32(samples, reinterpret_cast<int32_t*>(output), output_samples);
+    break;
+  default:
+    memcpy(output, samples, output_samples * sizeof(float));
+    break;
+  }
+
+  return frames;
+}
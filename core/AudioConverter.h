@@ -0,0 +1,63 @@
+// Sample format, channel layout and sample rate conversion for the mixer.
+// Used in device format mode, where the OpenAL side is configured once and
+// every upstream format is converted to it in memory.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AudioFormat.h"
+
+class CAudioConverter
+{
+public:
+  void SetFormats(const AudioFormat& input, const AudioFormat& output);
+  void Reset();
+
+  size_t GetInputFrameSize() const { return m_input_frame_size; }
+  size_t GetOutputFrameSize() const { return m_output_frame_size; }
+
+  // Input frames that still have to be supplied to produce output_frames
+  size_t InputFramesNeeded(size_t output_frames) const;
+
+  // Convert interleaved input frames, returns the number of output frames written
+  size_t Convert(const int8_t* input, size_t input_frames, int8_t* output, size_t max_output_frames);
+
+private:
+  void BuildChannelMatrix();
+  size_t Resample(const float* input, size_t input_frames, float* output, size_t max_output_frames);
+
+  AudioFormat m_input = {};
+  AudioFormat m_output = {};
+  size_t m_input_channels = 0;
+  size_t m_output_channels = 0;
+  size_t m_input_frame_size = 0;
+  size_t m_output_frame_size = 0;
+
+  // m_output_channels x m_input_channels gains, empty when channels match
+  std::vector<float> m_matrix;
+
+  // Linear interpolation state, positions are in frames of m_resample_history
+  // followed by the next input
+  double m_step = 1.0;
+  double m_position = 0.0;
+  std::vector<float> m_resample_history;
+
+  // Scratch buffers, grown on demand and then reused
+  std::vector<float> m_float_input;
+  std::vector<float> m_float_mapped;
+  std::vector<float> m_float_output;
+};
+
+// Sample conversion kernels, all operate on interleaved samples
+void ConvertU8ToFloat(const uint8_t* input, float* output, size_t count);
+void ConvertS16ToFloat(const int16_t* input, float* output, size_t count);
+void ConvertS24ToFloat(const uint8_t* input, float* output, size_t count);
+void ConvertS32ToFloat(const int32_t* input, float* output, size_t count);
+void ConvertFloatToU8(const float* input, uint8_t* output, size_t count);
+void ConvertFloatToS16(const float* input, int16_t* output, size_t count);
+void ConvertFloatToS24(const float* input, uint8_t* output, size_t count);
+void ConvertFloatToS32(const float* input, int32_t* output, size_t count);
+void MixChannels(const float* input, size_t input_channels, float* output, size_t output_channels,
+  const float* matrix, size_t frames);
@@ -0,0 +1,124 @@
+// Audio formats understood by the renderer core and helpers to describe
+// them. Shared by the mixer, the output backends and the DirectShow pin.
+
+#include "AudioFormat.h"
+
+std::string GenerateFormatString(SpeakerLayout speaker_layout, MediaBitness bitness)
+{
+  std::string result = "AL_FORMAT_";
+
+  switch (speaker_layout)
+  {
+  case SpeakerLayout::Mono:
+    result.append("MONO");
+    break;
+  case SpeakerLayout::Stereo:
+    result.append("STEREO");
+    break;
+  case SpeakerLayout::Quad:
+    result.append("QUAD");
+    break;
+  case SpeakerLayout::Surround6:
+    result.append("51CHN");
+    break;
+  case SpeakerLayout::Surround8:
+    result.append("71CHN");
+    break;
+  case SpeakerLayout::BFormat1:
+  case SpeakerLayout::BFormat2:
+  case SpeakerLayout::BFormat3:
+    // The order is set on the buffer with AL_UNPACK_AMBISONIC_ORDER_SOFT
+    result.append("BFORMAT3D_");
+    break;
+  }
+
+  switch (bitness)
+  {
+  case MediaBitness::bit8:
+    result.append("8");
+    break;
+  case MediaBitness::bit16:
+    result.append("16");
+    break;
+  case MediaBitness::bit24:
+    //result.append("QUAD");
+    break;
+  case MediaBitness::bit32:
+    result.append("32");
+    break;
+  case MediaBitness::bitfloat:
+    if (speaker_layout == SpeakerLayout::Stereo ||
+      speaker_layout == SpeakerLayout::Mono)
+    {
+      result.append("_FLOAT32");
+    }
+    else if (IsAmbisonic(speaker_layout))
+    {
+      result.append("FLOAT32");
+    }
+    else
+    {
+      result.append("32");
+    }
+    break;
+  }
+
+  return result;
+}
+
+size_t GetSampleSize(MediaBitness bitness)
+{
+  switch (bitness)
+  {
+  case MediaBitness::bit8:
+    return sizeof(int8_t);
+  case MediaBitness::bit16:
+    return sizeof(int16_t);
+  case MediaBitness::bit24:
+    // Packed, as delivered by upstream filters
+    return 3;
+  case MediaBitness::bit32:
+    return sizeof(int32_t);
+  case MediaBitness::bitfloat:
+    return sizeof(float);
+  }
+
+  return 0;
+}
+
+size_t GetChannelCount(SpeakerLayout speaker_layout)
+{
+  switch (speaker_layout)
+  {
+  case SpeakerLayout::Mono:
+    return 1;
+  case SpeakerLayout::Stereo:
+    return 2;
+  case SpeakerLayout::Quad:
+    return 4;
+  case SpeakerLayout::Surround6:
+    return 6;
+  case SpeakerLayout::Surround8:
+    return 8;
+  case SpeakerLayout::BFormat1:
+    return 4;
+  case SpeakerLayout::BFormat2:
+    return 9;
+  case SpeakerLayout::BFormat3:
+    return 16;
+  }
+
+  return 0;
+}
+
+bool IsAmbisonic(SpeakerLayout speaker_layout)
+{
+  return speaker_layout == SpeakerLayout::BFormat1 ||
+    speaker_layout == SpeakerLayout::BFormat2 ||
+    speaker_layout == SpeakerLayout::BFormat3;
+}
+
+size_t GetFrameSize(SpeakerLayout speaker_layout, MediaBitness bitness)
+{
+  return GetChannelCount(speaker_layout) * GetSampleSize(bitness);
+}
@@ -0,0 +1,60 @@
+// Audio formats understood by the renderer core and helpers to describe
+// them. Shared by the mixer, the output backends and the DirectShow pin.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum SpeakerLayout
+{
+  Mono,
+  Stereo,
+  Quad,
+  Surround6,
+  Surround8,
+  // Ambisonic B-Format, 4, 9 and 16 channels
+  BFormat1,
+  BFormat2,
+  BFormat3
+};
+
+enum AmbisonicLayout
+{
+  FuMa,
+  ACN
+};
+
+enum AmbisonicScaling
+{
+  FuMaScaling,
+  SN3D,
+  N3D
+};
+
+enum MediaBitness
+{
+  bit8,
+  bit16,
+  bit24,
+  bit32,
+  bitfloat
+};
+
+struct AudioFormat
+{
+  uint32_t frequency;
+  SpeakerLayout speaker_layout;
+  MediaBitness bitness;
+  // Only used by the B-Format layouts
+  AmbisonicLayout ambisonic_layout = FuMa;
+  AmbisonicScaling ambisonic_scaling = FuMaScaling;
+};
+
+// Name of the matching OpenAL format enum, for alGetEnumValue
+std::string GenerateFormatString(SpeakerLayout speaker_layout, MediaBitness bitness);
+size_t GetSampleSize(MediaBitness bitness);
+size_t GetChannelCount(SpeakerLayout speaker_layout);
+size_t GetFrameSize(SpeakerLayout speaker_layout, MediaBitness bitness);
+bool IsAmbisonic(SpeakerLayout speaker_layout);
@@ -0,0 +1,88 @@
+// Interfaces between the parts of the renderer core. The DirectShow filter
+// feeds an IAudioSink, an output backend pulls mixed frames from an
+// IAudioSource and the mixer drives the backend through IAudioOutput.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "AudioFormat.h"
+
+// The data of one received sample
+struct AudioBlock
+{
+  const void* data;
+  size_t length;
+};
+
+// Sample input, fed by the thread delivering decoded audio
+class IAudioSink
+{
+public:
+  virtual ~IAudioSink() = default;
+
+  // Queue interleaved frames in the last format set, may block until the
+  // output asks for more
+  virtual bool Receive(const void* data, size_t length) = 0;
+
+  // Receive for each block in turn, with one wake-up of the output and at
+  // most one wait for it, after all are queued
+  virtual bool ReceiveMultiple(const AudioBlock* blocks, size_t count) = 0;
+
+  // Format of the data received from now on
+  virtual void SetFormat(const AudioFormat& format) = 0;
+
+  // Drop everything queued
+  virtual void Flush() = 0;
+};
+
+// Mixed frames, pulled by the output thread
+class IAudioSource
+{
+public:
+  virtual ~IAudioSource() = default;
+
+  virtual bool IsStreaming() = 0;
+
+  // Fill samples with up to num_frames frames in the output format. Returns
+  // the frames written, 0 when the output format changed.
+  virtual size_t Mix(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample) = 0;
+};
+
+// Output backend
+class IAudioOutput
+{
+public:
+  virtual ~IAudioOutput() = default;
+
+  virtual bool OpenDevice() = 0;
+  virtual void CloseDevice() = 0;
+  virtual bool StartDevice() = 0;
+  virtual void StopDevice() = 0;
+
+  // Whether format can be played, directly or converted by the mixer
+  virtual bool isFormatSupported(const AudioFormat& format) = 0;
+  virtual void setFormat(const AudioFormat& format) = 0;
+  virtual AudioFormat getFormat() = 0;
+
+  // Device format mode locks the output to the format returned by
+  // getDeviceFormat, the mixer converts whatever is received to it
+  virtual bool getDeviceFormatMode() = 0;
+  virtual AudioFormat getDeviceFormat() = 0;
+};
+
+// Called on the output thread each time a buffer of mixed frames has been
+// handed to the device
+typedef std::function<void(size_t frames)> SubmitCallback;
+
+// Time source, in 100 ns units like DirectShow's REFERENCE_TIME
+class IClock
+{
+public:
+  virtual ~IClock() = default;
+
+  virtual int64_t GetTime() = 0;
+};
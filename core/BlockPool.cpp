@@ -0,0 +1,146 @@
+// Slab backed pool of fixed size blocks with per-thread magazines.
+
+#include <new>
+
+#include "BlockPool.h"
+
+struct CBlockPool::Magazine
+{
+  void* blocks[MAGAZINE_SIZE];
+  size_t count;
+};
+
+// Every pool's magazine of the thread, handed back to the depots when the
+// thread exits
+struct ThreadMagazines
+{
+  CBlockPool::Magazine magazines[CBlockPool::MAX_POOLS];
+
+  ~ThreadMagazines();
+};
+
+// Zero initialized, no constructor runs
+static thread_local ThreadMagazines t_magazines;
+
+// Magazine i of every thread is s_pools[i]'s
+static std::mutex s_pools_mutex;
+static CBlockPool* s_pools[CBlockPool::MAX_POOLS];
+
+ThreadMagazines::~ThreadMagazines()
+{
+  for (size_t i = 0; i < CBlockPool::MAX_POOLS; i++)
+  {
+    if (magazines[i].count != 0)
+    {
+      s_pools[i]->Drain(&magazines[i], magazines[i].count);
+    }
+  }
+}
+
+static inline void*& NextOf(void* block)
+{
+  return *static_cast<void**>(block);
+}
+
+CBlockPool* CBlockPool::Get(size_t block_size)
+{
+  // Room for the depot's link, and aligned as operator new would
+  const size_t align = alignof(std::max_align_t);
+  if (block_size < sizeof(void*))
+  {
+    block_size = sizeof(void*);
+  }
+  block_size = (block_size + align - 1) & ~(align - 1);
+
+  std::lock_guard<std::mutex> lock(s_pools_mutex);
+  for (size_t i = 0; i < MAX_POOLS; i++)
+  {
+    if (!s_pools[i])
+    {
+      s_pools[i] = new (std::nothrow) CBlockPool(block_size, i);
+      return s_pools[i];
+    }
+    if (s_pools[i]->m_block_size == block_size)
+    {
+      return s_pools[i];
+    }
+  }
+
+  return nullptr;
+}
+
+CBlockPool::CBlockPool(size_t block_size, size_t index)
+  : m_block_size(block_size)
+  , m_index(index)
+{
+}
+
+void* CBlockPool::Allocate()
+{
+  Magazine& magazine = t_magazines.magazines[m_index];
+  if (magazine.count == 0)
+  {
+    Refill(&magazine);
+    if (magazine.count == 0)
+    {
+      return nullptr;
+    }
+  }
+
+  return magazine.blocks[--magazine.count];
+}
+
+void CBlockPool::Free(void* block)
+{
+  Magazine& magazine = t_magazines.magazines[m_index];
+  if (magazine.count == MAGAZINE_SIZE)
+  {
+    Drain(&magazine, MAGAZINE_SIZE / 2);
+  }
+
+  magazine.blocks[magazine.count++] = block;
+}
+
+size_t CBlockPool::Capacity()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_capacity;
+}
+
+void CBlockPool::Refill(Magazine* magazine)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_depot)
+  {
+    char* slab = new (std::nothrow) char[m_block_size * SLAB_BLOCKS];
+    if (!slab)
+    {
+      return;
+    }
+    for (size_t i = SLAB_BLOCKS; i > 0; i--)
+    {
+      void* block = slab + (i - 1) * m_block_size;
+      NextOf(block) = m_depot;
+      m_depot = block;
+    }
+    m_capacity += SLAB_BLOCKS;
+  }
+
+  while (m_depot && magazine->count < MAGAZINE_SIZE / 2)
+  {
+    void* block = m_depot;
+    m_depot = NextOf(block);
+    magazine->blocks[magazine->count++] = block;
+  }
+}
+
+void CBlockPool::Drain(Magazine* magazine, size_t count)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < count; i++)
+  {
+    void* block = magazine->blocks[--magazine->count];
+    NextOf(block) = m_depot;
+    m_depot = block;
+  }
+}
@@ -0,0 +1,60 @@
+// Fixed size blocks for small objects made and freed at a high rate from
+// several threads, the nodes of the base classes' lists. Blocks are carved
+// from slabs and never go back to the heap. Every thread keeps a magazine of
+// free blocks for each pool, so most allocations and frees touch nothing
+// shared; an empty or full magazine trades half a magazine of blocks with
+// the pool's depot, under its lock. A block freed on another thread than
+// the one that allocated it simply joins that thread's magazine.
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+class CBlockPool
+{
+public:
+  static const size_t MAX_POOLS = 4;
+  static const size_t MAGAZINE_SIZE = 32;
+  static const size_t SLAB_BLOCKS = 64;
+
+  // The pool of blocks of at least block_size bytes, made on first use and
+  // never destroyed, as magazines may hold blocks until their thread exits.
+  // nullptr once MAX_POOLS sizes are in use.
+  static CBlockPool* Get(size_t block_size);
+
+  CBlockPool(const CBlockPool&) = delete;
+  CBlockPool& operator=(const CBlockPool&) = delete;
+
+  // nullptr when out of memory
+  void* Allocate();
+  // A block of this pool
+  void Free(void* block);
+
+  size_t BlockSize() const
+  {
+    return m_block_size;
+  }
+
+  // Blocks carved from slabs so far, free or not
+  size_t Capacity();
+
+private:
+  friend struct ThreadMagazines;
+  struct Magazine;
+
+  CBlockPool(size_t block_size, size_t index);
+  ~CBlockPool() = delete;
+
+  // Up to half a magazine from the depot, from a new slab when it is empty
+  void Refill(Magazine* magazine);
+  // count blocks off the top of the magazine to the depot
+  void Drain(Magazine* magazine, size_t count);
+
+  size_t m_block_size;
+  size_t m_index;               // of this pool's magazine in every thread's
+
+  std::mutex m_mutex;
+  void* m_depot = nullptr;      // free blocks, linked through their first word
+  size_t m_capacity = 0;
+};
@@ -0,0 +1,149 @@
+// Chrome trace-event JSON export of the event trace.
+
+#include <cinttypes>
+#include <cstdarg>
+#include <memory>
+
+#include "ChromeTrace.h"
+
+CChromeTraceWriter::~CChromeTraceWriter()
+{
+  Close();
+}
+
+bool CChromeTraceWriter::Open(const std::string& path)
+{
+  Close();
+
+#ifdef _MSC_VER
+  if (fopen_s(&m_file, path.c_str(), "w") != 0)
+  {
+    m_file = nullptr;
+  }
+#else
+  m_file = std::fopen(path.c_str(), "w");
+#endif
+  if (!m_file)
+  {
+    return false;
+  }
+
+  std::fputs("[", m_file);
+  m_first_record = true;
+  m_start_time = -1;
+  WriteRecord("{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"OpenAL Renderer\"}}");
+
+  return true;
+}
+
+void CChromeTraceWriter::Close()
+{
+  if (m_file)
+  {
+    std::fputs("\n]\n", m_file);
+    std::fclose(m_file);
+    m_file = nullptr;
+  }
+}
+
+void CChromeTraceWriter::WriteRecord(const char* format, ...)
+{
+  std::fputs(m_first_record ? "\n" : ",\n", m_file);
+  m_first_record = false;
+
+  va_list args;
+  va_start(args, format);
+  std::vfprintf(m_file, format, args);
+  va_end(args);
+}
+
+void CChromeTraceWriter::Write(const TraceEvent& event)
+{
+  if (!m_file)
+  {
+    return;
+  }
+
+  // Microseconds since the first event
+  if (m_start_time < 0)
+  {
+    m_start_time = event.time;
+  }
+  double ts = (event.time - m_start_time) / 1000.0;
+
+  const TraceEventInfo& info = GetTraceEventInfo(event.id);
+  uint32_t tid = event.thread;
+
+  switch (event.id)
+  {
+  case TraceReceiveBegin:
+    WriteRecord("{\"name\": \"Receive\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, "
+      "\"args\": {\"bytes\": %" PRId64 "}}", ts, tid, event.args[0]);
+    break;
+  case TraceReceiveEnd:
+    WriteRecord("{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, "
+      "\"args\": {\"queued\": %" PRId64 "}}", ts, tid, event.args[0]);
+    WriteRecord("{\"name\": \"queued bytes\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, "
+      "\"args\": {\"bytes\": %" PRId64 "}}", ts, event.args[0]);
+    break;
+  case TraceMixBegin:
+    WriteRecord("{\"name\": \"Mix\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, "
+      "\"args\": {\"requested\": %" PRId64 "}}", ts, tid, event.args[0]);
+    break;
+  case TraceMixEnd:
+    WriteRecord("{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, "
+      "\"args\": {\"frames\": %" PRId64 "}}", ts, tid, event.args[0]);
+    break;
+  case TraceBufferQueued:
+    WriteRecord("{\"name\": \"alBufferData\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, "
+      "\"args\": {\"frames\": %" PRId64 "}}", ts, tid, event.args[0]);
+    WriteRecord("{\"name\": \"queued buffers\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, "
+      "\"args\": {\"buffers\": %" PRId64 "}}", ts, event.args[1]);
+    break;
+  case TraceSampleTime:
+    WriteRecord("{\"name\": \"buffered ms\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, "
+      "\"args\": {\"ms\": %" PRId64 "}}", ts, event.args[0]);
+    break;
+  case TraceThreadName:
+    WriteRecord("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+      "\"args\": {\"name\": \"%s\"}}", tid, event.text ? event.text : "");
+    break;
+  default:
+  {
+    // Underruns, flushes, errors and state changes stand out across all threads
+    bool global = event.id == TraceUnderrun || event.id == TraceFlush || event.id == TraceStreaming ||
+      event.id == TraceStopped || event.id == TraceDropped;
+
+    WriteRecord("{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"%s\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": {",
+      info.name, global ? "g" : "t", ts, tid);
+    const char* separator = "";
+    for (int i = 0; i < 3 && info.args[i]; i++)
+    {
+      std::fprintf(m_file, "%s\"%s\": %" PRId64, separator, info.args[i], event.args[i]);
+      separator = ", ";
+    }
+    if (event.text)
+    {
+      std::fprintf(m_file, "%s\"text\": \"%s\"", separator, event.text);
+    }
+    std::fputs("}}", m_file);
+    break;
+  }
+  }
+}
+
+bool SetChromeTraceOutput(const std::string& path)
+{
+  auto writer = std::make_shared<CChromeTraceWriter>();
+  if (!writer->Open(path))
+  {
+    return false;
+  }
+
+  CEventTrace::Get().SetSink([writer](const TraceEvent& event)
+  {
+    writer->Write(event);
+  });
+
+  return true;
+}
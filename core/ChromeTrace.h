@@ -0,0 +1,37 @@
+// Chrome trace-event JSON export of the event trace. The file loads in
+// chrome://tracing and ui.perfetto.dev, where Receive and Mix show up as
+// spans on the decoder and sound loop threads, and queued buffers, underruns,
+// flushes and state changes as markers and counters between them.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "EventTrace.h"
+
+class CChromeTraceWriter
+{
+public:
+  ~CChromeTraceWriter();
+
+  bool Open(const std::string& path);
+
+  // Terminates the JSON array, the file is complete after this
+  void Close();
+
+  // Called on the drain thread, see CEventTrace::SetSink
+  void Write(const TraceEvent& event);
+
+private:
+  void WriteRecord(const char* format, ...);
+
+  std::FILE* m_file = nullptr;
+  bool m_first_record = true;
+  int64_t m_start_time = -1;
+};
+
+// Send every drained event to a new Chrome trace at path. The file is closed
+// when the sink is replaced.
+bool SetChromeTraceOutput(const std::string& path);
@@ -0,0 +1,53 @@
+// Clocks for the renderer core
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <chrono>
+
+#include "Clock.h"
+
+static const int64_t UNITS_PER_SECOND = 10000000;
+
+int64_t CMonotonicClock::GetTime()
+{
+  using units = std::chrono::duration<int64_t, std::ratio<1, 10000000>>;
+  return std::chrono::duration_cast<units>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+
+static int64_t GetPerformanceFrequency()
+{
+  LARGE_INTEGER frequency;
+  ::QueryPerformanceFrequency(&frequency);
+  return frequency.QuadPart;
+}
+
+int64_t CPerformanceClock::GetTime()
+{
+  // Never changes while the system runs
+  static const int64_t frequency = GetPerformanceFrequency();
+
+  LARGE_INTEGER counter;
+  ::QueryPerformanceCounter(&counter);
+  // Whole seconds apart so the product cannot overflow, 10 MHz on most
+  // systems makes both divisions exact
+  int64_t seconds = counter.QuadPart / frequency;
+  int64_t remainder = counter.QuadPart % frequency;
+  return seconds * UNITS_PER_SECOND + remainder * UNITS_PER_SECOND / frequency;
+}
+
+#else
+
+int64_t CPerformanceClock::GetTime()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+  return static_cast<int64_t>(now.tv_sec) * UNITS_PER_SECOND + now.tv_nsec / 100;
+}
+
+#endif
@@ -0,0 +1,22 @@
+// Clocks for the renderer core
+
+#pragma once
+
+#include "AudioInterfaces.h"
+
+// Monotonic system time, never adjusted
+class CMonotonicClock final : public IClock
+{
+public:
+  int64_t GetTime() override;
+};
+
+// The hardware counter behind the system time, QueryPerformanceCounter on
+// Windows and CLOCK_MONOTONIC_RAW elsewhere, which unlike CLOCK_MONOTONIC
+// is not slewed by NTP. 100 ns resolution on current hardware. The time
+// base of the reference clocks.
+class CPerformanceClock final : public IClock
+{
+public:
+  int64_t GetTime() override;
+};
@@ -0,0 +1,111 @@
+// Lock-free reads of a reference clock. The clock's time is published as a
+// linear function of the system time, the (private time, system time, rate)
+// of its last adjustment, through a sequence lock: the writer never waits
+// and readers only retry while a write is in progress, they take no lock
+// and never block each other. CMonotonicTime then keeps what the clock
+// returns from going backwards, also without a lock.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+struct ClockSnapshot
+{
+  int64_t private_time;   // clock time at system_time, 100 ns units
+  int64_t system_time;    // in the units of the system clock read
+  double rate;            // clock time per system time unit
+};
+
+class CClockSeqlock
+{
+public:
+  CClockSeqlock(int64_t private_time, int64_t system_time, double rate)
+  {
+    Publish(private_time, system_time, rate);
+  }
+
+  CClockSeqlock(const CClockSeqlock&) = delete;
+  CClockSeqlock& operator=(const CClockSeqlock&) = delete;
+
+  // Writers must be serialized by the caller
+  void Publish(int64_t private_time, int64_t system_time, double rate)
+  {
+    uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+    // Odd while writing
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_private_time.store(private_time, std::memory_order_relaxed);
+    m_system_time.store(system_time, std::memory_order_relaxed);
+    m_rate.store(rate, std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  ClockSnapshot Read() const
+  {
+    ClockSnapshot snapshot;
+    for (;;)
+    {
+      uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+      snapshot.private_time = m_private_time.load(std::memory_order_relaxed);
+      snapshot.system_time = m_system_time.load(std::memory_order_relaxed);
+      snapshot.rate = m_rate.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if (!(sequence & 1) && m_sequence.load(std::memory_order_relaxed) == sequence)
+      {
+        return snapshot;
+      }
+    }
+  }
+
+  // The clock time at system_time, which must not be before the snapshot's
+  static int64_t Extrapolate(const ClockSnapshot& snapshot, int64_t system_time)
+  {
+    return snapshot.private_time + static_cast<int64_t>((system_time - snapshot.system_time) * snapshot.rate);
+  }
+
+private:
+  std::atomic<uint32_t> m_sequence{0};
+  std::atomic<int64_t> m_private_time{0};
+  std::atomic<int64_t> m_system_time{0};
+  std::atomic<double> m_rate{1.0};
+};
+
+// The latest time returned so far
+class CMonotonicTime
+{
+public:
+  explicit CMonotonicTime(int64_t start = 0)
+    : m_last(start)
+  {
+  }
+
+  // Moves the time forward to time and returns it, or returns the later
+  // time already returned. *advanced tells which.
+  int64_t Advance(int64_t time, bool* advanced)
+  {
+    int64_t last = m_last.load(std::memory_order_relaxed);
+    while (time > last)
+    {
+      if (m_last.compare_exchange_weak(last, time, std::memory_order_relaxed))
+      {
+        *advanced = true;
+        return time;
+      }
+    }
+    *advanced = false;
+    return last;
+  }
+
+  // May move the time back, for a clock restarting
+  void Reset(int64_t time)
+  {
+    m_last.store(time, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<int64_t> m_last;
+};
@@ -0,0 +1,246 @@
+// Sub-millisecond waits for the reference clock's advise thread.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include "Clock.h"
+#include "DeadlineWait.h"
+
+#ifdef _WIN32
+// Windows 10 1803, older SDKs lack it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+static const int64_t UNITS_PER_SECOND = 10000000;
+
+static inline void CpuPause()
+{
+#ifdef _WIN32
+  YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+#ifdef _WIN32
+
+CDeadlineWait::CDeadlineWait(void* wake_event)
+  : m_wake_event(wake_event)
+{
+  m_timer = ::CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+  m_high_resolution = m_timer != nullptr;
+  if (!m_timer)
+  {
+    // Rounded to the system timer resolution
+    m_timer = ::CreateWaitableTimerW(nullptr, FALSE, nullptr);
+  }
+
+  if (!m_wake_event)
+  {
+    m_wake_event = ::CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    m_own_wake_event = true;
+  }
+}
+
+CDeadlineWait::~CDeadlineWait()
+{
+  if (m_timer)
+  {
+    ::CloseHandle(m_timer);
+  }
+  if (m_own_wake_event && m_wake_event)
+  {
+    ::CloseHandle(m_wake_event);
+  }
+}
+
+bool CDeadlineWait::IsValid() const
+{
+  return m_timer && m_wake_event;
+}
+
+void CDeadlineWait::Wake()
+{
+  ::SetEvent(m_wake_event);
+}
+
+bool CDeadlineWait::SleepUntil(int64_t until)
+{
+  if (!IsValid())
+  {
+    return false;
+  }
+
+  if (until == NO_DEADLINE)
+  {
+    return ::WaitForSingleObject(m_wake_event, INFINITE) == WAIT_OBJECT_0;
+  }
+
+  int64_t now = CMonotonicClock().GetTime();
+  if (until <= now)
+  {
+    return ::WaitForSingleObject(m_wake_event, 0) == WAIT_OBJECT_0;
+  }
+
+  // Negative is relative, in 100 ns units
+  LARGE_INTEGER due;
+  due.QuadPart = -(until - now);
+  if (!::SetWaitableTimer(m_timer, &due, 0, nullptr, nullptr, FALSE))
+  {
+    return false;
+  }
+
+  HANDLE handles[] = { m_wake_event, m_timer };
+  if (::WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0)
+  {
+    ::CancelWaitableTimer(m_timer);
+    return true;
+  }
+  return false;
+}
+
+#else
+
+CDeadlineWait::CDeadlineWait(void* /*wake_event*/)
+{
+  // CLOCK_MONOTONIC is the clock of std::chrono::steady_clock
+  m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  m_high_resolution = m_timer >= 0;
+}
+
+CDeadlineWait::~CDeadlineWait()
+{
+  if (m_timer >= 0)
+  {
+    close(m_timer);
+  }
+  if (m_wake >= 0)
+  {
+    close(m_wake);
+  }
+}
+
+bool CDeadlineWait::IsValid() const
+{
+  return m_timer >= 0 && m_wake >= 0;
+}
+
+void CDeadlineWait::Wake()
+{
+  uint64_t one = 1;
+  ssize_t written = write(m_wake, &one, sizeof(one));
+  (void)written;
+}
+
+bool CDeadlineWait::SleepUntil(int64_t until)
+{
+  if (!IsValid())
+  {
+    return false;
+  }
+
+  // The default 50 us of timer slack would be most of the lateness
+  static thread_local bool s_slack_set = false;
+  if (!s_slack_set)
+  {
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+    s_slack_set = true;
+  }
+
+  int timeout = -1;
+  nfds_t count = 1;
+  if (until != NO_DEADLINE)
+  {
+    if (until <= CMonotonicClock().GetTime())
+    {
+      timeout = 0;
+    }
+    else
+    {
+      itimerspec spec = {};
+      spec.it_value.tv_sec = static_cast<time_t>(until / UNITS_PER_SECOND);
+      spec.it_value.tv_nsec = static_cast<long>(until % UNITS_PER_SECOND * 100);
+      if (timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr) != 0)
+      {
+        return false;
+      }
+      count = 2;
+    }
+  }
+
+  pollfd fds[2] = { { m_wake, POLLIN, 0 }, { m_timer, POLLIN, 0 } };
+  int result;
+  do
+  {
+    result = poll(fds, count, timeout);
+  } while (result < 0 && errno == EINTR);
+
+  uint64_t value;
+  if (fds[0].revents & POLLIN)
+  {
+    ssize_t read_size = read(m_wake, &value, sizeof(value));
+    (void)read_size;
+
+    // Disarm, and drop an expiry that raced with the wake
+    itimerspec spec = {};
+    timerfd_settime(m_timer, 0, &spec, nullptr);
+    read_size = read(m_timer, &value, sizeof(value));
+    return true;
+  }
+
+  if (count == 2)
+  {
+    ssize_t read_size = read(m_timer, &value, sizeof(value));
+    (void)read_size;
+  }
+  return false;
+}
+
+#endif
+
+bool CDeadlineWait::WaitUntil(int64_t deadline)
+{
+  if (!IsValid())
+  {
+    return false;
+  }
+
+  if (deadline == NO_DEADLINE)
+  {
+    return SleepUntil(NO_DEADLINE);
+  }
+
+  if (SleepUntil(deadline - GetSpin()))
+  {
+    return true;
+  }
+
+  // The last stretch, and whatever the timer left
+  CMonotonicClock clock;
+  while (clock.GetTime() < deadline)
+  {
+    CpuPause();
+  }
+  return false;
+}
+
+bool CDeadlineWait::WaitFor(int64_t duration)
+{
+  int64_t now = CMonotonicClock().GetTime();
+  if (duration >= NO_DEADLINE - now)
+  {
+    return WaitUntil(NO_DEADLINE);
+  }
+  return WaitUntil(now + duration);
+}
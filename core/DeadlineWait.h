@@ -0,0 +1,68 @@
+// Sub-millisecond waits for the reference clock's advise thread. Sleeps on
+// a high resolution timer, a waitable timer on Windows and a timerfd
+// elsewhere, until a configurable spin time before the deadline and then
+// spins, so a wait ends within microseconds of its deadline rather than on
+// the next millisecond tick. Times are CMonotonicClock time, 100 ns units.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+class CDeadlineWait
+{
+public:
+  // Wait for the wake only
+  static const int64_t NO_DEADLINE = INT64_MAX;
+
+  // On Windows, wake_event is an auto-reset event handle that ends a wait
+  // when set, Wake sets it. Without one, or elsewhere, the wait has its own.
+  explicit CDeadlineWait(void* wake_event = nullptr);
+  ~CDeadlineWait();
+
+  CDeadlineWait(const CDeadlineWait&) = delete;
+  CDeadlineWait& operator=(const CDeadlineWait&) = delete;
+
+  // False when the timer could not be created, waits then return at once
+  bool IsValid() const;
+  // False when only a millisecond timer was available, before Windows 10
+  // 1803
+  bool IsHighResolution() const
+  {
+    return m_high_resolution;
+  }
+
+  // How long before the deadline to stop sleeping and spin. The spin does
+  // not watch the wake, a wake during it ends the next wait instead.
+  void SetSpin(int64_t spin)
+  {
+    m_spin.store(spin > 0 ? spin : 0, std::memory_order_relaxed);
+  }
+
+  int64_t GetSpin() const
+  {
+    return m_spin.load(std::memory_order_relaxed);
+  }
+
+  // Returns true when woken, false at the deadline. A deadline already
+  // passed returns false at once, unless a wake is pending.
+  bool WaitUntil(int64_t deadline);
+  bool WaitFor(int64_t duration);
+
+  void Wake();
+
+private:
+  bool SleepUntil(int64_t until);
+
+  std::atomic<int64_t> m_spin{0};
+  bool m_high_resolution = false;
+
+#ifdef _WIN32
+  void* m_timer = nullptr;
+  void* m_wake_event = nullptr;
+  bool m_own_wake_event = false;
+#else
+  int m_timer = -1;
+  int m_wake = -1;
+#endif
+};
@@ -0,0 +1,305 @@
+// Hot path event trace.
+//
+// The ring is a bounded multi-producer queue, each slot carries a sequence
+// number telling producers and the consumer whose turn it is. Recording is
+// a compare-exchange on the write position and a copy, producers never wait
+// on each other or on the drain thread.
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+
+#include "EventTrace.h"
+#include "Log.h"
+
+static const TraceEventInfo EVENT_INFO[TraceEventCount] =
+{
+  { "receive begin", { "bytes", nullptr, nullptr } },
+  { "receive end", { "queued", nullptr, nullptr } },
+  { "mix begin", { "frames", nullptr, nullptr } },
+  { "mix end", { "frames", nullptr, nullptr } },
+  { "flush", { "dropped", nullptr, nullptr } },
+  { "streaming", { "enabled", nullptr, nullptr } },
+  { "sound loop start", { "buffers", "frames_per_buffer", nullptr } },
+  { "format change", { "frequency", "layout", "bitness" } },
+  { "buffer queued", { "frames", "queued", nullptr } },
+  { "buffer underrun", { "queued", nullptr, nullptr } },
+  { "AL error", { "error", nullptr, nullptr } },
+  { "sample time", { "buffered_ms", nullptr, nullptr } },
+  { "stopped, cleared buffers", { nullptr, nullptr, nullptr } },
+  { "events dropped", { "count", nullptr, nullptr } },
+  { "thread name", { nullptr, nullptr, nullptr } },
+  { "hot path allocation", { "bytes", "pass", nullptr } },
+};
+
+const TraceEventInfo& GetTraceEventInfo(TraceEventId id)
+{
+  return EVENT_INFO[id < TraceEventCount ? id : TraceDropped];
+}
+
+void FormatTraceEvent(const TraceEvent& event, char* text, size_t size)
+{
+  const TraceEventInfo& info = GetTraceEventInfo(event.id);
+
+  int length = std::snprintf(text, size, "[%" PRId64 ".%06" PRId64 "] thread %u: %s",
+    event.time / 1000000000, event.time / 1000 % 1000000, event.thread, info.name);
+
+  for (int i = 0; i < 3 && info.args[i]; i++)
+  {
+    if (length < 0 || static_cast<size_t>(length) >= size)
+    {
+      return;
+    }
+    length += std::snprintf(text + length, size - length, " %s=%" PRId64, info.args[i], event.args[i]);
+  }
+
+  if (event.text && length >= 0 && static_cast<size_t>(length) < size)
+  {
+    std::snprintf(text + length, size - length, " (%s)", event.text);
+  }
+}
+
+static void LogTraceEvent(const TraceEvent& event)
+{
+  char text[256];
+  FormatTraceEvent(event, text, sizeof(text) - 1);
+  LogMessage(std::string(text) + "\n");
+}
+
+static uint32_t GetTraceThread()
+{
+  static std::atomic<uint32_t> next_thread = 1;
+  thread_local uint32_t thread = 0;
+
+  if (thread == 0)
+  {
+    thread = next_thread++;
+  }
+  return thread;
+}
+
+CEventTrace& CEventTrace::Get()
+{
+  // Never destroyed, joining the drain thread at DLL unload could deadlock
+  static CEventTrace* trace = new CEventTrace();
+  return *trace;
+}
+
+CEventTrace::CEventTrace()
+  : m_slots(new Slot[RING_SIZE]),
+  m_sink(LogTraceEvent)
+{
+  for (size_t i = 0; i < RING_SIZE; i++)
+  {
+    m_slots[i].sequence = i;
+  }
+}
+
+CEventTrace::~CEventTrace()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+    m_drain_users = 0;
+    m_drain_stop = true;
+  }
+  m_drain_cv.notify_all();
+  if (m_drain_thread.joinable())
+  {
+    m_drain_thread.join();
+  }
+
+  delete[] m_slots;
+}
+
+void CEventTrace::Record(TraceEventId id, int64_t arg0, int64_t arg1, int64_t arg2, const char* text)
+{
+  uint64_t position = m_write_position.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;)
+  {
+    slot = &m_slots[position % RING_SIZE];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int64_t difference = static_cast<int64_t>(sequence - position);
+
+    if (difference == 0)
+    {
+      // Our turn, claim the slot
+      if (m_write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      // The drain thread hasn't caught up
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      position = m_write_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  TraceEvent& event = slot->event;
+  event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  event.args[0] = arg0;
+  event.args[1] = arg1;
+  event.args[2] = arg2;
+  event.text = text;
+  event.thread = GetTraceThread();
+  event.id = id;
+
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+size_t CEventTrace::Drain(const TraceSink& sink)
+{
+  std::lock_guard<std::mutex> lock(m_read_mutex);
+
+  size_t drained = 0;
+  for (;;)
+  {
+    Slot& slot = m_slots[m_read_position % RING_SIZE];
+    if (slot.sequence.load(std::memory_order_acquire) != m_read_position + 1)
+    {
+      break;
+    }
+
+    TraceEvent event = slot.event;
+    slot.sequence.store(m_read_position + RING_SIZE, std::memory_order_release);
+    m_read_position++;
+
+    if (sink)
+    {
+      sink(event);
+    }
+    drained++;
+  }
+
+  uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+  if (dropped != m_dropped_reported && sink)
+  {
+    TraceEvent event = {};
+    event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    event.args[0] = static_cast<int64_t>(dropped - m_dropped_reported);
+    event.thread = GetTraceThread();
+    event.id = TraceDropped;
+    sink(event);
+  }
+  m_dropped_reported = dropped;
+
+  return drained;
+}
+
+uint64_t CEventTrace::GetDropped()
+{
+  return m_dropped;
+}
+
+void CEventTrace::StartDrain()
+{
+  std::lock_guard<std::mutex> lock(m_drain_mutex);
+
+  if (m_drain_users++ == 0)
+  {
+    if (m_drain_thread.joinable())
+    {
+      m_drain_thread.join();
+    }
+
+    m_drain_stop = false;
+    m_drain_thread = std::thread(&CEventTrace::DrainLoop, this);
+  }
+}
+
+void CEventTrace::StopDrain()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+
+    if (m_drain_users == 0 || --m_drain_users > 0)
+    {
+      return;
+    }
+    m_drain_stop = true;
+  }
+
+  m_drain_cv.notify_all();
+  if (m_drain_thread.joinable() && m_drain_thread.get_id() != std::this_thread::get_id())
+  {
+    m_drain_thread.join();
+  }
+}
+
+void CEventTrace::SetSink(TraceSink sink)
+{
+  std::lock_guard<std::mutex> lock(m_drain_mutex);
+
+  if (sink)
+  {
+    m_sink = std::move(sink);
+  }
+  else
+  {
+    m_sink = LogTraceEvent;
+  }
+}
+
+bool CEventTrace::SetOutputFile(const std::string& path)
+{
+#ifdef _MSC_VER
+  std::FILE* opened = nullptr;
+  if (fopen_s(&opened, path.c_str(), "a") != 0)
+  {
+    opened = nullptr;
+  }
+#else
+  std::FILE* opened = std::fopen(path.c_str(), "a");
+#endif
+  if (!opened)
+  {
+    return false;
+  }
+
+  std::shared_ptr<std::FILE> file(opened, std::fclose);
+  SetSink([file](const TraceEvent& event)
+  {
+    char text[256];
+    FormatTraceEvent(event, text, sizeof(text));
+    std::fprintf(file.get(), "%s\n", text);
+  });
+
+  return true;
+}
+
+void CEventTrace::DrainLoop()
+{
+  // Only ever behind the real-time threads
+#ifdef _WIN32
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+  sched_param param = {};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+  std::unique_lock<std::mutex> lock(m_drain_mutex);
+  while (!m_drain_stop)
+  {
+    m_drain_cv.wait_for(lock, std::chrono::milliseconds(20));
+    Drain(m_sink);
+  }
+
+  // What was recorded before the last user stopped
+  Drain(m_sink);
+}
@@ -0,0 +1,132 @@
+// Hot path event trace. The sound loop, Receive and Mix record fixed size
+// binary events into a lock-free ring instead of formatting log messages on
+// real-time threads. A low priority thread drains the ring and hands the
+// events to a sink, by default formatted as text to LogMessage.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum TraceEventId : uint16_t
+{
+  TraceReceiveBegin,    // bytes
+  TraceReceiveEnd,      // bytes queued
+  TraceMixBegin,        // frames requested
+  TraceMixEnd,          // frames mixed
+  TraceFlush,           // bytes dropped
+  TraceStreaming,       // 1 when streaming starts, 0 when it stops
+  TraceSoundLoopStart,  // buffers, frames per buffer
+  TraceFormatChange,    // frequency, speaker layout, bitness
+  TraceBufferQueued,    // frames, buffers queued on the source
+  TraceUnderrun,        // buffers queued on the source
+  TraceALError,         // AL error code, text is what failed
+  TraceSampleTime,      // milliseconds buffered
+  TraceStopped,
+  TraceDropped,         // events lost to a full ring
+  TraceThreadName,      // text names the recording thread
+  TraceHotPathAllocation, // bytes, hot path pass, text names the hot path
+  TraceEventCount
+};
+
+struct TraceEvent
+{
+  int64_t time;         // steady clock, nanoseconds
+  int64_t args[3];
+  const char* text;     // string literal or nullptr, never freed
+  uint32_t thread;      // small per-thread number, in order of first event
+  TraceEventId id;
+};
+
+// Names of an event and its arguments, nullptr for unused arguments
+struct TraceEventInfo
+{
+  const char* name;
+  const char* args[3];
+};
+
+const TraceEventInfo& GetTraceEventInfo(TraceEventId id);
+
+// One line of text, without the newline
+void FormatTraceEvent(const TraceEvent& event, char* text, size_t size);
+
+// Called on the drain thread
+typedef std::function<void(const TraceEvent& event)> TraceSink;
+
+class CEventTrace
+{
+public:
+  // The process wide trace
+  static CEventTrace& Get();
+
+  CEventTrace();
+  ~CEventTrace();
+
+  // Lock free and allocation free, from any thread. The event is dropped
+  // when the ring is full.
+  void Record(TraceEventId id, int64_t arg0 = 0, int64_t arg1 = 0, int64_t arg2 = 0, const char* text = nullptr);
+
+  // The drain thread runs while at least one user has started it. Stopping
+  // the last user drains what is left.
+  void StartDrain();
+  void StopDrain();
+
+  // Where drained events go, the default formats them to LogMessage. An
+  // empty sink restores the default and releases the previous one.
+  void SetSink(TraceSink sink);
+  // Text lines appended to path instead, false if it can't be opened
+  bool SetOutputFile(const std::string& path);
+
+  // Hand queued events to sink on the calling thread, returns how many
+  size_t Drain(const TraceSink& sink);
+
+  uint64_t GetDropped();
+
+private:
+  static const size_t RING_SIZE = 8192;
+
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence;
+    TraceEvent event;
+  };
+
+  void DrainLoop();
+
+  Slot* m_slots;
+  std::atomic<uint64_t> m_write_position = 0;
+  uint64_t m_read_position = 0;
+  std::atomic<uint64_t> m_dropped = 0;
+  uint64_t m_dropped_reported = 0;
+  std::mutex m_read_mutex;
+
+  std::mutex m_drain_mutex;
+  std::condition_variable m_drain_cv;
+  std::thread m_drain_thread;
+  int m_drain_users = 0;
+  bool m_drain_stop = false;
+  TraceSink m_sink;
+};
+
+// Shorthand for recording into the process wide trace
+inline void TraceRecord(TraceEventId id, int64_t arg0 = 0, int64_t arg1 = 0, int64_t arg2 = 0, const char* text = nullptr)
+{
+  CEventTrace::Get().Record(id, arg0, arg1, arg2, text);
+}
+
+// Name the calling thread in the trace, recorded once per thread and name
+inline void TraceNameThread(const char* name)
+{
+  thread_local const char* named = nullptr;
+  if (named != name)
+  {
+    named = name;
+    TraceRecord(TraceThreadName, 0, 0, 0, name);
+  }
+}
@@ -0,0 +1,137 @@
+// Lock-free free list of allocator samples, two tagged Treiber stacks.
+
+#include <new>
+#include <vector>
+
+#include "FreeList.h"
+
+// The low 32 bits of a stack head are the top node, the high 32 its tag
+static inline uint32_t TopOf(uint64_t head)
+{
+  return static_cast<uint32_t>(head);
+}
+
+static inline uint64_t NextHead(uint64_t head, uint32_t top)
+{
+  return (((head >> 32) + 1) << 32) | top;
+}
+
+CFreeList::~CFreeList()
+{
+  delete[] m_nodes;
+}
+
+bool CFreeList::Reserve(size_t capacity)
+{
+  if (capacity <= m_capacity)
+  {
+    return true;
+  }
+  if (capacity >= NO_NODE)
+  {
+    return false;
+  }
+
+  Node* nodes = new (std::nothrow) Node[capacity];
+  if (!nodes)
+  {
+    return false;
+  }
+  std::vector<void*> items;
+  try
+  {
+    items.reserve(m_capacity);
+  }
+  catch (const std::bad_alloc&)
+  {
+    delete[] nodes;
+    return false;
+  }
+
+  while (void* item = Pop())
+  {
+    items.push_back(item);
+  }
+
+  // Every node spare, in order
+  for (size_t i = 0; i < capacity; i++)
+  {
+    nodes[i].next.store(i + 1 < capacity ? static_cast<uint32_t>(i + 1) : NO_NODE, std::memory_order_relaxed);
+    nodes[i].item = nullptr;
+  }
+  delete[] m_nodes;
+  m_nodes = nodes;
+  m_capacity = capacity;
+  m_items.store(NO_NODE);
+  m_spare.store(0);
+
+  // Back in the order they were, the last popped was the bottom
+  for (size_t i = items.size(); i > 0; i--)
+  {
+    Push(items[i - 1]);
+  }
+  return true;
+}
+
+uint32_t CFreeList::PopNode(std::atomic<uint64_t>& stack)
+{
+  uint64_t head = stack.load();
+  for (;;)
+  {
+    uint32_t top = TopOf(head);
+    if (top == NO_NODE)
+    {
+      return NO_NODE;
+    }
+
+    // The node may be popped and pushed elsewhere meanwhile, then the tag
+    // has moved on and the swap fails
+    uint32_t next = m_nodes[top].next.load(std::memory_order_relaxed);
+    if (stack.compare_exchange_weak(head, NextHead(head, next)))
+    {
+      return top;
+    }
+  }
+}
+
+void CFreeList::PushNode(std::atomic<uint64_t>& stack, uint32_t index)
+{
+  uint64_t head = stack.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    m_nodes[index].next.store(TopOf(head), std::memory_order_relaxed);
+    if (stack.compare_exchange_weak(head, NextHead(head, index)))
+    {
+      return;
+    }
+  }
+}
+
+void CFreeList::Push(void* item)
+{
+  // Never fails while there is room, the nodes not spare hold an item or
+  // are held by a push or pop in progress, each with a different item
+  uint32_t index = PopNode(m_spare);
+  if (index == NO_NODE)
+  {
+    return;
+  }
+
+  m_nodes[index].item = item;
+  PushNode(m_items, index);
+  m_count.fetch_add(1);
+}
+
+void* CFreeList::Pop()
+{
+  uint32_t index = PopNode(m_items);
+  if (index == NO_NODE)
+  {
+    return nullptr;
+  }
+
+  m_count.fetch_sub(1);
+  void* item = m_nodes[index].item;
+  PushNode(m_spare, index);
+  return item;
+}
@@ -0,0 +1,72 @@
+// Free samples of an allocator, shared by the threads getting and releasing
+// them without a lock. Two lock-free stacks (Treiber stacks) over a fixed
+// array of nodes: one of the nodes holding free items, one of spare nodes.
+// A stack head is a node index and a tag counting its changes, packed in
+// 64 bits so one compare-and-swap moves it, and the tag rules out the ABA
+// problem of a pointer stack. The list is sized up front to hold every
+// item there is, so a push always finds a spare node. Last in, first out,
+// so the item handed out is the one most recently released, still in the
+// cache.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class CFreeList
+{
+public:
+  CFreeList() = default;
+  ~CFreeList();
+
+  CFreeList(const CFreeList&) = delete;
+  CFreeList& operator=(const CFreeList&) = delete;
+
+  // Room for at least capacity items, keeping those on the list. Not thread
+  // safe: nothing may push or pop meanwhile. False when out of memory.
+  bool Reserve(size_t capacity);
+
+  size_t Capacity() const
+  {
+    return m_capacity;
+  }
+
+  // Lock-free. There must be room, never push more items than reserved.
+  void Push(void* item);
+  // Lock-free, nullptr when empty
+  void* Pop();
+
+  // Items on the list, exact when no push or pop is in progress. Counted
+  // after an item is pushed and before it is popped, so a count read after
+  // a push includes it.
+  long Count() const
+  {
+    return m_count.load();
+  }
+
+private:
+  static const uint32_t NO_NODE = UINT32_MAX;
+
+  struct Node
+  {
+    std::atomic<uint32_t> next;
+    void* item;
+  };
+
+  uint32_t PopNode(std::atomic<uint64_t>& stack);
+  void PushNode(std::atomic<uint64_t>& stack, uint32_t index);
+
+  Node* m_nodes = nullptr;
+  size_t m_capacity = 0;
+
+  // Padded apart, so the two stacks and the count do not share a cache
+  // line. Not alignas, which would over-align the allocators holding a list
+  // for their operator new.
+  char m_pad0[64];
+  std::atomic<uint64_t> m_items{NO_NODE};
+  char m_pad1[64 - sizeof(uint64_t)];
+  std::atomic<uint64_t> m_spare{NO_NODE};
+  char m_pad2[64 - sizeof(uint64_t)];
+  std::atomic<long> m_count{0};
+};
@@ -0,0 +1,18 @@
+// Diagnostic output for the renderer core
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
+#include "Log.h"
+
+void LogMessage(const std::string& message)
+{
+#ifdef _WIN32
+  OutputDebugStringA(message.c_str());
+#else
+  fputs(message.c_str(), stderr);
+#endif
+}
@@ -0,0 +1,8 @@
+// Diagnostic output for the renderer core
+
+#pragma once
+
+#include <string>
+
+// The debugger output on Windows, stderr elsewhere
+void LogMessage(const std::string& message);
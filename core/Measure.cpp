@@ -0,0 +1,506 @@
+// Low overhead timing statistics.
+//
+// Each thread owns a block of accumulators, one per id it has recorded,
+// linked into a list that GetStats walks under the registration mutex. The
+// owner updates its accumulators with relaxed loads and stores only, a
+// reader may see a record half applied but never blocks the owner. Resets
+// bump an epoch per id instead of touching other threads' memory, owners
+// clear their accumulator when they see the new epoch. Exiting threads fold
+// their accumulators into a retired set so nothing recorded is lost.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MEASURE_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "Measure.h"
+
+struct MeasureThread
+{
+  CMeasure::ThreadBlock* block = nullptr;
+
+  ~MeasureThread()
+  {
+    if (block)
+    {
+      CMeasure::Get().RetireThread(block);
+    }
+  }
+};
+
+static thread_local MeasureThread t_measure_thread;
+
+static int64_t GetSteadyTime()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CMeasure& CMeasure::Get()
+{
+  // Never destroyed, threads retire into it until the process is gone
+  static CMeasure* measure = new CMeasure();
+  return *measure;
+}
+
+CMeasure::CMeasure()
+  : m_start_ticks(ReadTicks()),
+  m_start_time(GetSteadyTime())
+{
+  m_ids[0].name = "Unregistered";
+}
+
+uint64_t CMeasure::ReadTicks()
+{
+#ifdef MEASURE_RDTSC
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(GetSteadyTime());
+#endif
+}
+
+int CMeasure::GetBucket(uint64_t value)
+{
+  if (value < SUB_BUCKETS)
+  {
+    return static_cast<int>(value);
+  }
+
+#ifdef _MSC_VER
+  unsigned long top = 0;
+#ifdef _WIN64
+  _BitScanReverse64(&top, value);
+#else
+  if (!_BitScanReverse(&top, static_cast<unsigned long>(value >> 32)))
+  {
+    _BitScanReverse(&top, static_cast<unsigned long>(value));
+  }
+  else
+  {
+    top += 32;
+  }
+#endif
+  int exponent = static_cast<int>(top);
+#else
+  int exponent = 63 - __builtin_clzll(value);
+#endif
+
+  int sub_bucket = static_cast<int>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return SUB_BUCKETS * (exponent - SUB_BUCKET_BITS + 1) + sub_bucket;
+}
+
+uint64_t CMeasure::GetBucketValue(int bucket)
+{
+  if (bucket < SUB_BUCKETS)
+  {
+    return static_cast<uint64_t>(bucket);
+  }
+
+  // The middle of the bucket
+  int shift = bucket / SUB_BUCKETS - 1;
+  uint64_t low = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return low + ((uint64_t(1) << shift) >> 1);
+}
+
+int CMeasure::Register(const char* name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  int num_ids = m_num_ids.load(std::memory_order_relaxed);
+  for (int id = 1; id < num_ids; id++)
+  {
+    if (m_ids[id].name == name)
+    {
+      return id;
+    }
+  }
+
+  if (num_ids == MAX_IDS)
+  {
+    return 0;
+  }
+
+  m_ids[num_ids].name = name;
+  m_num_ids.store(num_ids + 1, std::memory_order_release);
+  return num_ids;
+}
+
+CMeasure::Accumulator* CMeasure::GetAccumulator(int id)
+{
+  ThreadBlock* block = t_measure_thread.block;
+  if (!block)
+  {
+    block = new ThreadBlock();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    block->next = m_threads;
+    m_threads = block;
+    t_measure_thread.block = block;
+  }
+
+  Accumulator* accumulator = block->ids[id].load(std::memory_order_relaxed);
+  if (!accumulator)
+  {
+    // First use of this id on this thread
+    accumulator = new Accumulator();
+    accumulator->epoch.store(m_ids[id].epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    block->ids[id].store(accumulator, std::memory_order_release);
+  }
+
+  uint32_t epoch = m_ids[id].epoch.load(std::memory_order_relaxed);
+  if (accumulator->epoch.load(std::memory_order_relaxed) != epoch)
+  {
+    accumulator->count.store(0, std::memory_order_relaxed);
+    accumulator->sum.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& bucket : accumulator->buckets)
+    {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    accumulator->epoch.store(epoch, std::memory_order_relaxed);
+  }
+
+  return accumulator;
+}
+
+void CMeasure::Record(int id, Kind kind, int64_t value)
+{
+  Accumulator* accumulator = GetAccumulator(id);
+
+  if (m_ids[id].kind.load(std::memory_order_relaxed) != kind)
+  {
+    m_ids[id].kind.store(kind, std::memory_order_relaxed);
+  }
+
+  uint64_t count = accumulator->count.load(std::memory_order_relaxed);
+  if (count == 0 || value < accumulator->min.load(std::memory_order_relaxed))
+  {
+    accumulator->min.store(value, std::memory_order_relaxed);
+  }
+  if (count == 0 || value > accumulator->max.load(std::memory_order_relaxed))
+  {
+    accumulator->max.store(value, std::memory_order_relaxed);
+  }
+  accumulator->sum.store(accumulator->sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+  std::atomic<uint64_t>& bucket = accumulator->buckets[GetBucket(value > 0 ? static_cast<uint64_t>(value) : 0)];
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  accumulator->count.store(count + 1, std::memory_order_relaxed);
+}
+
+static inline bool IsValidId(int id, int num_ids)
+{
+  return id >= 0 && id < num_ids;
+}
+
+void CMeasure::Start(int id)
+{
+  if (!m_running.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  if (!IsValidId(id, m_num_ids.load(std::memory_order_acquire)))
+  {
+    id = 0;
+  }
+
+  GetAccumulator(id)->start = ReadTicks();
+}
+
+void CMeasure::Stop(int id)
+{
+  uint64_t ticks = ReadTicks();
+
+  if (!m_running.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  if (!IsValidId(id, m_num_ids.load(std::memory_order_acquire)))
+  {
+    id = 0;
+  }
+
+  Accumulator* accumulator = GetAccumulator(id);
+  uint64_t start = accumulator->start;
+  if (start == 0 || ticks < start)
+  {
+    // No Start on this thread, or it migrated to a core whose counter is behind
+    return;
+  }
+  accumulator->start = 0;
+
+  Record(id, KindTimed, static_cast<int64_t>(ticks - start));
+}
+
+void CMeasure::Note(int id)
+{
+  uint64_t ticks = ReadTicks();
+
+  if (!m_running.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  if (!IsValidId(id, m_num_ids.load(std::memory_order_acquire)))
+  {
+    id = 0;
+  }
+
+  Accumulator* accumulator = GetAccumulator(id);
+  uint64_t last_note = accumulator->last_note;
+  accumulator->last_note = ticks;
+
+  if (last_note != 0 && ticks >= last_note)
+  {
+    Record(id, KindTimed, static_cast<int64_t>(ticks - last_note));
+  }
+}
+
+void CMeasure::Integer(int id, int64_t value)
+{
+  if (!m_running.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  if (!IsValidId(id, m_num_ids.load(std::memory_order_acquire)))
+  {
+    id = 0;
+  }
+
+  Record(id, KindValue, value);
+}
+
+void CMeasure::Reset(int id)
+{
+  if (IsValidId(id, m_num_ids.load(std::memory_order_acquire)))
+  {
+    m_ids[id].epoch.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void CMeasure::ResetAll()
+{
+  int num_ids = m_num_ids.load(std::memory_order_acquire);
+  for (int id = 0; id < num_ids; id++)
+  {
+    m_ids[id].epoch.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void CMeasure::SetRunning(bool running)
+{
+  m_running = running;
+}
+
+void CMeasure::RetireThread(ThreadBlock* block)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for (ThreadBlock** link = &m_threads; *link; link = &(*link)->next)
+  {
+    if (*link == block)
+    {
+      *link = block->next;
+      break;
+    }
+  }
+
+  for (int id = 0; id < MAX_IDS; id++)
+  {
+    Accumulator* accumulator = block->ids[id].load(std::memory_order_relaxed);
+    if (!accumulator)
+    {
+      continue;
+    }
+
+    uint32_t epoch = m_ids[id].epoch.load(std::memory_order_relaxed);
+    uint64_t count = accumulator->count.load(std::memory_order_relaxed);
+    if (accumulator->epoch.load(std::memory_order_relaxed) == epoch && count > 0)
+    {
+      Accumulator*& retired = m_retired[id];
+      if (!retired)
+      {
+        retired = new Accumulator();
+      }
+      if (retired->epoch.load(std::memory_order_relaxed) != epoch)
+      {
+        retired->count.store(0, std::memory_order_relaxed);
+        retired->sum.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& bucket : retired->buckets)
+        {
+          bucket.store(0, std::memory_order_relaxed);
+        }
+        retired->epoch.store(epoch, std::memory_order_relaxed);
+      }
+
+      uint64_t retired_count = retired->count.load(std::memory_order_relaxed);
+      int64_t min = accumulator->min.load(std::memory_order_relaxed);
+      int64_t max = accumulator->max.load(std::memory_order_relaxed);
+      if (retired_count == 0 || min < retired->min.load(std::memory_order_relaxed))
+      {
+        retired->min.store(min, std::memory_order_relaxed);
+      }
+      if (retired_count == 0 || max > retired->max.load(std::memory_order_relaxed))
+      {
+        retired->max.store(max, std::memory_order_relaxed);
+      }
+      retired->sum.fetch_add(accumulator->sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      for (int i = 0; i < BUCKETS; i++)
+      {
+        retired->buckets[i].fetch_add(accumulator->buckets[i].load(std::memory_order_relaxed),
+          std::memory_order_relaxed);
+      }
+      retired->count.store(retired_count + count, std::memory_order_relaxed);
+    }
+
+    delete accumulator;
+  }
+
+  delete block;
+}
+
+double CMeasure::GetTicksPerMicrosecond()
+{
+#ifdef MEASURE_RDTSC
+  // Calibrate the counter against the steady clock over the process
+  // lifetime, at least 20 ms of it
+  int64_t elapsed = GetSteadyTime() - m_start_time;
+  if (elapsed < 20000000)
+  {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(20000000 - elapsed));
+  }
+
+  int64_t time = GetSteadyTime();
+  uint64_t ticks = ReadTicks();
+  return static_cast<double>(ticks - m_start_ticks) * 1000.0 / static_cast<double>(time - m_start_time);
+#else
+  return 1000.0;
+#endif
+}
+
+std::vector<MeasureStats> CMeasure::GetStats()
+{
+  double ticks_per_us = GetTicksPerMicrosecond();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::vector<MeasureStats> result;
+  std::vector<uint64_t> buckets(BUCKETS);
+
+  int num_ids = m_num_ids.load(std::memory_order_acquire);
+  for (int id = 0; id < num_ids; id++)
+  {
+    uint32_t epoch = m_ids[id].epoch.load(std::memory_order_relaxed);
+    uint64_t count = 0;
+    int64_t sum = 0;
+    int64_t min = 0;
+    int64_t max = 0;
+    std::fill(buckets.begin(), buckets.end(), 0);
+
+    auto merge = [&](const Accumulator* accumulator)
+    {
+      if (!accumulator || accumulator->epoch.load(std::memory_order_relaxed) != epoch)
+      {
+        return;
+      }
+      uint64_t accumulator_count = accumulator->count.load(std::memory_order_relaxed);
+      if (accumulator_count == 0)
+      {
+        return;
+      }
+
+      int64_t accumulator_min = accumulator->min.load(std::memory_order_relaxed);
+      int64_t accumulator_max = accumulator->max.load(std::memory_order_relaxed);
+      min = count == 0 ? accumulator_min : std::min(min, accumulator_min);
+      max = count == 0 ? accumulator_max : std::max(max, accumulator_max);
+      count += accumulator_count;
+      sum += accumulator->sum.load(std::memory_order_relaxed);
+      for (int i = 0; i < BUCKETS; i++)
+      {
+        buckets[i] += accumulator->buckets[i].load(std::memory_order_relaxed);
+      }
+    };
+
+    for (ThreadBlock* block = m_threads; block; block = block->next)
+    {
+      merge(block->ids[id].load(std::memory_order_acquire));
+    }
+    merge(m_retired[id]);
+
+    if (count == 0)
+    {
+      continue;
+    }
+
+    MeasureStats stats;
+    stats.name = m_ids[id].name;
+    stats.timed = m_ids[id].kind.load(std::memory_order_relaxed) == KindTimed;
+    stats.count = count;
+
+    double scale = stats.timed ? 1.0 / ticks_per_us : 1.0;
+    stats.mean = static_cast<double>(sum) / static_cast<double>(count) * scale;
+    stats.min = static_cast<double>(min) * scale;
+    stats.max = static_cast<double>(max) * scale;
+
+    // The buckets may hold a few more or less records than count while
+    // other threads are recording
+    uint64_t total = 0;
+    for (uint64_t bucket : buckets)
+    {
+      total += bucket;
+    }
+
+    auto percentile = [&](double fraction)
+    {
+      uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total));
+      uint64_t seen = 0;
+      for (int i = 0; i < BUCKETS; i++)
+      {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+          double value = static_cast<double>(GetBucketValue(i));
+          return std::min(std::max(value, static_cast<double>(min)), static_cast<double>(max)) * scale;
+        }
+      }
+      return static_cast<double>(max) * scale;
+    };
+
+    stats.p50 = percentile(0.5);
+    stats.p90 = percentile(0.9);
+    stats.p99 = percentile(0.99);
+    stats.p999 = percentile(0.999);
+
+    result.push_back(stats);
+  }
+
+  return result;
+}
+
+std::string CMeasure::DumpStats()
+{
+  std::string text;
+  char line[512];
+
+  std::snprintf(line, sizeof(line), "%-48s %10s %11s %11s %11s %11s %11s %11s %11s\n",
+    "Incident", "Count", "Mean", "Min", "p50", "p90", "p99", "p99.9", "Max");
+  text += line;
+
+  for (const MeasureStats& stats : GetStats())
+  {
+    std::string name = stats.timed ? stats.name + " (us)" : stats.name;
+    std::snprintf(line, sizeof(line), "%-48s %10llu %11.3f %11.3f %11.3f %11.3f %11.3f %11.3f %11.3f\n",
+      name.c_str(), static_cast<unsigned long long>(stats.count), stats.mean, stats.min,
+      stats.p50, stats.p90, stats.p99, stats.p999, stats.max);
+    text += line;
+  }
+
+  return text;
+}
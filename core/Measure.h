@@ -0,0 +1,150 @@
+// Low overhead timing statistics, the backend of the MSR_* macros in
+// measure.h. Code registers named incidents once and then times them with
+// Start/Stop, the interval between Notes, or records integer values. Each
+// thread accumulates into its own log-bucketed histograms with plain loads
+// and stores, no locks and no allocation after the first use of an id, so
+// it is cheap enough to leave on in release builds. GetStats merges the
+// threads into counts, means and percentiles.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct MeasureStats
+{
+  std::string name;
+  bool timed;           // durations in microseconds, otherwise recorded values
+  uint64_t count;
+  double mean;
+  double min;
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+  double max;
+};
+
+class CMeasure
+{
+public:
+  // The process wide statistics
+  static CMeasure& Get();
+
+  CMeasure();
+
+  // Registering a name again returns the same id. Id 0 collects the
+  // unregistered incidents and everything past the last free id.
+  int Register(const char* name);
+
+  // Time from Start to Stop on the same thread
+  void Start(int id);
+  void Stop(int id);
+  // Time since the previous Note of id on the same thread
+  void Note(int id);
+  void Integer(int id, int64_t value);
+
+  // Clears the statistics of an id, or all of them. Threads pick the reset
+  // up at their next record.
+  void Reset(int id);
+  void ResetAll();
+  // Paused ids record nothing
+  void SetRunning(bool running);
+
+  // Every id recorded at least once, in registration order
+  std::vector<MeasureStats> GetStats();
+  // The same as a text table, one line per id
+  std::string DumpStats();
+
+private:
+  static const int MAX_IDS = 128;
+  // Eight sub-buckets per power of two, values below eight are exact.
+  // Percentiles are within 12.5% of the recorded values.
+  static const int SUB_BUCKET_BITS = 3;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int BUCKETS = SUB_BUCKETS * (64 - SUB_BUCKET_BITS + 1);
+
+  enum Kind : uint8_t
+  {
+    KindNone,
+    KindTimed,
+    KindValue,
+  };
+
+  // One id on one thread. Only the owning thread writes, GetStats reads the
+  // atomics without stopping it.
+  struct Accumulator
+  {
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<int64_t> sum{0};
+    std::atomic<int64_t> min{0};
+    std::atomic<int64_t> max{0};
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+    uint64_t start = 0;
+    uint64_t last_note = 0;
+  };
+
+  struct ThreadBlock
+  {
+    std::atomic<Accumulator*> ids[MAX_IDS] = {};
+    ThreadBlock* next = nullptr;
+  };
+
+  struct Id
+  {
+    std::string name;
+    std::atomic<uint8_t> kind{KindNone};
+    std::atomic<uint32_t> epoch{0};
+  };
+
+  friend struct MeasureThread;
+
+  static uint64_t ReadTicks();
+  static int GetBucket(uint64_t value);
+  static uint64_t GetBucketValue(int bucket);
+
+  Accumulator* GetAccumulator(int id);
+  void Record(int id, Kind kind, int64_t value);
+  void RetireThread(ThreadBlock* block);
+  double GetTicksPerMicrosecond();
+
+  std::atomic<bool> m_running{true};
+  std::atomic<int> m_num_ids{1};
+  Id m_ids[MAX_IDS];
+
+  // Guards registration and the thread list, never taken while recording
+  std::mutex m_mutex;
+  ThreadBlock* m_threads = nullptr;
+  // What exited threads recorded
+  Accumulator* m_retired[MAX_IDS] = {};
+
+  uint64_t m_start_ticks;
+  int64_t m_start_time;
+};
+
+// Times the enclosing scope
+class CMeasureScope
+{
+public:
+  explicit CMeasureScope(int id)
+    : m_id(id)
+  {
+    CMeasure::Get().Start(m_id);
+  }
+
+  ~CMeasureScope()
+  {
+    CMeasure::Get().Stop(m_id);
+  }
+
+  CMeasureScope(const CMeasureScope&) = delete;
+  CMeasureScope& operator=(const CMeasureScope&) = delete;
+
+private:
+  int m_id;
+};
@@ -0,0 +1,403 @@
+// Queues the samples received from upstream and hands them to the output
+// backend in buffer sized chunks, switching formats exactly where the
+// stream changed them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "AllocationAudit.h"
+#include "EventTrace.h"
+#include "Mixer.h"
+
+//
+// Destructor
+//
+CMixer::~CMixer()
+{
+  // Ensure we stop streaming and release any waiting threads
+
+  StopStreaming();
+} // (Destructor)
+
+void CMixer::SetOutput(IAudioOutput* output)
+{
+  m_output = output;
+}
+
+  //
+  // StartStreaming
+  //
+  // This is called when we start running state
+  //
+void CMixer::StartStreaming()
+{
+  m_bStreaming = true;
+  TraceRecord(TraceStreaming, 1);
+} // StartStreaming
+
+  //
+  // StopStreaming
+  //
+  // This is called when we stop streaming. Wakes a Receive waiting for the
+  // output, which would otherwise never ask for more.
+  //
+void CMixer::StopStreaming()
+{
+  if (m_bStreaming == false)
+  {
+    return;
+  }
+
+  m_bStreaming = false;
+  TraceRecord(TraceStreaming, 0);
+  m_request_samples_cv.notify_all();
+  m_samples_ready_cv.notify_all();
+} // StopStreaming
+
+bool CMixer::IsStreaming()
+{
+  return m_bStreaming;
+}
+
+//
+// CopyWaveform
+//
+// Queue whole frames of the received data and wait until the output thread
+// asks for more.
+//
+void CMixer::CopyWaveform(const void* data, size_t length)
+{
+  if (QueueWaveform(data, length))
+  {
+    WaitForRequest();
+  }
+} // CopyWaveform
+
+// Whole frames only, false while no format is set
+bool CMixer::QueueWaveform(const void* data, size_t length)
+{
+  size_t frame_size = m_input_frame_size;
+  if (frame_size == 0)
+  {
+    return false;
+  }
+
+  length -= length % frame_size;
+
+  m_sample_queue.Push(data, length);
+  m_bytes_pushed += length;
+  return true;
+} // QueueWaveform
+
+// Wake the output and block until it asks for more
+void CMixer::WaitForRequest()
+{
+  m_samples_ready = true;
+  m_samples_ready_cv.notify_one();
+
+  {
+    std::unique_lock<std::mutex> lk_rs(m_request_samples_mutex);
+    while (m_request_samples == false && m_bStreaming)
+    {
+      // Wait for only 500 ms, just in case
+      m_request_samples_cv.wait_for(lk_rs, std::chrono::milliseconds(500));
+    }
+
+    // We already delivered them, set it back to false
+    m_request_samples = false;
+  }
+} // WaitForRequest
+
+//
+// Receive
+//
+// Called when the input pin receives another sample.
+//
+bool CMixer::Receive(const void* data, size_t length)
+{
+  // Including the wait for the receive lock
+  CMeasureScope measure(m_measure_receive);
+  CHotPathScope audit("Receive");
+  std::lock_guard<std::mutex> lock(m_receive_mutex);
+
+  // Ignore zero-length samples
+  if (data == nullptr || length == 0)
+    return true;
+
+  if (m_bStreaming == true)
+  {
+    TraceNameThread("Receive");
+    TraceRecord(TraceReceiveBegin, length);
+    CopyWaveform(data, length);
+    TraceRecord(TraceReceiveEnd, m_sample_queue.Size());
+  }
+
+  return true;
+} // Receive
+
+//
+// ReceiveMultiple
+//
+// Called when the input pin receives a batch of samples. Queues them all
+// under one receive lock, then wakes the output once.
+//
+bool CMixer::ReceiveMultiple(const AudioBlock* blocks, size_t count)
+{
+  CMeasureScope measure(m_measure_receive);
+  CHotPathScope audit("Receive");
+  std::lock_guard<std::mutex> lock(m_receive_mutex);
+
+  if (m_bStreaming == true)
+  {
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+      length += blocks[i].length;
+    }
+
+    TraceNameThread("Receive");
+    TraceRecord(TraceReceiveBegin, length);
+    bool queued = false;
+    for (size_t i = 0; i < count; i++)
+    {
+      // Ignore zero-length samples
+      if (blocks[i].data != nullptr && blocks[i].length != 0)
+      {
+        queued = QueueWaveform(blocks[i].data, blocks[i].length) || queued;
+      }
+    }
+    if (queued)
+    {
+      WaitForRequest();
+    }
+    TraceRecord(TraceReceiveEnd, m_sample_queue.Size());
+  }
+
+  return true;
+} // ReceiveMultiple
+
+bool CMixer::WaitForFrames()
+{
+  if (m_bStreaming)
+  {
+    std::unique_lock<std::mutex> lk(m_samples_ready_mutex);
+    while (!m_samples_ready)
+    {
+      if (!m_bStreaming)
+      {
+        return false;
+      }
+
+      // Re-check everything after 30 ms
+      m_samples_ready_cv.wait_for(lk, std::chrono::milliseconds(30));
+    }
+
+    // We already received them
+    m_samples_ready = false;
+
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+//
+// SetFormat
+//
+// Called from the receiving thread with a new media type. The format is
+// handed to the output by Mix once all bytes received before it have been
+// mixed, so the queued data of the old format is not lost.
+//
+void CMixer::SetFormat(const AudioFormat& format)
+{
+  // Buffers grow to the new format's sizes
+  RestartHotPathWarmup();
+
+  std::lock_guard<std::mutex> lock(m_pending_formats_mutex);
+
+  m_input_frame_size = GetFrameSize(format.speaker_layout, format.bitness);
+  m_pending_formats.push_back({ m_bytes_pushed, format });
+}
+
+bool CMixer::ApplyPendingFormat()
+{
+  std::lock_guard<std::mutex> lock(m_pending_formats_mutex);
+
+  bool applied = false;
+  while (!m_pending_formats.empty() && m_pending_formats.front().position <= m_bytes_popped)
+  {
+    const PendingFormat& pending = m_pending_formats.front();
+    m_output_channels = GetChannelCount(pending.format.speaker_layout);
+    m_output_bitness = pending.format.bitness;
+
+    if (m_output->getDeviceFormatMode())
+    {
+      // The device keeps its format, only the conversion changes
+      m_converter.SetFormats(pending.format, m_output->getDeviceFormat());
+    }
+    else
+    {
+      m_output->setFormat(pending.format);
+    }
+    m_pending_formats.pop_front();
+    applied = true;
+  }
+
+  return applied;
+}
+
+size_t CMixer::BytesUntilFormatChange()
+{
+  std::lock_guard<std::mutex> lock(m_pending_formats_mutex);
+
+  if (m_pending_formats.empty() || m_pending_formats.front().position <= m_bytes_popped)
+  {
+    return m_pending_formats.empty() ? SIZE_MAX : 0;
+  }
+
+  return static_cast<size_t>(m_pending_formats.front().position - m_bytes_popped);
+}
+
+//
+// Flush
+//
+// Drop everything queued. Pending format changes now apply right away.
+//
+void CMixer::Flush()
+{
+  std::lock_guard<std::mutex> lock(m_pending_formats_mutex);
+
+  // The output thread may pop while we clear, only take back what was
+  // actually dropped so the counters stay in step with the queue
+  size_t discarded = m_sample_queue.Clear();
+  TraceRecord(TraceFlush, discarded);
+  m_bytes_pushed -= discarded;
+
+  for (PendingFormat& pending : m_pending_formats)
+  {
+    pending.position = m_bytes_pushed;
+  }
+}
+
+size_t CMixer::Mix(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample)
+{
+  if (!samples || !m_output)
+    return 0;
+
+  TraceRecord(TraceMixBegin, num_frames);
+  CMeasure::Get().Start(m_measure_mix);
+  size_t frames = MixFrames(samples, num_frames, num_bytes_per_sample);
+  CMeasure::Get().Stop(m_measure_mix);
+  TraceRecord(TraceMixEnd, frames);
+
+  return frames;
+}
+
+size_t CMixer::MixFrames(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample)
+{
+  // Switch formats exactly where the new media type was received. Unless we
+  // convert to a fixed device format, no frames are returned so the caller
+  // re-reads the stream format before mixing.
+  bool format_changed = ApplyPendingFormat();
+  bool device_format_mode = m_output->getDeviceFormatMode();
+  if (format_changed && !device_format_mode)
+  {
+    return 0;
+  }
+
+  if (m_output_channels == 0)
+  {
+    // No format received yet, wait for data rather than have the output
+    // thread spin on us
+    WaitForFrames();
+    return 0;
+  }
+
+  if (device_format_mode)
+  {
+    size_t input_frame_size = m_converter.GetInputFrameSize();
+    size_t input_frames = ReadFrames(&m_converter_input,
+      m_converter.InputFramesNeeded(num_frames), input_frame_size);
+
+    samples->resize(num_frames * m_converter.GetOutputFrameSize());
+    return m_converter.Convert(m_converter_input.data(), input_frames, samples->data(), num_frames);
+  }
+
+  // 2 = stereo
+  // 6 = 5.1
+  return ReadFrames(samples, num_frames, m_output_channels * num_bytes_per_sample);
+}
+
+uint64_t CMixer::GetBytesMixed()
+{
+  return m_bytes_popped;
+}
+
+//
+// ReadFrames
+//
+// Wait for and pop up to num_frames frames of the format at the head of the
+// queue, stopping at the next format change. Returns the frames read.
+//
+size_t CMixer::ReadFrames(std::vector<int8_t>* samples, size_t num_frames, size_t frame_size)
+{
+  if (frame_size == 0)
+  {
+    return 0;
+  }
+
+  m_desired_bytes = num_frames * frame_size;
+
+  // Never mix across a format change
+  size_t bytes_until_change = BytesUntilFormatChange();
+  if (bytes_until_change < m_desired_bytes)
+  {
+    m_desired_bytes = bytes_until_change - bytes_until_change % frame_size;
+  }
+
+  // Wait for queue to fill
+  while (m_sample_queue.Size() < m_desired_bytes) //&& m_notEOS)
+  {
+    // A format change arrived while waiting, all data before it is queued
+    bytes_until_change = BytesUntilFormatChange();
+    if (bytes_until_change < m_desired_bytes)
+    {
+      m_desired_bytes = bytes_until_change - bytes_until_change % frame_size;
+      continue;
+    }
+
+    m_request_samples = true;
+    m_request_samples_cv.notify_one();
+
+    if (!WaitForFrames())
+    {
+      break;
+    }
+  }
+
+  if (m_desired_bytes == 0)
+  {
+    // Drop a trailing partial frame of the old format, if any
+    if (bytes_until_change < frame_size)
+    {
+      m_bytes_popped += m_sample_queue.Discard(bytes_until_change);
+    }
+
+    return 0;
+  }
+
+  samples->resize(m_desired_bytes);
+
+  // Stopped while waiting, pad what is missing with silence. Unsigned 8 bit
+  // is centered on 0x80, every other format on 0.
+  size_t popped = m_sample_queue.Pop(samples->data(), m_desired_bytes);
+  int8_t silence = m_output_bitness == MediaBitness::bit8 ? static_cast<int8_t>(0x80) : 0;
+  std::fill(samples->begin() + popped, samples->end(), silence);
+  m_bytes_popped += popped;
+
+  // Set EOS samples here
+  return m_desired_bytes / frame_size;
+}
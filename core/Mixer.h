@@ -0,0 +1,96 @@
+// Queues the samples received from upstream and hands them to the output
+// backend in buffer sized chunks, switching formats exactly where the
+// stream changed them.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "AudioConverter.h"
+#include "AudioInterfaces.h"
+#include "Measure.h"
+#include "SampleQueue.h"
+
+class CMixer final : public IAudioSink, public IAudioSource
+{
+public:
+
+  CMixer() = default;
+  ~CMixer();
+
+  // The backend the received formats are applied to
+  void SetOutput(IAudioOutput* output);
+
+  void StartStreaming();
+  void StopStreaming();
+  bool IsStreaming() override;
+
+  // Called when the input pin receives a sample
+  bool Receive(const void* data, size_t length) override;
+  bool ReceiveMultiple(const AudioBlock* blocks, size_t count) override;
+  void SetFormat(const AudioFormat& format) override;
+  void Flush() override;
+
+  size_t Mix(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample) override;
+
+  // Received bytes taken from the queue so far
+  uint64_t GetBytesMixed();
+
+private:
+
+  void CopyWaveform(const void* data, size_t length);
+  bool QueueWaveform(const void* data, size_t length);
+  void WaitForRequest();
+  bool WaitForFrames();
+
+  IAudioOutput* m_output = nullptr;
+  std::mutex m_receive_mutex;
+
+  int m_measure_receive = CMeasure::Get().Register("CMixer::Receive");
+  int m_measure_mix = CMeasure::Get().Register("CMixer::Mix");
+
+  std::atomic<bool> m_bStreaming = false; // Are we currently streaming
+
+  std::atomic<size_t> m_input_frame_size = 0; // frame size of the data being received
+  size_t m_desired_bytes = 0;
+
+  CSampleQueue m_sample_queue;
+  std::atomic<uint64_t> m_bytes_pushed = 0;
+  std::atomic<uint64_t> m_bytes_popped = 0;
+
+  // Format changes that take effect once the queue has been drained up to
+  // the byte position they were received at. Lets the data of the previous
+  // format play out instead of being dropped.
+  struct PendingFormat
+  {
+    uint64_t position;
+    AudioFormat format;
+  };
+  std::deque<PendingFormat> m_pending_formats;
+  std::mutex m_pending_formats_mutex;
+  size_t m_output_channels = 0;   // channels of the data at the queue head
+  MediaBitness m_output_bitness = MediaBitness::bit16;  // and its sample format
+
+  bool ApplyPendingFormat();
+  size_t BytesUntilFormatChange();
+  size_t MixFrames(std::vector<int8_t>* samples, size_t num_frames, size_t num_bytes_per_sample);
+  size_t ReadFrames(std::vector<int8_t>* samples, size_t num_frames, size_t frame_size);
+
+  // Device format mode, converts the queued data to the device format
+  CAudioConverter m_converter;
+  std::vector<int8_t> m_converter_input;
+
+  // Locking between inbound samples and the mixer
+  std::atomic<bool> m_samples_ready = false;
+  std::mutex m_samples_ready_mutex;
+  std::condition_variable m_samples_ready_cv;
+
+  std::atomic<bool> m_request_samples = false;
+  std::mutex m_request_samples_mutex;
+  std::condition_variable m_request_samples_cv;
+}; // CMixer
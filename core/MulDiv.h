@@ -0,0 +1,103 @@
+// (a * b + d) / c with a 128 bit intermediate, the arithmetic behind the
+// base classes' llMulDiv and Int64x32Div32. One hardware multiply and one
+// hardware divide where the compiler offers them, unsigned __int128 or
+// inline divq with GCC and Clang, _umul128 and _udiv128 with MSVC on x64.
+// MULDIV_HAS_128 is defined when they are available.
+//
+// Results round as the base classes always have: the magnitude of a * b + d
+// is divided and truncated, then the sign applied. A quotient that does not
+// fit 64 bits, and c == 0, saturate to INT64_MAX or INT64_MIN by sign.
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64) && _MSC_VER >= 1920
+#include <intrin.h>
+#include <immintrin.h>
+#define MULDIV_HAS_128
+#elif defined(__SIZEOF_INT128__)
+#define MULDIV_HAS_128
+#endif
+
+#ifdef MULDIV_HAS_128
+
+namespace muldiv
+{
+// |value| as unsigned, also for INT64_MIN
+inline uint64_t Magnitude(int64_t value)
+{
+  return value >= 0 ? static_cast<uint64_t>(value) : 0 - static_cast<uint64_t>(value);
+}
+
+inline uint64_t Multiply(uint64_t a, uint64_t b, uint64_t* high)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  return _umul128(a, b, high);
+#else
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  *high = static_cast<uint64_t>(product >> 64);
+  return static_cast<uint64_t>(product);
+#endif
+}
+
+// high must be below divisor, so the quotient fits 64 bits
+inline uint64_t Divide(uint64_t high, uint64_t low, uint64_t divisor)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  uint64_t remainder;
+  return _udiv128(high, low, divisor, &remainder);
+#elif defined(__x86_64__)
+  // A single divq, unsigned __int128 division goes through a library call
+  uint64_t quotient;
+  uint64_t remainder;
+  __asm__("divq %4" : "=a"(quotient), "=d"(remainder) : "a"(low), "d"(high), "rm"(divisor));
+  return quotient;
+#else
+  return static_cast<uint64_t>(((static_cast<unsigned __int128>(high) << 64) | low) / divisor);
+#endif
+}
+}
+
+inline int64_t MulDiv128(int64_t a, int64_t b, int64_t c, int64_t d)
+{
+  bool negative = (a < 0) != (b < 0);
+
+  uint64_t high;
+  uint64_t low = muldiv::Multiply(muldiv::Magnitude(a), muldiv::Magnitude(b), &high);
+
+  if (d != 0)
+  {
+    // Added to the magnitude, so subtracted from that of a negative
+    // product, as a sign extended 128 bit value
+    uint64_t addend = negative ? 0 - static_cast<uint64_t>(d) : static_cast<uint64_t>(d);
+    uint64_t addend_high = (negative ? d > 0 : d < 0) ? UINT64_MAX : 0;
+    low += addend;
+    high += addend_high + (low < addend ? 1 : 0);
+
+    // d changed the sign
+    if (high >> 63)
+    {
+      negative = !negative;
+      low = ~low + 1;
+      high = ~high + (low == 0 ? 1 : 0);
+    }
+  }
+
+  if (c < 0)
+  {
+    negative = !negative;
+  }
+
+  // Catches c == 0 and overflow
+  uint64_t divisor = muldiv::Magnitude(c);
+  if (divisor <= high)
+  {
+    return negative ? INT64_MIN : INT64_MAX;
+  }
+
+  uint64_t quotient = muldiv::Divide(high, low, divisor);
+  return static_cast<int64_t>(negative ? 0 - quotient : quotient);
+}
+
+#endif
@@ -0,0 +1,193 @@
+// Output backend that plays into nothing.
+
+#include "AllocationAudit.h"
+#include "EventTrace.h"
+#include "NullOutput.h"
+
+CNullOutput::CNullOutput(IAudioSource* source)
+  : m_source(source)
+{
+}
+
+CNullOutput::~CNullOutput()
+{
+  CloseDevice();
+}
+
+bool CNullOutput::OpenDevice()
+{
+  return true;
+}
+
+void CNullOutput::CloseDevice()
+{
+  StopDevice();
+}
+
+bool CNullOutput::StartDevice()
+{
+  if (m_run_thread)
+  {
+    return true;
+  }
+
+  m_run_thread = true;
+  m_thread = std::thread(&CNullOutput::SoundLoop, this);
+  return true;
+}
+
+void CNullOutput::StopDevice()
+{
+  m_run_thread = false;
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+  }
+}
+
+bool CNullOutput::isFormatSupported(const AudioFormat& format)
+{
+  if (format.frequency == 0 || IsAmbisonic(format.speaker_layout))
+  {
+    return false;
+  }
+
+  if (format.bitness == bit24 || format.bitness == bit32)
+  {
+    return m_device_format_mode;
+  }
+
+  return true;
+}
+
+void CNullOutput::setFormat(const AudioFormat& format)
+{
+  // Only read by the sound loop, which is the thread the mixer calls us on
+  m_format = format;
+}
+
+AudioFormat CNullOutput::getFormat()
+{
+  return m_format;
+}
+
+void CNullOutput::setDeviceFormatMode(bool enabled)
+{
+  m_device_format_mode = enabled;
+}
+
+bool CNullOutput::getDeviceFormatMode()
+{
+  return m_device_format_mode;
+}
+
+void CNullOutput::setDeviceFormat(const AudioFormat& format)
+{
+  m_device_format = format;
+}
+
+AudioFormat CNullOutput::getDeviceFormat()
+{
+  return m_device_format;
+}
+
+void CNullOutput::setBufferDuration(uint32_t milliseconds)
+{
+  m_buffer_duration = milliseconds;
+}
+
+void CNullOutput::setSubmitCallback(SubmitCallback callback)
+{
+  m_submit_callback = std::move(callback);
+}
+
+void CNullOutput::setRealtime(bool enabled, uint32_t buffers)
+{
+  m_realtime = enabled;
+  m_realtime_buffers = buffers;
+}
+
+uint64_t CNullOutput::getFramesSubmitted()
+{
+  return m_frames_submitted;
+}
+
+uint64_t CNullOutput::getUnderruns()
+{
+  return m_underruns;
+}
+
+//
+// WaitForBuffer
+//
+// In realtime, wait until one of the queued buffers has played
+//
+void CNullOutput::WaitForBuffer()
+{
+  if (!m_realtime || m_frames_submitted == 0)
+  {
+    return;
+  }
+
+  auto free_at = m_queue_end - std::chrono::milliseconds(m_buffer_duration * (m_realtime_buffers - 1));
+  std::this_thread::sleep_until(free_at);
+}
+
+void CNullOutput::Play(size_t frames, uint32_t frequency)
+{
+  if (!m_realtime)
+  {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (m_queue_end < now)
+  {
+    // Nothing left to play, the device would have output silence
+    if (m_frames_submitted != 0)
+    {
+      m_underruns++;
+      TraceRecord(TraceUnderrun, 0);
+    }
+    m_queue_end = now;
+  }
+
+  m_queue_end += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(static_cast<double>(frames) / frequency));
+}
+
+void CNullOutput::SoundLoop()
+{
+  TraceNameThread("SoundLoop");
+
+  while (m_run_thread)
+  {
+    CHotPathScope audit("SoundLoop");
+
+    if (!m_source->IsStreaming())
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    // Re-read on every buffer, Mix applies format changes through setFormat
+    AudioFormat format = m_device_format_mode ? m_device_format : m_format;
+    size_t frames = format.frequency * m_buffer_duration / 1000;
+
+    WaitForBuffer();
+
+    size_t mixed = m_source->Mix(&m_buffer, frames, GetSampleSize(format.bitness));
+    if (mixed == 0)
+    {
+      continue;
+    }
+
+    Play(mixed, format.frequency);
+    m_frames_submitted += mixed;
+    TraceRecord(TraceBufferQueued, mixed, 0);
+    if (m_submit_callback)
+    {
+      m_submit_callback(mixed);
+    }
+  }
+}
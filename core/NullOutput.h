@@ -0,0 +1,74 @@
+// Output backend that plays into nothing. Pulls buffers from the mixer as
+// soon as it can produce them, so the data path can be measured without a
+// sound card or OpenAL.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "AudioInterfaces.h"
+
+class CNullOutput final : public IAudioOutput
+{
+public:
+  explicit CNullOutput(IAudioSource* source);
+  ~CNullOutput();
+
+  bool OpenDevice() override;
+  void CloseDevice() override;
+  bool StartDevice() override;
+  void StopDevice() override;
+
+  // Accepts what OpenAL Soft plays natively: speaker layouts up to 7.1 in
+  // 8-bit, 16-bit and float. Device format mode adds 24-bit and 32-bit.
+  bool isFormatSupported(const AudioFormat& format) override;
+  void setFormat(const AudioFormat& format) override;
+  AudioFormat getFormat() override;
+
+  void setDeviceFormatMode(bool enabled);
+  bool getDeviceFormatMode() override;
+  void setDeviceFormat(const AudioFormat& format);
+  AudioFormat getDeviceFormat() override;
+
+  // Length of one buffer, in milliseconds
+  void setBufferDuration(uint32_t milliseconds);
+
+  // Play at the stream rate like a sound card with the given number of
+  // buffers, rather than taking buffers as fast as they come
+  void setRealtime(bool enabled, uint32_t buffers);
+
+  // Times the buffer queue ran dry while streaming, realtime only
+  uint64_t getUnderruns();
+
+  // Set before StartDevice, called after each buffer is mixed
+  void setSubmitCallback(SubmitCallback callback);
+
+  uint64_t getFramesSubmitted();
+
+private:
+  void SoundLoop();
+  void WaitForBuffer();
+  void Play(size_t frames, uint32_t frequency);
+
+  IAudioSource* m_source;
+  std::thread m_thread;
+  std::atomic<bool> m_run_thread = false;
+
+  std::vector<int8_t> m_buffer;
+  SubmitCallback m_submit_callback;
+  std::atomic<uint64_t> m_frames_submitted = 0;
+
+  AudioFormat m_format = { 48000, Stereo, bit16 };
+  AudioFormat m_device_format = { 48000, Stereo, bitfloat };
+  std::atomic<bool> m_device_format_mode = false;
+  uint32_t m_buffer_duration = 8;
+
+  // Realtime playback, the time the queued frames finish playing
+  bool m_realtime = false;
+  uint32_t m_realtime_buffers = 8;
+  std::chrono::steady_clock::time_point m_queue_end;
+  std::atomic<uint64_t> m_underruns = 0;
+};
@@ -0,0 +1,80 @@
+// OpenAL is loaded at runtime so the renderer has no link time dependency on
+// a particular implementation.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "OpenALLibrary.h"
+
+#ifdef _WIN32
+typedef HMODULE LibraryHandle;
+#else
+typedef void* LibraryHandle;
+#endif
+
+static LibraryHandle s_openal_library = nullptr;
+
+#define OPENAL_FUNC_DEFINE(func)                                                                   \
+  func##_t p##func = nullptr;
+
+OPENAL_API_VISIT(OPENAL_FUNC_DEFINE)
+
+static void* GetLibrarySymbol(const char* name)
+{
+#ifdef _WIN32
+  return reinterpret_cast<void*>(::GetProcAddress(s_openal_library, name));
+#else
+  return dlsym(s_openal_library, name);
+#endif
+}
+
+static void CloseLibrary()
+{
+#ifdef _WIN32
+  ::FreeLibrary(s_openal_library);
+#else
+  dlclose(s_openal_library);
+#endif
+  s_openal_library = nullptr;
+}
+
+// Attempt to load the function from the opened library.
+#define OPENAL_FUNC_LOAD(func)                                                                     \
+  p##func = reinterpret_cast<func##_t>(GetLibrarySymbol(#func));                                   \
+  if (!p##func)                                                                                    \
+  {                                                                                                \
+    return false;                                                                                  \
+  }
+
+static bool InitFunctions()
+{
+  OPENAL_API_VISIT(OPENAL_FUNC_LOAD);
+  return true;
+}
+
+bool InitOpenALLibrary()
+{
+  if (s_openal_library)
+    return true;
+
+#ifdef _WIN32
+  s_openal_library = ::LoadLibrary(TEXT("openal32.dll"));
+#else
+  s_openal_library = dlopen("libopenal.so.1", RTLD_NOW | RTLD_LOCAL);
+  if (!s_openal_library)
+    s_openal_library = dlopen("libopenal.so", RTLD_NOW | RTLD_LOCAL);
+#endif
+  if (!s_openal_library)
+    return false;
+
+  if (!InitFunctions())
+  {
+    CloseLibrary();
+    return false;
+  }
+
+  return true;
+}
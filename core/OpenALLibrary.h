@@ -0,0 +1,52 @@
+// OpenAL is loaded at runtime so the renderer has no link time dependency on
+// a particular implementation. Every function used is reached through a
+// p-prefixed pointer, palBufferData for alBufferData and so on.
+
+#pragma once
+
+#include <include/OpenAL/al.h>
+#include <include/OpenAL/alc.h>
+
+#define OPENAL_API_VISIT(X)                                                                        \
+  X(alBufferData)                                                                                  \
+  X(alBufferi)                                                                                     \
+  X(alcCloseDevice)                                                                                \
+  X(alcCreateContext)                                                                              \
+  X(alcDestroyContext)                                                                             \
+  X(alcGetContextsDevice)                                                                          \
+  X(alcGetIntegerv)                                                                                \
+  X(alcGetProcAddress)                                                                             \
+  X(alcGetCurrentContext)                                                                          \
+  X(alcGetString)                                                                                  \
+  X(alcIsExtensionPresent)                                                                         \
+  X(alcMakeContextCurrent)                                                                         \
+  X(alcOpenDevice)                                                                                 \
+  X(alDeleteBuffers)                                                                               \
+  X(alDeleteSources)                                                                               \
+  X(alGenBuffers)                                                                                  \
+  X(alGenSources)                                                                                  \
+  X(alGetError)                                                                                    \
+  X(alGetProcAddress)                                                                              \
+  X(alGetSourcei)                                                                                  \
+  X(alGetString)                                                                                   \
+  X(alIsExtensionPresent)                                                                          \
+  X(alSourcef)                                                                                     \
+  X(alSourcei)                                                                                     \
+  X(alSourcePlay)                                                                                  \
+  X(alSourceQueueBuffers)                                                                          \
+  X(alSourceStop)                                                                                  \
+  X(alSourceUnqueueBuffers)                                                                        \
+  X(alGetEnumValue)                                                                                \
+  X(alIsSource)                                                                                    \
+  X(alGetSourcef)
+
+// Create func_t function pointer type and declare the "pfunc" variable of
+// that type, defined in OpenALLibrary.cpp.
+#define OPENAL_FUNC_DECLARE(func)                                                                  \
+  typedef decltype(&func) func##_t;                                                                \
+  extern func##_t p##func;
+
+OPENAL_API_VISIT(OPENAL_FUNC_DECLARE)
+
+// Load openal32.dll on Windows or libopenal.so.1 elsewhere, once
+bool InitOpenALLibrary();
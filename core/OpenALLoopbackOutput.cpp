@@ -0,0 +1,215 @@
+// OpenAL output rendering to memory through an ALC_SOFT_loopback device.
+
+#include <chrono>
+#include <thread>
+
+#include "Log.h"
+#include "OpenALLoopbackOutput.h"
+
+// ALC_SOFT_loopback, not in our OpenAL headers
+#ifndef ALC_SOFT_loopback
+#define ALC_BYTE_SOFT 0x1400
+#define ALC_UNSIGNED_BYTE_SOFT 0x1401
+#define ALC_SHORT_SOFT 0x1402
+#define ALC_UNSIGNED_SHORT_SOFT 0x1403
+#define ALC_INT_SOFT 0x1404
+#define ALC_UNSIGNED_INT_SOFT 0x1405
+#define ALC_FLOAT_SOFT 0x1406
+#define ALC_MONO_SOFT 0x1500
+#define ALC_STEREO_SOFT 0x1501
+#define ALC_QUAD_SOFT 0x1503
+#define ALC_5POINT1_SOFT 0x1504
+#define ALC_6POINT1_SOFT 0x1505
+#define ALC_7POINT1_SOFT 0x1506
+#define ALC_FORMAT_CHANNELS_SOFT 0x1990
+#define ALC_FORMAT_TYPE_SOFT 0x1991
+typedef ALCdevice* (ALC_APIENTRY* LPALCLOOPBACKOPENDEVICESOFT)(const ALCchar* deviceName);
+typedef ALCboolean (ALC_APIENTRY* LPALCISRENDERFORMATSUPPORTEDSOFT)(ALCdevice* device, ALCsizei freq, ALCenum channels, ALCenum type);
+typedef void (ALC_APIENTRY* LPALCRENDERSAMPLESSOFT)(ALCdevice* device, ALCvoid* buffer, ALCsizei samples);
+#endif
+
+// Extension functions are only reachable through alcGetProcAddress
+static LPALCLOOPBACKOPENDEVICESOFT palcLoopbackOpenDeviceSOFT = nullptr;
+static LPALCISRENDERFORMATSUPPORTEDSOFT palcIsRenderFormatSupportedSOFT = nullptr;
+static LPALCRENDERSAMPLESSOFT palcRenderSamplesSOFT = nullptr;
+
+static bool InitLoopbackFunctions()
+{
+  if (!palcIsExtensionPresent(nullptr, "ALC_SOFT_loopback"))
+  {
+    return false;
+  }
+
+  palcLoopbackOpenDeviceSOFT = reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(
+    palcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT"));
+  palcIsRenderFormatSupportedSOFT = reinterpret_cast<LPALCISRENDERFORMATSUPPORTEDSOFT>(
+    palcGetProcAddress(nullptr, "alcIsRenderFormatSupportedSOFT"));
+  palcRenderSamplesSOFT = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(
+    palcGetProcAddress(nullptr, "alcRenderSamplesSOFT"));
+
+  return palcLoopbackOpenDeviceSOFT && palcIsRenderFormatSupportedSOFT && palcRenderSamplesSOFT;
+}
+
+static ALCenum GetLoopbackChannels(SpeakerLayout speaker_layout)
+{
+  switch (speaker_layout)
+  {
+  case SpeakerLayout::Mono:
+    return ALC_MONO_SOFT;
+  case SpeakerLayout::Stereo:
+    return ALC_STEREO_SOFT;
+  case SpeakerLayout::Quad:
+    return ALC_QUAD_SOFT;
+  case SpeakerLayout::Surround6:
+    return ALC_5POINT1_SOFT;
+  case SpeakerLayout::Surround8:
+    return ALC_7POINT1_SOFT;
+  default:
+    return 0;
+  }
+}
+
+static ALCenum GetLoopbackType(MediaBitness bitness)
+{
+  switch (bitness)
+  {
+  case MediaBitness::bit8:
+    return ALC_UNSIGNED_BYTE_SOFT;
+  case MediaBitness::bit16:
+    return ALC_SHORT_SOFT;
+  case MediaBitness::bit32:
+    return ALC_INT_SOFT;
+  case MediaBitness::bitfloat:
+    return ALC_FLOAT_SOFT;
+  default:
+    return 0;
+  }
+}
+
+COpenALLoopbackOutput::COpenALLoopbackOutput(IAudioSource* source)
+  : COpenALOutput(source)
+{
+}
+
+COpenALLoopbackOutput::~COpenALLoopbackOutput()
+{
+  // The sound loop calls into us, stop it while we still exist
+  CloseDevice();
+}
+
+bool COpenALLoopbackOutput::setRenderFormat(const AudioFormat& format)
+{
+  if (!GetLoopbackChannels(format.speaker_layout) || !GetLoopbackType(format.bitness) || !format.frequency)
+  {
+    return false;
+  }
+
+  m_render_format = format;
+  return true;
+}
+
+AudioFormat COpenALLoopbackOutput::getRenderFormat()
+{
+  return m_render_format;
+}
+
+void COpenALLoopbackOutput::setRenderBlock(size_t frames)
+{
+  m_render_block = frames;
+}
+
+void COpenALLoopbackOutput::setRenderCallback(RenderCallback callback)
+{
+  m_render_callback = std::move(callback);
+}
+
+uint64_t COpenALLoopbackOutput::getRenderedFrames()
+{
+  return m_rendered_frames;
+}
+
+bool COpenALLoopbackOutput::isDrained()
+{
+  return m_drained_submitted == getBuffersSubmitted();
+}
+
+ALCdevice* COpenALLoopbackOutput::OpenALCDevice(std::vector<ALCint>* attributes)
+{
+  if (!InitLoopbackFunctions())
+  {
+    LogMessage("OpenAL: ALC_SOFT_loopback is not supported\n");
+    return nullptr;
+  }
+
+  ALCenum channels = GetLoopbackChannels(m_render_format.speaker_layout);
+  ALCenum type = GetLoopbackType(m_render_format.bitness);
+  ALCsizei frequency = static_cast<ALCsizei>(m_render_format.frequency);
+
+  ALCdevice* device = palcLoopbackOpenDeviceSOFT(nullptr);
+  if (!device)
+  {
+    LogMessage("OpenAL: can't open loopback device\n");
+    return nullptr;
+  }
+
+  if (!palcIsRenderFormatSupportedSOFT(device, frequency, channels, type))
+  {
+    palcCloseDevice(device);
+    LogMessage("OpenAL: render format not supported by the loopback device\n");
+    return nullptr;
+  }
+
+  attributes->insert(attributes->end(), {
+    ALC_FORMAT_CHANNELS_SOFT, channels,
+    ALC_FORMAT_TYPE_SOFT, type,
+    ALC_FREQUENCY, frequency });
+
+  m_device = device;
+  m_rendered_frames = 0;
+  m_drained_submitted = getBuffersSubmitted();
+
+  return device;
+}
+
+void COpenALLoopbackOutput::Render()
+{
+  size_t frames = m_render_block;
+  if (frames == 0)
+  {
+    frames = m_render_format.frequency / 1000 * getLatency() / OAL_BUFFERS;
+  }
+
+  size_t size = frames * GetFrameSize(m_render_format.speaker_layout, m_render_format.bitness);
+  if (m_render_buffer.size() < size)
+  {
+    m_render_buffer.resize(size);
+  }
+
+  // Mixes the playing sources, which releases their processed buffers
+  palcRenderSamplesSOFT(m_device, m_render_buffer.data(), static_cast<ALCsizei>(frames));
+  m_rendered_frames += frames;
+
+  if (m_render_callback)
+  {
+    m_render_callback(m_render_buffer.data(), frames);
+  }
+}
+
+void COpenALLoopbackOutput::WaitForBuffers(bool /*last_buffer*/)
+{
+  // Nothing plays the buffers but us
+  Render();
+}
+
+void COpenALLoopbackOutput::WaitForStreaming()
+{
+  // Play out what is still queued once streaming stopped
+  if (IsPlaying())
+  {
+    Render();
+    return;
+  }
+
+  m_drained_submitted = getBuffersSubmitted();
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
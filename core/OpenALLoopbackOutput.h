@@ -0,0 +1,58 @@
+// OpenAL output rendering to memory through an ALC_SOFT_loopback device.
+// Runs the same sound loop as COpenALOutput, but instead of waiting for a
+// sound card to play the queued buffers it renders them right away, so a
+// stream is processed as fast as the CPU allows.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "OpenALOutput.h"
+
+class COpenALLoopbackOutput final : public COpenALOutput
+{
+public:
+  // Called on the sound loop thread with every block of rendered frames,
+  // interleaved in the render format
+  typedef std::function<void(const void* samples, size_t frames)> RenderCallback;
+
+  explicit COpenALLoopbackOutput(IAudioSource* source);
+  ~COpenALLoopbackOutput();
+
+  // Format OpenAL mixes to. Speaker layouts only, 8-bit is unsigned.
+  // Takes effect on the next OpenDevice.
+  bool setRenderFormat(const AudioFormat& format);
+  AudioFormat getRenderFormat();
+
+  // Frames rendered per call to alcRenderSamplesSOFT, 0 for one buffer's worth
+  void setRenderBlock(size_t frames);
+
+  void setRenderCallback(RenderCallback callback);
+
+  // Total frames rendered since the device was opened
+  uint64_t getRenderedFrames();
+
+  // True once streaming stopped and the queued buffers have been rendered
+  bool isDrained();
+
+protected:
+  ALCdevice* OpenALCDevice(std::vector<ALCint>* attributes) override;
+  void WaitForBuffers(bool last_buffer) override;
+  void WaitForStreaming() override;
+
+private:
+  void Render();
+
+  ALCdevice* m_device = nullptr;
+  AudioFormat m_render_format = { 48000, Stereo, bitfloat };
+  size_t m_render_block = 0;
+  std::vector<int8_t> m_render_buffer;
+  RenderCallback m_render_callback;
+
+  std::atomic<uint64_t> m_rendered_frames = 0;
+
+  // Buffers submitted when the sources were last seen idle
+  std::atomic<uint64_t> m_drained_submitted = 0;
+};
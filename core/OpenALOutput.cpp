@@ -0,0 +1,1044 @@
+// OpenAL output backend. Streams the mixer output through a queue of AL
+// buffers on its own thread.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "AllocationAudit.h"
+#include "EventTrace.h"
+#include "Log.h"
+#include "OpenALOutput.h"
+
+// ALC_SOFT_output_mode, not in our OpenAL headers
+#ifndef ALC_OUTPUT_MODE_SOFT
+#define ALC_OUTPUT_MODE_SOFT 0x19AC
+#define ALC_MONO_SOFT 0x1500
+#define ALC_STEREO_SOFT 0x1501
+#define ALC_QUAD_SOFT 0x1503
+#define ALC_SURROUND_5_1_SOFT 0x1504
+#define ALC_SURROUND_6_1_SOFT 0x1505
+#define ALC_SURROUND_7_1_SOFT 0x1506
+#endif
+
+// AL_SOFT_direct_channels and AL_SOFT_direct_channels_remix
+#ifndef AL_DIRECT_CHANNELS_SOFT
+#define AL_DIRECT_CHANNELS_SOFT 0x1033
+#endif
+#ifndef AL_REMIX_UNMATCHED_SOFT
+#define AL_REMIX_UNMATCHED_SOFT 0x0002
+#endif
+
+// AL_SOFT_bformat_ex and AL_SOFT_bformat_hoa
+#ifndef AL_AMBISONIC_LAYOUT_SOFT
+#define AL_AMBISONIC_LAYOUT_SOFT 0x1997
+#define AL_AMBISONIC_SCALING_SOFT 0x1998
+#define AL_FUMA_SOFT 0x0000
+#define AL_ACN_SOFT 0x0001
+#define AL_SN3D_SOFT 0x0001
+#define AL_N3D_SOFT 0x0002
+#endif
+#ifndef AL_UNPACK_AMBISONIC_ORDER_SOFT
+#define AL_UNPACK_AMBISONIC_ORDER_SOFT 0x199D
+#endif
+
+// ALC_SOFT_device_clock with AL_SOFT_source_latency, and
+// AL_SOFT_source_start_delay
+#ifndef AL_SAMPLE_OFFSET_CLOCK_SOFT
+#define AL_SAMPLE_OFFSET_CLOCK_SOFT 0x1202
+#endif
+typedef void (AL_APIENTRY* LPALGETSOURCEI64VSOFT)(ALuint source, ALenum param, int64_t* values);
+typedef void (AL_APIENTRY* LPALSOURCEPLAYATTIMESOFT)(ALuint source, int64_t start_time);
+
+// Extension functions are only reachable through alGetProcAddress
+static LPALGETSOURCEI64VSOFT palGetSourcei64vSOFT = nullptr;
+static LPALSOURCEPLAYATTIMESOFT palSourcePlayAtTimeSOFT = nullptr;
+
+static std::vector<std::string> GetAllDevices()
+{
+  std::vector<std::string> devices_names_list;
+  ALint device_index = 0;
+  const ALchar* device_names = palcGetString(nullptr, ALC_ALL_DEVICES_SPECIFIER);
+
+  while (device_names && *device_names)
+  {
+    std::string name = device_names;
+    devices_names_list.push_back(name);
+    device_index++;
+    device_names += strlen(device_names) + 1;
+  }
+
+  return devices_names_list;
+}
+
+COpenALOutput::COpenALOutput(IAudioSource* source)
+  : m_mixer(source)
+{
+}
+
+COpenALOutput::~COpenALOutput()
+{
+  CloseDevice();
+}
+
+//
+// AyuanX: Spec says OpenAL1.1 is thread safe already
+//
+
+bool COpenALOutput::OpenDevice()
+{
+  if (!InitOpenALLibrary())
+  {
+    LogMessage("OpenAL: can't load the OpenAL library\n");
+    return false;
+  }
+
+  std::vector<ALCint> attributes;
+  ALCdevice* device = OpenALCDevice(&attributes);
+  if (!device)
+  {
+    return false;
+  }
+
+  if (!attributes.empty())
+  {
+    attributes.push_back(0);
+  }
+
+  ALCcontext* context = palcCreateContext(device, attributes.empty() ? nullptr : attributes.data());
+  if (!context)
+  {
+    palcCloseDevice(device);
+    LogMessage("OpenAL: can't create context\n");
+    return false;
+  }
+
+  palcMakeContextCurrent(context);
+  QueryCapabilities(device);
+
+  // The sound loop reports through the event trace from now on
+  if (!m_event_drain)
+  {
+    CEventTrace::Get().StartDrain();
+    m_event_drain = true;
+  }
+
+  return true;
+}
+
+ALCdevice* COpenALOutput::OpenALCDevice(std::vector<ALCint>* /*attributes*/)
+{
+  if (!palcIsExtensionPresent(nullptr, "ALC_ENUMERATION_EXT"))
+  {
+    LogMessage("OpenAL: can't find sound devices\n");
+    return nullptr;
+  }
+
+  const char* default_device = palcGetString(nullptr, ALC_DEFAULT_DEVICE_SPECIFIER);
+
+  if (!strlen(default_device))
+  {
+    LogMessage("No device found.\n");
+    return nullptr;
+  }
+
+  std::vector<std::string> devices = GetAllDevices();
+
+  {
+    std::ostringstream string;
+    string << "Found OpenAL device \"" << devices[0].c_str() << "\"." << std::endl;
+    LogMessage(string.str());
+  }
+
+  ALCdevice* device = palcOpenDevice(devices[0].c_str());
+  if (!device)
+  {
+    std::ostringstream string;
+    string << "OpenAL: can't open device " << devices[0].c_str() << std::endl;
+    LogMessage(string.str());
+  }
+
+  return device;
+}
+
+void COpenALOutput::WaitForBuffers(bool last_buffer)
+{
+  if (last_buffer)
+  {
+    // The old format is on its last buffer, poll tightly so the
+    // switch doesn't leave a gap.
+    std::this_thread::yield();
+  }
+  else
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void COpenALOutput::WaitForStreaming()
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+bool COpenALOutput::IsPlaying()
+{
+  for (ALuint source : m_sources)
+  {
+    ALint state = 0;
+    if (source)
+      palGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state == AL_PLAYING)
+      return true;
+  }
+
+  return false;
+}
+
+uint64_t COpenALOutput::getBuffersSubmitted()
+{
+  return m_buffers_submitted;
+}
+
+void COpenALOutput::setSubmitCallback(SubmitCallback callback)
+{
+  m_submit_callback = std::move(callback);
+}
+
+static bool IsCreativeXFi()
+{
+  const ALchar* renderer = palGetString(AL_RENDERER);
+  return renderer && strstr(renderer, "X-Fi") != nullptr;
+}
+
+void COpenALOutput::QueryCapabilities(ALCdevice* device)
+{
+  OpenALCapabilities capabilities;
+
+  capabilities.float32 = palIsExtensionPresent("AL_EXT_float32") != AL_FALSE;
+  capabilities.mcformats = palIsExtensionPresent("AL_EXT_MCFORMATS") != AL_FALSE;
+
+  // As there is no extension to check for 32-bit fixed point support
+  // and we know that only a X-Fi with hardware OpenAL supports it,
+  // we just check if one is being used.
+  capabilities.fixed32 = IsCreativeXFi();
+
+  capabilities.direct_channels = palIsExtensionPresent("AL_SOFT_direct_channels") != AL_FALSE;
+  capabilities.direct_channels_remix = palIsExtensionPresent("AL_SOFT_direct_channels_remix") != AL_FALSE;
+  capabilities.source_latency = palIsExtensionPresent("AL_SOFT_source_latency") != AL_FALSE;
+  capabilities.callback_buffer = palIsExtensionPresent("AL_SOFT_callback_buffer") != AL_FALSE;
+  capabilities.device_clock = palcIsExtensionPresent(device, "ALC_SOFT_device_clock") != ALC_FALSE;
+  if (capabilities.source_latency && capabilities.device_clock &&
+    palIsExtensionPresent("AL_SOFT_source_start_delay") != AL_FALSE)
+  {
+    palGetSourcei64vSOFT = reinterpret_cast<LPALGETSOURCEI64VSOFT>(palGetProcAddress("alGetSourcei64vSOFT"));
+    palSourcePlayAtTimeSOFT = reinterpret_cast<LPALSOURCEPLAYATTIMESOFT>(palGetProcAddress("alSourcePlayAtTimeSOFT"));
+    capabilities.source_start_delay = palGetSourcei64vSOFT && palSourcePlayAtTimeSOFT;
+  }
+  capabilities.bformat = palIsExtensionPresent("AL_EXT_BFORMAT") != AL_FALSE;
+  capabilities.bformat_ex = capabilities.bformat && palIsExtensionPresent("AL_SOFT_bformat_ex") != AL_FALSE;
+  capabilities.bformat_hoa = capabilities.bformat_ex && palIsExtensionPresent("AL_SOFT_bformat_hoa") != AL_FALSE;
+
+  if (capabilities.mcformats || capabilities.fixed32)
+  {
+    capabilities.max_channels = 8;
+  }
+
+  ALCint frequency = 0;
+  palcGetIntegerv(device, ALC_FREQUENCY, 1, &frequency);
+  capabilities.native_frequency = frequency > 0 ? static_cast<uint32_t>(frequency) : 0;
+
+  if (palcIsExtensionPresent(device, "ALC_SOFT_output_mode"))
+  {
+    capabilities.output_mode = true;
+    ALCint output_mode = 0;
+    palcGetIntegerv(device, ALC_OUTPUT_MODE_SOFT, 1, &output_mode);
+    switch (output_mode)
+    {
+    case ALC_MONO_SOFT:
+      capabilities.output_channels = 1;
+      break;
+    case ALC_QUAD_SOFT:
+      capabilities.output_channels = 4;
+      break;
+    case ALC_SURROUND_5_1_SOFT:
+    case ALC_SURROUND_6_1_SOFT:
+      capabilities.output_channels = 6;
+      break;
+    case ALC_SURROUND_7_1_SOFT:
+      capabilities.output_channels = 8;
+      break;
+    default:
+      // Stereo, HRTF, UHJ and anything unknown
+      capabilities.output_channels = 2;
+      break;
+    }
+
+    if (capabilities.output_channels > capabilities.max_channels)
+    {
+      capabilities.output_channels = capabilities.max_channels;
+    }
+  }
+
+  m_capabilities = capabilities;
+
+  std::ostringstream string;
+  string << "OpenAL capabilities: float32=" << capabilities.float32 <<
+    " mcformats=" << capabilities.mcformats <<
+    " fixed32=" << capabilities.fixed32 <<
+    " direct_channels=" << capabilities.direct_channels <<
+    " direct_channels_remix=" << capabilities.direct_channels_remix <<
+    " source_latency=" << capabilities.source_latency <<
+    " callback_buffer=" << capabilities.callback_buffer <<
+    " device_clock=" << capabilities.device_clock <<
+    " source_start_delay=" << capabilities.source_start_delay <<
+    " bformat=" << capabilities.bformat <<
+    " bformat_ex=" << capabilities.bformat_ex <<
+    " bformat_hoa=" << capabilities.bformat_hoa <<
+    " max_channels=" << capabilities.max_channels <<
+    " output_mode=" << capabilities.output_mode <<
+    " output_channels=" << capabilities.output_channels <<
+    " frequency=" << capabilities.native_frequency << std::endl;
+  LogMessage(string.str());
+}
+
+const OpenALCapabilities& COpenALOutput::getCapabilities()
+{
+  return m_capabilities;
+}
+
+void COpenALOutput::CloseDevice()
+{
+  StopDevice();
+
+  // The sound loop uses the context until it returns
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+  }
+
+  Destroy();
+
+  if (m_event_drain)
+  {
+    CEventTrace::Get().StopDrain();
+    m_event_drain = false;
+  }
+}
+
+bool COpenALOutput::StartDevice()
+{
+  if (m_run_thread == false)
+  {
+    // Terminate older thread, if it exists
+    if (m_thread.joinable())
+    {
+      m_thread.join();
+    }
+
+    m_run_thread = true;
+    m_thread = std::thread(&COpenALOutput::SoundLoop, this);
+  }
+
+  return true;
+}
+
+void COpenALOutput::StopDevice()
+{
+  m_run_thread = false;
+}
+
+void COpenALOutput::setVolume(float volume)
+{
+  m_volume = volume;
+  for (ALuint source : m_sources)
+  {
+    if (source)
+      palSourcef(source, AL_GAIN, m_volume);
+  }
+}
+
+float COpenALOutput::getVolume()
+{
+  float volume = m_volume;
+  if (m_source && palIsSource(m_source))
+  {
+    palGetSourcef(m_source, AL_GAIN, &volume);
+  }
+
+  return volume;
+}
+
+void COpenALOutput::Destroy()
+{
+  ALCcontext* context = palcGetCurrentContext();
+
+  if (context != nullptr)
+  {
+    if (palIsSource(m_sources[0]))
+    {
+      for (ALuint source : m_sources)
+      {
+        palSourceStop(source);
+        palSourcei(source, AL_BUFFER, 0);
+      }
+
+      // Clean up buffers and sources
+      palDeleteSources(2, m_sources);
+      m_sources[0] = m_sources[1] = 0;
+      m_source = 0;
+      palDeleteBuffers(num_buffers, m_buffers.data());
+    }
+
+    ALCdevice* device = palcGetContextsDevice(context);
+
+    palcMakeContextCurrent(nullptr);
+    palcDestroyContext(context);
+    palcCloseDevice(device);
+  }
+
+  m_capabilities = OpenALCapabilities();
+}
+
+ALenum COpenALOutput::CheckALError(const char* desc)
+{
+  ALenum err = palGetError();
+
+  if (err != AL_NO_ERROR)
+  {
+    TraceRecord(TraceALError, err, 0, 0, desc);
+  }
+
+  return err;
+}
+
+void COpenALOutput::Stop()
+{
+  for (ALuint source : m_sources)
+  {
+    palSourceStop(source);
+    palSourcei(source, AL_BUFFER, 0);
+  }
+  m_total_buffered = 0;
+  TraceRecord(TraceStopped);
+}
+
+void COpenALOutput::setSpeakerLayout(SpeakerLayout layout)
+{
+  m_speaker_layout = layout;
+}
+
+SpeakerLayout COpenALOutput::getSpeakerLayout()
+{
+  return m_speaker_layout;
+}
+
+void COpenALOutput::setFrequency(uint32_t frequency)
+{
+  m_frequency = frequency;
+}
+
+uint32_t COpenALOutput::getFrequency()
+{
+  return m_frequency;
+}
+
+void COpenALOutput::setBitness(MediaBitness bitness)
+{
+  m_bitness = bitness;
+}
+
+MediaBitness COpenALOutput::getBitness()
+{
+  return m_bitness;
+}
+
+void COpenALOutput::setFormat(const AudioFormat& format)
+{
+  m_frequency = format.frequency;
+  m_bitness = format.bitness;
+  m_ambisonic_layout = format.ambisonic_layout;
+  m_ambisonic_scaling = format.ambisonic_scaling;
+  m_speaker_layout = format.speaker_layout;
+}
+
+AudioFormat COpenALOutput::getFormat()
+{
+  AudioFormat format;
+  format.frequency = m_frequency;
+  format.speaker_layout = m_speaker_layout;
+  format.bitness = m_bitness;
+  format.ambisonic_layout = m_ambisonic_layout;
+  format.ambisonic_scaling = m_ambisonic_scaling;
+  return format;
+}
+
+void COpenALOutput::setDeviceFormatMode(bool enabled)
+{
+  m_device_format_mode = enabled;
+  if (enabled)
+  {
+    setFormat(getDeviceFormat());
+  }
+}
+
+bool COpenALOutput::getDeviceFormatMode()
+{
+  return m_device_format_mode;
+}
+
+void COpenALOutput::setDirectChannels(bool enabled)
+{
+  m_direct_channels = enabled;
+}
+
+bool COpenALOutput::getDirectChannels()
+{
+  return m_direct_channels;
+}
+
+bool COpenALOutput::setACNScaling(AmbisonicScaling scaling)
+{
+  if (scaling == FuMaScaling)
+  {
+    return false;
+  }
+
+  m_acn_scaling = scaling;
+  return true;
+}
+
+AmbisonicScaling COpenALOutput::getACNScaling()
+{
+  return m_acn_scaling;
+}
+
+void COpenALOutput::setACNFirstOrder(bool enabled)
+{
+  m_acn_first_order = enabled;
+}
+
+bool COpenALOutput::getACNFirstOrder()
+{
+  return m_acn_first_order;
+}
+
+AudioFormat COpenALOutput::getDeviceFormat()
+{
+  AudioFormat format;
+  format.frequency = m_capabilities.native_frequency ? m_capabilities.native_frequency : 48000;
+  format.bitness = m_capabilities.float32 ? bitfloat : bit16;
+
+  switch (m_capabilities.output_channels)
+  {
+  case 1:
+    format.speaker_layout = Mono;
+    break;
+  case 4:
+    format.speaker_layout = Quad;
+    break;
+  case 6:
+    format.speaker_layout = Surround6;
+    break;
+  case 8:
+    format.speaker_layout = Surround8;
+    break;
+  default:
+    format.speaker_layout = Stereo;
+    break;
+  }
+
+  return format;
+}
+
+std::vector<MediaBitness> COpenALOutput::getSupportedBitness()
+{
+  std::vector<MediaBitness> supported_bitness;
+
+  if (m_capabilities.float32)
+  {
+    supported_bitness.push_back(bitfloat);
+  }
+
+  if (m_capabilities.fixed32)
+  {
+    supported_bitness.push_back(bit32);
+  }
+
+  // All implementation support 16-bit and 8-bit
+  supported_bitness.push_back(bit16);
+  supported_bitness.push_back(bit8);
+
+  return supported_bitness;
+}
+
+std::vector<SpeakerLayout> COpenALOutput::getSupportedSpeakerLayout()
+{
+  std::vector<SpeakerLayout> supported_layouts;
+  if (m_capabilities.max_channels >= 8)
+  {
+    supported_layouts.push_back(Surround8);
+    supported_layouts.push_back(Surround6);
+  }
+
+  supported_layouts.push_back(Quad);
+  supported_layouts.push_back(Stereo);
+  supported_layouts.push_back(Mono);
+
+  // Decoded to the output by OpenAL
+  if (m_capabilities.bformat_hoa)
+  {
+    supported_layouts.push_back(BFormat3);
+    supported_layouts.push_back(BFormat2);
+  }
+
+  if (m_capabilities.bformat)
+  {
+    supported_layouts.push_back(BFormat1);
+  }
+
+  return supported_layouts;
+}
+
+bool COpenALOutput::isFormatSupported(const AudioFormat& format)
+{
+  // In device format mode the mixer converts everything we can decode
+  bool device_format_mode = m_device_format_mode;
+
+  if (IsAmbisonic(format.speaker_layout))
+  {
+    // B-Format is decoded by OpenAL, we can't convert it to speakers
+    if (device_format_mode)
+    {
+      return false;
+    }
+
+    // OpenAL has 8-bit, 16-bit and float B-Format only
+    if (format.bitness == bit24 || format.bitness == bit32)
+    {
+      return false;
+    }
+
+    // Plain AL_EXT_BFORMAT only knows FuMa
+    if (format.ambisonic_layout == ACN && !m_capabilities.bformat_ex)
+    {
+      return false;
+    }
+  }
+
+  auto supported_layouts = getSupportedSpeakerLayout();
+  auto supported_bitness = getSupportedBitness();
+  if (device_format_mode)
+  {
+    supported_layouts.push_back(Surround6);
+    supported_layouts.push_back(Surround8);
+    supported_bitness.push_back(bit24);
+    supported_bitness.push_back(bit32);
+    supported_bitness.push_back(bitfloat);
+  }
+
+  return std::find(supported_layouts.cbegin(), supported_layouts.cend(), format.speaker_layout) != supported_layouts.cend() &&
+    std::find(supported_bitness.cbegin(), supported_bitness.cend(), format.bitness) != supported_bitness.cend();
+}
+
+uint32_t COpenALOutput::getLatency()
+{
+  return m_latency;
+}
+
+int64_t COpenALOutput::getSampleTime()
+{
+  size_t total_played = m_total_buffered * 1000;
+  total_played /= m_frequency;
+
+  // Subtract played
+  float offset = 0;
+  if (m_source)
+  {
+    palGetSourcef(m_source, AL_SEC_OFFSET, &offset);
+    offset *= 1000;
+    if (offset < total_played)
+      total_played -= static_cast<size_t>(offset);
+  }
+
+  TraceRecord(TraceSampleTime, total_played);
+
+  return total_played;
+}
+
+void COpenALOutput::resetSampleTime()
+{
+  m_total_buffered = 0;
+}
+
+static uint32_t GetFramesPerBuffer(uint32_t frequency, uint32_t latency, uint32_t num_buffers)
+{
+  // Can't have zero samples per buffer
+  if (latency > 0)
+  {
+    return frequency / 1000 * latency / num_buffers;
+  }
+
+  return frequency / 1000 * 1 / num_buffers;
+}
+
+uint32_t COpenALOutput::getFramesPerBuffer(uint32_t frequency)
+{
+  return GetFramesPerBuffer(frequency, m_latency, num_buffers);
+}
+
+void COpenALOutput::ReclaimBuffers(size_t source_index)
+{
+  ALuint source = m_sources[source_index];
+
+  int num_buffers_processed = 0;
+  palGetSourcei(source, AL_BUFFERS_PROCESSED, &num_buffers_processed);
+  if (num_buffers_processed <= 0)
+  {
+    return;
+  }
+
+  palSourceUnqueueBuffers(source, num_buffers_processed, m_unqueued_buffers.data());
+  if (CheckALError("unqueuing buffers") != AL_NO_ERROR)
+  {
+    return;
+  }
+
+  m_free_buffers.insert(m_free_buffers.end(), m_unqueued_buffers.begin(),
+    m_unqueued_buffers.begin() + num_buffers_processed);
+  m_buffers_queued[source_index] -= num_buffers_processed;
+
+  for (int i = 0; i < num_buffers_processed; i++)
+  {
+    m_frames_queued[source_index] -= m_buffer_frames[BufferIndex(m_unqueued_buffers[i])];
+  }
+}
+
+size_t COpenALOutput::BufferIndex(ALuint buffer)
+{
+  return std::find(m_buffers.begin(), m_buffers.end(), buffer) - m_buffers.begin();
+}
+
+bool COpenALOutput::StartAfterDrain(size_t draining_source, ALsizei draining_frequency)
+{
+  if (!m_capabilities.source_start_delay)
+  {
+    return false;
+  }
+
+  // Sample offset into the queue in 32.32 fixed point, and the device clock
+  // in nanoseconds it was taken at. The state is read after it, a source
+  // that stopped in between would report its offset as 0.
+  int64_t offset_clock[2] = {};
+  palGetSourcei64vSOFT(m_sources[draining_source], AL_SAMPLE_OFFSET_CLOCK_SOFT, offset_clock);
+  ALint state = 0;
+  palGetSourcei(m_sources[draining_source], AL_SOURCE_STATE, &state);
+  if (CheckALError("getting the sample offset clock") != AL_NO_ERROR)
+  {
+    return false;
+  }
+
+  if (state != AL_PLAYING)
+  {
+    palSourcePlay(m_sources[m_active_source]);
+  }
+  else
+  {
+    uint64_t played = static_cast<uint64_t>(offset_clock[0]) >> 32;
+    uint64_t queued = m_frames_queued[draining_source];
+    uint64_t remaining = queued > played ? queued - played : 0;
+    int64_t start_time = offset_clock[1] + static_cast<int64_t>(remaining * 1000000000 / draining_frequency);
+    palSourcePlayAtTimeSOFT(m_sources[m_active_source], start_time);
+  }
+
+  return CheckALError("scheduling source after format change") == AL_NO_ERROR;
+}
+
+void COpenALOutput::ConfigureSource(ALuint source, SpeakerLayout speaker_layout)
+{
+  // Mono sources are always panned and B-Format is always decoded,
+  // direct channels doesn't apply to them. Without ALC_SOFT_output_mode the
+  // output channels are a guess, and a wrong one would bypass HRTF.
+  ALint direct = AL_FALSE;
+  if (m_direct_channels && m_capabilities.direct_channels && m_capabilities.output_mode &&
+    speaker_layout != Mono && !IsAmbisonic(speaker_layout))
+  {
+    if (GetChannelCount(speaker_layout) == m_capabilities.output_channels)
+    {
+      direct = AL_TRUE;
+    }
+    else if (m_capabilities.direct_channels_remix)
+    {
+      // Without the remix variant channels missing from the output are dropped
+      direct = AL_REMIX_UNMATCHED_SOFT;
+    }
+  }
+
+  if (m_capabilities.direct_channels)
+  {
+    palSourcei(source, AL_DIRECT_CHANNELS_SOFT, direct);
+    CheckALError("setting direct channels");
+  }
+}
+
+void COpenALOutput::ConfigureBuffer(ALuint buffer, SpeakerLayout speaker_layout)
+{
+  if (!IsAmbisonic(speaker_layout) || !m_capabilities.bformat_ex)
+  {
+    return;
+  }
+
+  // Must be set before the data is loaded
+  palBufferi(buffer, AL_AMBISONIC_LAYOUT_SOFT,
+    m_ambisonic_layout == ACN ? AL_ACN_SOFT : AL_FUMA_SOFT);
+  palBufferi(buffer, AL_AMBISONIC_SCALING_SOFT,
+    m_ambisonic_scaling == N3D ? AL_N3D_SOFT : m_ambisonic_scaling == SN3D ? AL_SN3D_SOFT : AL_FUMA_SOFT);
+
+  if (m_capabilities.bformat_hoa)
+  {
+    ALint order = speaker_layout == BFormat3 ? 3 : speaker_layout == BFormat2 ? 2 : 1;
+    palBufferi(buffer, AL_UNPACK_AMBISONIC_ORDER_SOFT, order);
+  }
+
+  CheckALError("setting ambisonic format");
+}
+
+void COpenALOutput::SoundLoop()
+{
+  ALsizei past_frequency = m_frequency;
+  SpeakerLayout past_speaker_layout = m_speaker_layout;
+  MediaBitness past_bitness = m_bitness;
+  AmbisonicLayout past_ambisonic_layout = m_ambisonic_layout;
+  AmbisonicScaling past_ambisonic_scaling = m_ambisonic_scaling;
+  bool past_direct_channels = m_direct_channels;
+  // The layout each source was last configured for, and the frequency of
+  // the buffers it plays
+  SpeakerLayout source_layouts[2] = { past_speaker_layout, past_speaker_layout };
+  ALsizei source_frequencies[2] = { past_frequency, past_frequency };
+
+  uint32_t frames_per_buffer = GetFramesPerBuffer(m_frequency, m_latency, num_buffers);
+
+  TraceNameThread("SoundLoop");
+  TraceRecord(TraceSoundLoopStart, num_buffers, frames_per_buffer);
+
+  // Should we make these larger just in case the mixer ever sends more samples
+  // than what we request?
+  m_buffers.resize(num_buffers);
+  m_unqueued_buffers.resize(num_buffers);
+  m_free_buffers.reserve(num_buffers);
+  m_sources[0] = m_sources[1] = 0;
+  m_buffers_queued[0] = m_buffers_queued[1] = 0;
+  m_frames_queued[0] = m_frames_queued[1] = 0;
+  m_buffer_frames.assign(num_buffers, 0);
+  m_active_source = 0;
+
+  // Clear error state before querying or else we get false positives.
+  ALenum err = palGetError();
+
+  // Generate some AL Buffers for streaming
+  palGenBuffers(num_buffers, (ALuint*)m_buffers.data());
+  err = CheckALError("generating buffers");
+  m_free_buffers.assign(m_buffers.begin(), m_buffers.end());
+
+  // Generate the Sources to playback the Buffers
+  palGenSources(2, m_sources);
+  err = CheckALError("generating sources");
+  m_source = m_sources[m_active_source];
+
+  // Set the default sound volume as saved in the config file.
+  for (ALuint source : m_sources)
+  {
+    palSourcef(source, AL_GAIN, m_volume);
+    ConfigureSource(source, past_speaker_layout);
+  }
+
+  // TODO: Error handling
+  // ALenum err = alGetError();
+
+  // Set while the previous format is still playing on the other source
+  bool format_handoff = false;
+
+  ALint state = 0;
+
+  // Looked up once per format rather than once per buffer
+  ALenum buffer_format = palGetEnumValue(GenerateFormatString(m_speaker_layout, m_bitness).c_str());
+
+  std::vector<int8_t> byte_data;
+  while (m_run_thread)
+  {
+    CHotPathScope audit("SoundLoop");
+
+    if (m_mixer->IsStreaming())
+    {
+      size_t draining_source = 1 - m_active_source;
+
+      // Check if stream changed frequency, bitness or channel setup.
+      // A source can only queue buffers of a single format, so the new format
+      // goes to the other source while the queued buffers finish playing.
+      if (past_frequency != m_frequency || past_bitness != m_bitness || past_speaker_layout != m_speaker_layout ||
+        past_ambisonic_layout != m_ambisonic_layout || past_ambisonic_scaling != m_ambisonic_scaling)
+      {
+        if (m_buffers_queued[m_active_source] > 0)
+        {
+          if (m_buffers_queued[draining_source] > 0)
+          {
+            // Two format changes within one queue length, drop the oldest
+            palSourceStop(m_sources[draining_source]);
+            ReclaimBuffers(draining_source);
+          }
+
+          m_active_source = draining_source;
+          draining_source = 1 - m_active_source;
+          m_source = m_sources[m_active_source];
+          format_handoff = true;
+        }
+
+        // The source taking over still has the direct channels setting of
+        // the layout it played last
+        source_layouts[m_active_source] = m_speaker_layout;
+        source_frequencies[m_active_source] = m_frequency;
+        ConfigureSource(m_sources[m_active_source], source_layouts[m_active_source]);
+
+        frames_per_buffer = GetFramesPerBuffer(m_frequency, m_latency, num_buffers);
+        buffer_format = palGetEnumValue(GenerateFormatString(m_speaker_layout, m_bitness).c_str());
+        TraceRecord(TraceFormatChange, m_frequency, m_speaker_layout, m_bitness);
+
+        past_frequency = m_frequency;
+        past_bitness = m_bitness;
+        past_speaker_layout = m_speaker_layout;
+        past_ambisonic_layout = m_ambisonic_layout;
+        past_ambisonic_scaling = m_ambisonic_scaling;
+      }
+
+      // Direct channels switched on or off while playing
+      if (past_direct_channels != m_direct_channels)
+      {
+        past_direct_channels = m_direct_channels;
+        ConfigureSource(m_sources[0], source_layouts[0]);
+        ConfigureSource(m_sources[1], source_layouts[1]);
+      }
+
+      // Return the processed buffers of both sources to the free list
+      ReclaimBuffers(m_active_source);
+      if (m_buffers_queued[draining_source] > 0)
+      {
+        ReclaimBuffers(draining_source);
+      }
+
+      // Without AL_SOFT_source_start_delay, start the new format once the
+      // old one has run out. That leaves a gap of up to a device update and
+      // the wait below.
+      if (format_handoff && m_buffers_queued[draining_source] == 0 && m_buffers_queued[m_active_source] > 0)
+      {
+        palSourcePlay(m_sources[m_active_source]);
+        err = CheckALError("starting source after format change");
+        format_handoff = false;
+      }
+
+      // Block until we have a free buffer
+      if (m_free_buffers.empty())
+      {
+        WaitForBuffers(format_handoff && m_buffers_queued[draining_source] <= 1);
+        continue;
+      }
+
+      // Control clock
+      //ClockController();
+
+      // Mixing, converting and handing one buffer to the driver
+      CMeasure::Get().Start(m_measure_buffer);
+
+      size_t available_frames = 0;
+      switch (m_bitness)
+      {
+      case bit8:
+        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 1);
+        break;
+      case bit16:
+        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 2);
+        break;
+      case bit32:
+        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 4);
+        break;
+      case bitfloat:
+        available_frames = m_mixer->Mix(&byte_data, frames_per_buffer, 4);
+        break;
+      case bit24:
+        // OpenAL has no packed 24-bit buffer format and isFormatSupported
+        // never lets one through. Should one get here anyway, the data is
+        // still consumed at its size, keeping the stream moving, and the
+        // buffer skipped.
+        m_mixer->Mix(&byte_data, frames_per_buffer, GetSampleSize(bit24));
+        break;
+      }
+
+      // The mixer returns no frames when it reaches a format change, the next
+      // iteration picks up the new format.
+      if (!available_frames)
+      {
+        continue;
+      }
+
+      ALuint buffer = m_free_buffers.back();
+      m_free_buffers.pop_back();
+
+      ConfigureBuffer(buffer, m_speaker_layout);
+
+      palBufferData(buffer,
+        buffer_format,
+        byte_data.data(),
+        static_cast<ALsizei>(available_frames * GetFrameSize(m_speaker_layout, m_bitness)),
+        m_frequency);
+
+      err = CheckALError("buffering data");
+
+      palSourceQueueBuffers(m_sources[m_active_source], 1, &buffer);
+      err = CheckALError("queuing buffers");
+      if (err != AL_NO_ERROR)
+      {
+        m_free_buffers.push_back(buffer);
+        continue;
+      }
+
+      m_total_buffered += available_frames;
+      m_buffers_queued[m_active_source]++;
+      m_frames_queued[m_active_source] += available_frames;
+      m_buffer_frames[BufferIndex(buffer)] = static_cast<uint32_t>(available_frames);
+      m_buffers_submitted++;
+      CMeasure::Get().Stop(m_measure_buffer);
+      TraceRecord(TraceBufferQueued, available_frames, m_buffers_queued[m_active_source]);
+
+      if (m_submit_callback)
+      {
+        m_submit_callback(available_frames);
+      }
+
+      if (format_handoff)
+      {
+        // Schedule the new format on the device clock to start on the
+        // sample the previous one ends with, or wait for it to finish
+        if (StartAfterDrain(draining_source, source_frequencies[draining_source]))
+        {
+          format_handoff = false;
+        }
+        continue;
+      }
+
+      palGetSourcei(m_sources[m_active_source], AL_SOURCE_STATE, &state);
+      if (state != AL_PLAYING)
+      {
+        // Buffer underrun occurred, resume playback
+        palSourcePlay(m_sources[m_active_source]);
+        err = CheckALError("occurred resuming playback");
+        TraceRecord(TraceUnderrun, m_buffers_queued[m_active_source]);
+      }
+    }
+    else
+    {
+      WaitForStreaming();
+    }
+  }
+}
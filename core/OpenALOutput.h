@@ -0,0 +1,173 @@
+// OpenAL output backend. Streams the mixer output through a queue of AL
+// buffers on its own thread.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioInterfaces.h"
+#include "Measure.h"
+#include "OpenALLibrary.h"
+
+// OpenAL requires a minimum of two buffers, three or more recommended
+const size_t OAL_BUFFERS = 8;
+
+// Capabilities of the opened OpenAL device. Queried once in OpenDevice so
+// media type negotiation and the sound loop don't have to probe the driver.
+struct OpenALCapabilities
+{
+  bool float32 = false;         // AL_EXT_float32
+  bool mcformats = false;       // AL_EXT_MCFORMATS
+  bool fixed32 = false;         // Creative X-Fi hardware OpenAL
+  bool direct_channels = false; // AL_SOFT_direct_channels
+  bool direct_channels_remix = false; // AL_SOFT_direct_channels_remix
+  bool source_latency = false;  // AL_SOFT_source_latency
+  bool callback_buffer = false; // AL_SOFT_callback_buffer
+  bool device_clock = false;    // ALC_SOFT_device_clock
+  bool source_start_delay = false; // AL_SOFT_source_start_delay, with the two above
+  bool bformat = false;         // AL_EXT_BFORMAT, first order FuMa
+  bool bformat_ex = false;      // AL_SOFT_bformat_ex, ACN ordering and SN3D/N3D scaling
+  bool bformat_hoa = false;     // AL_SOFT_bformat_hoa, up to third order
+  uint32_t max_channels = 2;
+  bool output_mode = false;     // ALC_SOFT_output_mode, output_channels was queried
+  uint32_t output_channels = 2;  // ALC_SOFT_output_mode, stereo if unknown
+  uint32_t native_frequency = 0;
+};
+
+class COpenALOutput : public IAudioOutput
+{
+public:
+  explicit COpenALOutput(IAudioSource* source);
+  virtual ~COpenALOutput();
+
+  bool OpenDevice() override;
+  void CloseDevice() override;
+  bool StartDevice() override;
+  void StopDevice() override;
+
+  // Stop playback and drop the queued buffers
+  void Stop();
+
+  // Linear gain, 1.0 is unchanged
+  void setVolume(float volume);
+  float getVolume();
+
+  void setSpeakerLayout(SpeakerLayout layout);
+  SpeakerLayout getSpeakerLayout();
+  void setFrequency(uint32_t frequency);
+  uint32_t getFrequency();
+  void setBitness(MediaBitness bitness);
+  MediaBitness getBitness();
+  bool isFormatSupported(const AudioFormat& format) override;
+  void setFormat(const AudioFormat& format) override;
+  AudioFormat getFormat() override;
+
+  void setDeviceFormatMode(bool enabled);
+  bool getDeviceFormatMode() override;
+  AudioFormat getDeviceFormat() override;
+
+  // Play multichannel content straight to the matching output channels,
+  // bypassing OpenAL's virtual speaker panning and HRTF. Off by default, and
+  // only used when the device reports its output mode. The sound loop
+  // applies a change to the sources already playing.
+  void setDirectChannels(bool enabled);
+  bool getDirectChannels();
+
+  // Wave formats don't say how ACN ordered B-Format is normalized
+  bool setACNScaling(AmbisonicScaling scaling);
+  AmbisonicScaling getACNScaling();
+  // Take 4 channels without a channel mask as first order ACN B-Format
+  // instead of quad. Off by default, quad decoders leave the mask unset too.
+  void setACNFirstOrder(bool enabled);
+  bool getACNFirstOrder();
+  std::vector<MediaBitness> getSupportedBitness();
+  std::vector<SpeakerLayout> getSupportedSpeakerLayout();
+  const OpenALCapabilities& getCapabilities();
+  // Total length of the buffer queue, in milliseconds
+  uint32_t getLatency();
+  // Frames of each AL buffer the sound loop queues, at frequency
+  uint32_t getFramesPerBuffer(uint32_t frequency);
+  // In milliseconds
+  int64_t getSampleTime();
+  void resetSampleTime();
+
+  // Set before StartDevice, called after each alBufferData
+  void setSubmitCallback(SubmitCallback callback);
+
+protected:
+  // Open the device the context is created on, attributes receives the
+  // context attributes it needs. Opens the first enumerated device.
+  virtual ALCdevice* OpenALCDevice(std::vector<ALCint>* attributes);
+
+  // Called by the sound loop while every buffer is queued, until one has been
+  // played. last_buffer is set when a format change is waiting on the final
+  // buffer of the previous format.
+  virtual void WaitForBuffers(bool last_buffer);
+
+  // Called by the sound loop while the mixer isn't streaming
+  virtual void WaitForStreaming();
+
+  // Whether a source is still playing queued buffers, sound loop thread only
+  bool IsPlaying();
+
+  // Buffers queued since the output was created
+  uint64_t getBuffersSubmitted();
+
+private:
+  void QueryCapabilities(ALCdevice* device);
+
+  std::thread m_thread;
+  std::atomic<bool> m_run_thread = false;
+  bool m_event_drain = false;   // holding the event trace drain thread
+  int m_measure_buffer = CMeasure::Get().Register("COpenALOutput::SoundLoop buffer");
+
+  void SoundLoop();
+  void ReclaimBuffers(size_t source_index);
+  size_t BufferIndex(ALuint buffer);
+  // Start the active source on the sample the draining one runs out at.
+  // False without AL_SOFT_source_start_delay, it is then started once the
+  // draining source has stopped.
+  bool StartAfterDrain(size_t draining_source, ALsizei draining_frequency);
+  void ConfigureSource(ALuint source, SpeakerLayout speaker_layout);
+  void ConfigureBuffer(ALuint buffer, SpeakerLayout speaker_layout);
+  void Destroy();
+  ALenum CheckALError(const char* desc);
+
+  uint32_t num_buffers = OAL_BUFFERS;
+
+  std::vector<ALuint> m_buffers;
+  std::vector<ALuint> m_free_buffers;
+  std::vector<ALuint> m_unqueued_buffers;
+  std::vector<uint32_t> m_buffer_frames;  // frames last queued in each of m_buffers
+  std::atomic<size_t> m_total_buffered = 0;
+  std::atomic<uint64_t> m_buffers_submitted = 0;
+  SubmitCallback m_submit_callback;
+
+  // Two sources so that a format change can start queuing on one while the
+  // buffers of the previous format finish playing on the other.
+  ALuint m_sources[2] = {};
+  uint32_t m_buffers_queued[2] = {};
+  uint64_t m_frames_queued[2] = {};
+  size_t m_active_source = 0;
+  std::atomic<ALuint> m_source = 0;
+  std::atomic<ALfloat> m_volume = 1.0f;
+
+  OpenALCapabilities m_capabilities;
+
+  IAudioSource* m_mixer;
+  std::atomic<SpeakerLayout> m_speaker_layout = Surround6;
+  std::atomic<MediaBitness> m_bitness = bit16;
+  std::atomic<AmbisonicLayout> m_ambisonic_layout = FuMa;
+  std::atomic<AmbisonicScaling> m_ambisonic_scaling = FuMaScaling;
+  std::atomic<ALsizei> m_frequency = 48000;
+
+  // Get from settings
+  uint32_t m_latency = 64;
+  std::atomic<bool> m_device_format_mode = false;
+  std::atomic<bool> m_direct_channels = false;
+  std::atomic<AmbisonicScaling> m_acn_scaling = SN3D;
+  std::atomic<bool> m_acn_first_order = false;
+};
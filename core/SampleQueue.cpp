@@ -0,0 +1,108 @@
+// Byte FIFO between the thread receiving samples and the output thread.
+
+#include <algorithm>
+#include <cstring>
+
+#include "SampleQueue.h"
+
+void CSampleQueue::Grow(size_t capacity)
+{
+  size_t new_capacity = std::max<size_t>(m_buffer.size(), 4096);
+  while (new_capacity < capacity)
+  {
+    new_capacity *= 2;
+  }
+
+  if (new_capacity == m_buffer.size())
+  {
+    return;
+  }
+
+  // Unwrap the queued data to the start of the new buffer
+  std::vector<int8_t> buffer(new_capacity);
+  size_t first = std::min(m_size, m_buffer.size() - m_head);
+  if (first)
+    memcpy(buffer.data(), m_buffer.data() + m_head, first);
+  if (m_size > first)
+    memcpy(buffer.data() + first, m_buffer.data(), m_size - first);
+
+  m_buffer.swap(buffer);
+  m_head = 0;
+}
+
+void CSampleQueue::Push(const void* data, size_t length)
+{
+  if (length == 0)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_size + length > m_buffer.size())
+  {
+    Grow(m_size + length);
+  }
+
+  const int8_t* source = static_cast<const int8_t*>(data);
+  size_t tail = (m_head + m_size) % m_buffer.size();
+  size_t first = std::min(length, m_buffer.size() - tail);
+  memcpy(m_buffer.data() + tail, source, first);
+  if (length > first)
+    memcpy(m_buffer.data(), source + first, length - first);
+
+  m_size += length;
+}
+
+size_t CSampleQueue::Pop(void* data, size_t length)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  length = std::min(length, m_size);
+  if (length == 0)
+  {
+    return 0;
+  }
+
+  int8_t* destination = static_cast<int8_t*>(data);
+  size_t first = std::min(length, m_buffer.size() - m_head);
+  memcpy(destination, m_buffer.data() + m_head, first);
+  if (length > first)
+    memcpy(destination + first, m_buffer.data(), length - first);
+
+  m_head = (m_head + length) % m_buffer.size();
+  m_size -= length;
+
+  return length;
+}
+
+size_t CSampleQueue::Discard(size_t length)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  length = std::min(length, m_size);
+  if (length)
+  {
+    m_head = (m_head + length) % m_buffer.size();
+    m_size -= length;
+  }
+
+  return length;
+}
+
+size_t CSampleQueue::Size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_size;
+}
+
+size_t CSampleQueue::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  size_t length = m_size;
+  m_head = 0;
+  m_size = 0;
+  return length;
+}
@@ -0,0 +1,37 @@
+// Byte FIFO between the thread receiving samples and the output thread.
+// Replaces concurrency::concurrent_queue<int8_t>, which is MSVC only and
+// moves a single byte per call.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class CSampleQueue
+{
+public:
+  void Push(const void* data, size_t length);
+
+  // Copy up to length bytes from the head, returns the bytes copied
+  size_t Pop(void* data, size_t length);
+
+  // Drop up to length bytes from the head, returns the bytes dropped
+  size_t Discard(size_t length);
+
+  size_t Size() const;
+
+  // Drop everything, returns the bytes dropped
+  size_t Clear();
+
+private:
+  void Grow(size_t capacity);
+
+  mutable std::mutex m_mutex;
+
+  // Ring buffer, grown to the largest backlog seen and then reused
+  std::vector<int8_t> m_buffer;
+  size_t m_head = 0;
+  size_t m_size = 0;
+};
@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// File: Measure.cpp
+//
+// Desc: DirectShow base classes - implements the Msr_ performance measurement
+//       functions declared in measure.h on top of the renderer core's
+//       CMeasure statistics (core\Measure.h).
+//
+//       The circular incident log of the original implementation is not
+//       kept, the hot path event trace (core\EventTrace.h) covers that.
+//       Msr_Dump and Msr_DumpStats both write the statistics table.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+#include <string>
+#include "core/Measure.h"
+
+void WINAPI Msr_Init(void)
+{
+    // The statistics are created on first use
+    CMeasure::Get();
+}
+
+
+void WINAPI Msr_Terminate(void)
+{
+}
+
+
+int WINAPI Msr_Register(__in LPCTSTR Incident)
+{
+#ifdef UNICODE
+    char szName[256];
+    if (!WideCharToMultiByte(CP_UTF8, 0, Incident, -1, szName, sizeof(szName), NULL, NULL)) {
+        return 0;
+    }
+    return CMeasure::Get().Register(szName);
+#else
+    return CMeasure::Get().Register(Incident);
+#endif
+}
+
+
+void WINAPI Msr_Reset(int Id)
+{
+    CMeasure::Get().Reset(Id);
+}
+
+
+void WINAPI Msr_Control(int iAction)
+{
+    switch (iAction) {
+    case MSR_RESET_ALL:
+        CMeasure::Get().ResetAll();
+        break;
+    case MSR_PAUSE:
+        CMeasure::Get().SetRunning(false);
+        break;
+    case MSR_RUN:
+        CMeasure::Get().SetRunning(true);
+        break;
+    }
+}
+
+
+void WINAPI Msr_Start(int Id)
+{
+    CMeasure::Get().Start(Id);
+}
+
+
+void WINAPI Msr_Stop(int Id)
+{
+    CMeasure::Get().Stop(Id);
+}
+
+
+void WINAPI Msr_Note(int Id)
+{
+    CMeasure::Get().Note(Id);
+}
+
+
+void WINAPI Msr_Integer(int Id, int n)
+{
+    CMeasure::Get().Integer(Id, n);
+}
+
+
+void WINAPI Msr_Dump(HANDLE hFile)
+{
+    Msr_DumpStats(hFile);
+}
+
+
+void WINAPI Msr_DumpStats(HANDLE hFile)
+{
+    std::string text = CMeasure::Get().DumpStats();
+
+    if (hFile == NULL) {
+        // Not DbgLog, that is compiled out of release builds
+        OutputDebugStringA(text.c_str());
+        return;
+    }
+
+    DWORD dwWritten;
+    WriteFile(hFile, text.data(), (DWORD)text.size(), &dwWritten, NULL);
+}
@@ -102,7 +102,14 @@ Number      Average       StdDev     Smallest      Largest Incident_Name
     are mixed in with Starts and Stops their statistics will be gibberish.
 
     If you code the calls in upper case i.e. MSR_START(idMunge); then you get
-    macros which will turn into nothing unless PERF is defined.
+    macros which will turn into nothing unless PERF or MSR_STATISTICS is
+    defined.  PERF also turns on timing code of the renderer and transform
+    base classes, MSR_STATISTICS turns on only these macros.
+
+    In this tree the functions are implemented in measure.cpp on top of the
+    core statistics (core\Measure.h): per-thread log-bucketed histograms that
+    are cheap enough to leave MSR_STATISTICS on in release builds.  Msr_Dump
+    writes the statistics with percentiles, there is no incident log.
 
     You can reset the statistical counts for a given id by calling Reset(Id).
     They are reset by default at the start.
@@ -116,7 +123,11 @@ Number      Average       StdDev     Smallest      Largest Incident_Name
 #ifndef __MEASURE__
 #define __MEASURE__
 
-#ifdef PERF
+#if defined(PERF) && !defined(MSR_STATISTICS)
+#define MSR_STATISTICS
+#endif
+
+#ifdef MSR_STATISTICS
 #define MSR_INIT() Msr_Init()
 #define MSR_TERMINATE() Msr_Terminate()
 #define MSR_REGISTER(a) Msr_Register(a)
@@ -159,7 +170,7 @@ void WINAPI Msr_Terminate(void);
 // Call this to get an Id for an "incident" that you can pass to Start, Stop or Note
 // everything that's logged is called an "incident".
 
-int  WINAPI Msr_Register(__in LPTSTR Incident);
+int  WINAPI Msr_Register(__in LPCTSTR Incident);
 
 
 // Reset the statistical counts for an incident
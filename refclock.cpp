@@ -60,6 +60,7 @@ CBaseReferenceClock::~CBaseReferenceClock()
         WaitForSingleObject( m_hThread, INFINITE );
         EXECUTE_ASSERT( CloseHandle(m_hThread) );
         m_hThread = 0;
+        delete m_pWait;
         EXECUTE_ASSERT( CloseHandle(m_pSchedule->GetEvent()) );
 	delete m_pSchedule;
     }
@@ -73,11 +74,13 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
                                           __inout HRESULT *phr, 
                                           __inout_opt CAMSchedule * pShed )
 : CUnknown( pName, pUnk )
-, m_rtLastGotTime(0)
+, m_Snapshot(0, 0, 1.0)          // Starts at the performance counter's time
+, m_LastGotTime(0)
 , m_TimerResolution(0)
 , m_bAbort( FALSE )
 , m_pSchedule( pShed ? pShed : new CAMSchedule(CreateEvent(NULL, FALSE, FALSE, NULL)) )
 , m_hThread(0)
+, m_pWait(0)
 {
 
 #ifdef DXMPERF
@@ -91,20 +94,29 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
     }
     else
     {
-        // Set up the highest resolution timer we can manage
-        TIMECAPS tc;
-        m_TimerResolution = (TIMERR_NOERROR == timeGetDevCaps(&tc, sizeof(tc)))
-                            ? tc.wPeriodMin
-                            : 1;
+        if ( !pShed )
+        {
+            // Ends its waits when the schedule's event is set
+            m_pWait = new CDeadlineWait(m_pSchedule->GetEvent());
+        }
 
-        timeBeginPeriod(m_TimerResolution);
+        // Our time comes from the performance counter and a high resolution
+        // waitable timer doesn't need it, but a millisecond timer or a
+        // derived class's own advise thread may.
+        if ( !m_pWait || !m_pWait->IsHighResolution() )
+        {
+            // Set up the highest resolution timer we can manage
+            TIMECAPS tc;
+            m_TimerResolution = (TIMERR_NOERROR == timeGetDevCaps(&tc, sizeof(tc)))
+                                ? tc.wPeriodMin
+                                : 1;
 
-        /* Initialise our system times - the derived clock should set the right values */
-        m_dwPrevSystemTime = timeGetTime();
-        m_rtPrivateTime = (UNITS / MILLISECONDS) * m_dwPrevSystemTime;
+            timeBeginPeriod(m_TimerResolution);
+        }
 
-        #ifdef PERF
+        #ifdef MSR_STATISTICS
             m_idGetSystemTime = MSR_REGISTER(TEXT("CBaseReferenceClock::GetTime"));
+            m_idAdviseLateness = MSR_REGISTER(TEXT("CBaseReferenceClock advise lateness (us)"));
         #endif
 
         if ( !pShed )
@@ -124,6 +136,8 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
             else
             {
                 *phr = E_FAIL;
+                delete m_pWait;
+                m_pWait = NULL;
                 EXECUTE_ASSERT( CloseHandle(m_pSchedule->GetEvent()) );
                 delete m_pSchedule;
                 m_pSchedule = NULL;
@@ -134,9 +148,7 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
 
 void CBaseReferenceClock::Restart (IN REFERENCE_TIME rtMinTime)
 {
-    Lock();
-    m_rtLastGotTime = rtMinTime ;
-    Unlock();
+    m_LastGotTime.Reset(rtMinTime);
 }
 
 STDMETHODIMP CBaseReferenceClock::GetTime(__out REFERENCE_TIME *pTime)
@@ -144,21 +156,13 @@ STDMETHODIMP CBaseReferenceClock::GetTime(__out REFERENCE_TIME *pTime)
     HRESULT hr;
     if (pTime)
     {
-        REFERENCE_TIME rtNow;
-        Lock();
-        rtNow = GetPrivateTime();
-        if (rtNow > m_rtLastGotTime)
-        {
-            m_rtLastGotTime = rtNow;
-            hr = S_OK;
-        }
-        else
-        {
-            hr = S_FALSE;
-        }
-        *pTime = m_rtLastGotTime;
-        Unlock();
-        MSR_INTEGER(m_idGetSystemTime, LONG((*pTime) / (UNITS/MILLISECONDS)) );
+        MSR_START(m_idGetSystemTime);
+        // No lock, readers of the base clock's time never wait and the
+        // last time returned only moves forward
+        bool bAdvanced;
+        *pTime = m_LastGotTime.Advance(GetPrivateTime(), &bAdvanced);
+        hr = bAdvanced ? S_OK : S_FALSE;
+        MSR_STOP(m_idGetSystemTime);
 
 #ifdef DXMPERF
         PERFLOG_GETTIME( (IReferenceClock *) this, *pTime );
@@ -231,23 +235,10 @@ STDMETHODIMP CBaseReferenceClock::Unadvise(DWORD_PTR dwAdviseCookie)
 
 REFERENCE_TIME CBaseReferenceClock::GetPrivateTime()
 {
-    CAutoLock cObjectLock(this);
-
-
-    /* If the clock has wrapped then the current time will be less than
-     * the last time we were notified so add on the extra milliseconds
-     *
-     * The time period is long enough so that the likelihood of
-     * successive calls spanning the clock cycle is not considered.
-     */
-
-    DWORD dwTime = timeGetTime();
-    {
-        m_rtPrivateTime += Int32x32To64(UNITS / MILLISECONDS, (DWORD)(dwTime - m_dwPrevSystemTime));
-        m_dwPrevSystemTime = dwTime;
-    }
-
-    return m_rtPrivateTime;
+    // The snapshot first, so that its system time is never after ours.
+    // The performance counter is 64 bits of 100ns, it doesn't wrap.
+    const ClockSnapshot snapshot = m_Snapshot.Read();
+    return CClockSeqlock::Extrapolate(snapshot, m_SystemClock.GetTime());
 }
 
 
@@ -287,10 +278,11 @@ STDMETHODIMP CBaseReferenceClock::SetTimeDelta(const REFERENCE_TIME & TimeDelta)
     }
 
     // Sev == 0 => > 2 second delta!
+    const REFERENCE_TIME rtPrivateTime = CBaseReferenceClock::GetPrivateTime();
     DbgLog((LOG_TIMING, Severity < 0 ? 0 : Severity,
         TEXT("Sev %2i: CSystemClock::SetTimeDelta(%8ld us) %lu -> %lu ms."),
-        Severity, usDelta, DWORD(ConvertToMilliseconds(m_rtPrivateTime)),
-        DWORD(ConvertToMilliseconds(TimeDelta+m_rtPrivateTime)) ));
+        Severity, usDelta, DWORD(ConvertToMilliseconds(rtPrivateTime)),
+        DWORD(ConvertToMilliseconds(TimeDelta+rtPrivateTime)) ));
 
     // Don't want the DbgBreak to fire when running stress on debug-builds.
     #ifdef BREAK_ON_SEVERE_TIME_DELTA
@@ -302,7 +294,11 @@ STDMETHODIMP CBaseReferenceClock::SetTimeDelta(const REFERENCE_TIME & TimeDelta)
 #endif
 
     CAutoLock cObjectLock(this);
-    m_rtPrivateTime += TimeDelta;
+    // A new snapshot at the adjusted time, GetPrivateTime picks it up at
+    // its next read
+    const ClockSnapshot snapshot = m_Snapshot.Read();
+    const REFERENCE_TIME rtSystemTime = m_SystemClock.GetTime();
+    m_Snapshot.Publish(CClockSeqlock::Extrapolate(snapshot, rtSystemTime) + TimeDelta, rtSystemTime, snapshot.rate);
     // If time goes forwards, and we have advises, then we need to
     // trigger the thread so that it can re-evaluate its wait time.
     // Since we don't want the cost of the thread switches if the change
@@ -323,7 +319,13 @@ DWORD __stdcall CBaseReferenceClock::AdviseThreadFunction(__in LPVOID p)
 
 HRESULT CBaseReferenceClock::AdviseThread()
 {
-    DWORD dwWait = INFINITE;
+    REFERENCE_TIME rtWait = MAX_TIME;
+
+    // Without a high resolution timer (before Windows 10 1803) waits end on
+    // the system timer's tick, so advises due within the next millisecond
+    // are fired now, as the millisecond waits of old did.  Failure to do so
+    // will cause us to loop franticly for (approx) 1 a millisecond.
+    const REFERENCE_TIME rtSlop = m_pWait->IsHighResolution() ? 0 : 10000;
 
     // The first thing we do is wait until something interesting happens
     // (meaning a first advise or shutdown).  This prevents us calling
@@ -334,8 +336,10 @@ HRESULT CBaseReferenceClock::AdviseThread()
     while ( !m_bAbort )
     {
         // Wait for an interesting event to happen
-        DbgLog((LOG_TIMING, 3, TEXT("CBaseRefClock::AdviseThread() Delay: %lu ms"), dwWait ));
-        WaitForSingleObject(m_pSchedule->GetEvent(), dwWait);
+        DbgLog((LOG_TIMING, 3, TEXT("CBaseRefClock::AdviseThread() Delay: %I64d us"),
+            rtWait == MAX_TIME ? -1 : rtWait / 10 ));
+        const bool bWoken = rtWait == MAX_TIME ? m_pWait->WaitUntil(CDeadlineWait::NO_DEADLINE)
+                                               : m_pWait->WaitFor(rtWait);
         if (m_bAbort) break;
 
         // There are several reasons why we need to work from the internal
@@ -349,21 +353,30 @@ HRESULT CBaseReferenceClock::AdviseThread()
               TEXT("CBaseRefClock::AdviseThread() Woke at = %lu ms"),
               ConvertToMilliseconds(rtNow) ));
 
-        // We must add in a millisecond, since this is the resolution of our
-        // WaitForSingleObject timer.  Failure to do so will cause us to loop
-        // franticly for (approx) 1 a millisecond.
-        m_rtNextAdvise = m_pSchedule->Advise( 10000 + rtNow );
-        LONGLONG llWait = m_rtNextAdvise - rtNow;
+        // How late the wait for the last advise time ended, in clock time
+        if (!bWoken && rtWait != MAX_TIME)
+        {
+            MSR_INTEGER(m_idAdviseLateness, int((rtNow - m_rtNextAdvise) / 10));
+        }
 
-        ASSERT( llWait > 0 );
+        m_rtNextAdvise = m_pSchedule->Advise( rtSlop + rtNow );
+        rtWait = m_rtNextAdvise == MAX_TIME ? MAX_TIME : m_rtNextAdvise - rtNow;
 
-        llWait = ConvertToMilliseconds(llWait);
-        // DON'T replace this with a max!! (The type's of these things is VERY important)
-        dwWait = (llWait > REFERENCE_TIME(UINT_MAX)) ? UINT_MAX : DWORD(llWait);
+        ASSERT( rtWait > 0 );
     };
     return NOERROR;
 }
 
+void CBaseReferenceClock::SetAdviseSpinTime(REFERENCE_TIME rtSpin)
+{
+    if (m_pWait) m_pWait->SetSpin(rtSpin);
+}
+
+REFERENCE_TIME CBaseReferenceClock::GetAdviseSpinTime() const
+{
+    return m_pWait ? m_pWait->GetSpin() : 0;
+}
+
 HRESULT CBaseReferenceClock::SetDefaultTimerResolution(
         REFERENCE_TIME timerResolution // in 100ns
     )
@@ -381,7 +394,7 @@ HRESULT CBaseReferenceClock::SetDefaultTimerResolution(
                             : 1;
         DWORD dwResolution = max( dwMinResolution, DWORD(timerResolution / 10000) );
         if( dwResolution != m_TimerResolution ) {
-            timeEndPeriod(m_TimerResolution);
+            if( m_TimerResolution ) timeEndPeriod(m_TimerResolution);
             m_TimerResolution = dwResolution;
             timeBeginPeriod( m_TimerResolution );
         }
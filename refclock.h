@@ -11,6 +11,9 @@
 #define __BASEREFCLOCK__
 
 #include <Schedule.h>
+#include "core/Clock.h"
+#include "core/ClockSeqlock.h"
+#include "core/DeadlineWait.h"
 
 const UINT RESOLUTION = 1;                      /* High resolution timer */
 const INT ADVISE_CACHE = 4;                     /* Default cache size */
@@ -54,8 +57,9 @@ inline LONGLONG WINAPI ConvertToMilliseconds(const REFERENCE_TIME& RT)
  * Each advise call defines a point in time when they wish to be notified.  A
  * periodic advise is a series of these such events.  We maintain a list of
  * advise links and calculate when the nearest event notification is due for.
- * We then call WaitForSingleObject with a timeout equal to this time.  The
- * handle we wait on is used by the class to signal that something has changed
+ * We then sleep on a high resolution waitable timer until this time, less a
+ * spin time we busy wait through (see SetAdviseSpinTime).  The handle we
+ * also wait on is used by the class to signal that something has changed
  * and that we must reschedule the next event.  This typically happens when
  * someone comes in and asks for an advise link while we are waiting for an
  * event to timeout.
@@ -93,8 +97,10 @@ public:
     // clock has gone backwards and GetTime time has halted until internal
     // time has caught up. (Don't know if this will be much use to folk,
     // but it seems odd not to use the return code for something useful.)
+    // GetTime takes no lock, any number of threads may call it at once; an
+    // overridden GetPrivateTime must be thread safe by itself.
     STDMETHODIMP GetTime(__out REFERENCE_TIME *pTime);
-    // When this is called, it sets m_rtLastGotTime to the time it returns.
+    // When this is called, it sets m_LastGotTime to the time it returns.
 
     /* Provide standard mechanisms for scheduling events */
 
@@ -148,15 +154,25 @@ public:
         __out REFERENCE_TIME* pTimerResolution // in 100ns
     );
 
+    // How long before an advise time the advise thread stops sleeping and
+    // spins, in 100ns.  0, the default, never spins; the high resolution
+    // timer alone is typically within 100us.  Without an advise thread (the
+    // derived class supplied the schedule) this does nothing.
+    void SetAdviseSpinTime(REFERENCE_TIME rtSpin);
+    REFERENCE_TIME GetAdviseSpinTime() const;
+
 private:
-    REFERENCE_TIME m_rtPrivateTime;     // Current best estimate of time
-    DWORD          m_dwPrevSystemTime;  // Last vaule we got from timeGetTime
-    REFERENCE_TIME m_rtLastGotTime;     // Last time returned by GetTime
+    // Our time as of the last adjustment, against the performance counter.
+    // Published under the object lock, GetPrivateTime reads it without.
+    CPerformanceClock m_SystemClock;
+    CClockSeqlock  m_Snapshot;
+    CMonotonicTime m_LastGotTime;       // Last time returned by GetTime
     REFERENCE_TIME m_rtNextAdvise;      // Time of next advise
     UINT           m_TimerResolution;
 
-#ifdef PERF
+#ifdef MSR_STATISTICS
     int m_idGetSystemTime;
+    int m_idAdviseLateness;             // Microseconds from advise time to wake up
 #endif
 
 // Thread stuff
@@ -170,6 +186,7 @@ public:
 private:
     BOOL           m_bAbort;            // Flag used for thread shutdown
     HANDLE         m_hThread;           // Thread handle
+    CDeadlineWait *m_pWait;             // What the thread waits on, ends when the schedule's event is set
 
     HRESULT AdviseThread();             // Method in which the advise thread runs
     static DWORD __stdcall AdviseThreadFunction(__in LPVOID); // Function used to get there
@@ -10,6 +10,8 @@
 #ifndef __CAMSchedule__
 #define __CAMSchedule__
 
+#include "core/AdviseHeap.h"
+
 class CAMSchedule : private CBaseObject
 {
 public:
@@ -34,87 +36,21 @@ public:
     HANDLE GetEvent() const { return m_ev; }
 
 private:
-    // We define the nodes that will be used in our singly linked list
-    // of advise packets.  The list is ordered by time, with the
-    // elements that will expire first at the front.
-    class CAdvisePacket
-    {
-    public:
-        CAdvisePacket()
-        {}
-
-        CAdvisePacket * m_next;
-        DWORD_PTR       m_dwAdviseCookie;
-        REFERENCE_TIME  m_rtEventTime;      // Time at which event should be set
-        REFERENCE_TIME  m_rtPeriod;         // Periodic time
-        HANDLE          m_hNotify;          // Handle to event or semephore
-        BOOL            m_bPeriodic;        // TRUE => Periodic event
-
-        CAdvisePacket( __inout_opt CAdvisePacket * next, LONGLONG time ) : m_next(next), m_rtEventTime(time)
-        {}
-
-        void InsertAfter( __inout CAdvisePacket * p )
-        {
-            p->m_next = m_next;
-            m_next    = p;
-        }
-
-        int IsZ() const // That is, is it the node that represents the end of the list
-        { return m_next == 0; }
-
-        CAdvisePacket * RemoveNext()
-        {
-            CAdvisePacket *const next = m_next;
-            CAdvisePacket *const new_next = next->m_next;
-            m_next = new_next;
-            return next;
-        }
-
-        void DeleteNext()
-        {
-            delete RemoveNext();
-        }
+    // Advise packets ordered by time in a binary heap, so adding,
+    // cancelling and rescheduling a periodic advise are O(log n) and a
+    // cookie finds its packet directly.  Packets are stored by value in
+    // arrays that keep their size, so like the packet cache of the linked
+    // list version, a clock stops allocating once it has seen its peak
+    // number of advises.
+    CAdviseHeap     m_Heap;
 
-        CAdvisePacket * Next() const
-        {
-            CAdvisePacket * result = m_next;
-            if (result->IsZ()) result = 0;
-            return result;
-        }
-
-        DWORD_PTR Cookie() const
-        { return m_dwAdviseCookie; }
-    };
-
-    // Structure is:
-    // head -> elmt1 -> elmt2 -> z -> null
-    // So an empty list is:       head -> z -> null
-    // Having head & z as links makes insertaion,
-    // deletion and shunting much easier.
-    CAdvisePacket   head, z;            // z is both a tail and a sentry
-
-    volatile DWORD_PTR  m_dwNextCookie;     // Strictly increasing
-    volatile DWORD  m_dwAdviseCount;    // Number of elements on list
+    volatile DWORD  m_dwAdviseCount;    // Number of packets in the heap
 
     CCritSec        m_Serialize;
 
-    // AddAdvisePacket: adds the packet, returns the cookie (0 if failed)
-    DWORD_PTR AddAdvisePacket( __inout CAdvisePacket * pPacket );
     // Event that we should set if the packed added above will be the next to fire.
     const HANDLE m_ev;
 
-    // A Shunt is where we have changed the first element in the
-    // list and want it re-evaluating (i.e. repositioned) in
-    // the list.
-    void ShuntHead();
-
-    // Rather than delete advise packets, we cache them for future use
-    CAdvisePacket * m_pAdviseCache;
-    DWORD           m_dwCacheCount;
-    enum { dwCacheMax = 5 };             // Don't bother caching more than five
-
-    void Delete( __inout CAdvisePacket * pLink );// This "Delete" will cache the Link
-
 // Attributes and methods for debugging
 public:
 #ifdef DEBUG
@@ -12,7 +12,8 @@
 #define __SYSTEMCLOCK__
 
 //
-// Base clock.  Uses timeGetTime ONLY
+// Base clock.  Uses the performance counter ONLY (CPerformanceClock), in
+// 100ns with no wrap, and is adjusted through IAMClockAdjust
 // Uses most of the code in the base reference clock.
 // Provides GetTime
 //
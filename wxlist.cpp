@@ -40,6 +40,11 @@
    without danger of creating a dangling reference if the original cache goes
    away.
 
+   Nodes missing from a cache, or not fitting in it, come from and go back
+   to a pool of node sized blocks shared by all lists (core/BlockPool.h),
+   with a magazine of free nodes per thread, so a list growing past its
+   cache doesn't hit the heap for every node.
+
    Questionable design decisions:
    1. Retaining the warts for compatibility
    2. Keeping an element count -i.e. counting whenever we do anything
@@ -51,6 +56,8 @@
 
 
 #include <streams.h>
+#include <new>
+#include "core/BlockPool.h"
 
 /* set cursor to the position of each element of list in turn  */
 #define INTERNALTRAVERSELIST(list, cursor)               \
@@ -69,6 +76,35 @@ for ( cursor = (list).GetTailPositionI()           \
     ; cursor = (list).Prev(cursor)                \
     )
 
+/* The pool of list nodes, made by the first node allocated */
+static CBlockPool *NodePool()
+{
+    static CBlockPool *pPool = CBlockPool::Get(sizeof(CBaseList::CNode));
+    return pPool;
+}
+
+void *CBaseList::CNode::operator new(size_t cb) throw()
+{
+    CBlockPool *pPool = NodePool();
+    if (pPool == NULL || cb > pPool->BlockSize()) {
+        return ::operator new(cb, std::nothrow);
+    }
+    return pPool->Allocate();
+}
+
+void CBaseList::CNode::operator delete(__in_opt void *pv, size_t cb)
+{
+    if (pv == NULL) {
+        return;
+    }
+    CBlockPool *pPool = NodePool();
+    if (pPool == NULL || cb > pPool->BlockSize()) {
+        ::operator delete(pv);
+        return;
+    }
+    pPool->Free(pv);
+}
+
 /* Constructor calls a separate initialisation function that
    creates a node cache, optionally creates a lock object
    and optionally creates a signaling object.
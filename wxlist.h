@@ -116,6 +116,12 @@ public:
 
         /* Set the pointer to the object for this node */
         void SetData(__in void *p) { m_pObject = p; };
+
+
+        /* Nodes come from a pool shared by every list rather than the
+           heap, NULL when out of memory */
+        void *operator new(size_t cb) throw();
+        void operator delete(__in_opt void *pv, size_t cb);
     };
 
     class CNodeCache
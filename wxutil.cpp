@@ -457,13 +457,14 @@ HRESULT AMSafeMemMoveOffset(
 }
 
 
-#ifdef DEBUG
+#if defined(DEBUG) || defined(LOCKSTATS)
 /******************************Public*Routine******************************\
-* Debug CCritSec helpers
+* Debug and LOCKSTATS CCritSec helpers
 *
 * We provide debug versions of the Constructor, destructor, Lock and Unlock
 * routines.  The debug code tracks who owns each critical section by
-* maintaining a depth count.
+* maintaining a depth count.  The LOCKSTATS code times the waits and holds
+* of named critical sections.
 *
 * History:
 *
@@ -472,8 +473,14 @@ HRESULT AMSafeMemMoveOffset(
 CCritSec::CCritSec()
 {
     InitializeCriticalSection(&m_CritSec);
+#ifdef DEBUG
     m_currentOwner = m_lockCount = 0;
     m_fTrace = FALSE;
+#endif
+#ifdef LOCKSTATS
+    m_idLockWait = m_idLockHold = 0;
+    m_holdCount = 0;
+#endif
 }
 
 CCritSec::~CCritSec()
@@ -483,6 +490,7 @@ CCritSec::~CCritSec()
 
 void CCritSec::Lock()
 {
+#ifdef DEBUG
     UINT tracelevel=3;
     DWORD us = GetCurrentThreadId();
     DWORD currentOwner = m_currentOwner;
@@ -497,7 +505,25 @@ void CCritSec::Lock()
 	        // critical section
         }
     }
+#endif
+
+#ifdef LOCKSTATS
+    if (m_idLockWait == 0) {
+        EnterCriticalSection(&m_CritSec);
+    } else if (!TryEnterCriticalSection(&m_CritSec)) {
+        // Contended, owned by another thread
+        Msr_Start(m_idLockWait);
+        EnterCriticalSection(&m_CritSec);
+        Msr_Stop(m_idLockWait);
+    }
+    if (m_idLockHold && 0 == m_holdCount++) {
+        Msr_Start(m_idLockHold);
+    }
+#else
     EnterCriticalSection(&m_CritSec);
+#endif
+
+#ifdef DEBUG
     if (0 == m_lockCount++) {
         // we now own it for the first time.  Set owner information
         m_currentOwner = us;
@@ -506,9 +532,11 @@ void CCritSec::Lock()
             DbgLog((LOG_LOCKING, tracelevel, TEXT("Thread %d now owns lock %x"), m_currentOwner, &m_CritSec));
         }
     }
+#endif
 }
 
 void CCritSec::Unlock() {
+#ifdef DEBUG
     if (0 == --m_lockCount) {
         // about to be unowned
         if (m_fTrace) {
@@ -517,9 +545,31 @@ void CCritSec::Unlock() {
 
         m_currentOwner = 0;
     }
+#endif
+#ifdef LOCKSTATS
+    // Zero when the lock was named while held
+    if (m_holdCount && 0 == --m_holdCount) {
+        Msr_Stop(m_idLockHold);
+    }
+#endif
     LeaveCriticalSection(&m_CritSec);
 }
 
+#endif
+
+#ifdef LOCKSTATS
+void WINAPI LockStatsName(CCritSec * pcCrit, LPCTSTR pName)
+{
+    TCHAR szName[128];
+
+    (void)StringCchPrintf(szName, NUMELMS(szName), TEXT("%s wait"), pName);
+    pcCrit->m_idLockWait = Msr_Register(szName);
+    (void)StringCchPrintf(szName, NUMELMS(szName), TEXT("%s hold"), pName);
+    pcCrit->m_idLockHold = Msr_Register(szName);
+}
+#endif
+
+#ifdef DEBUG
 void WINAPI DbgLockTrace(CCritSec * pcCrit, BOOL fTrace)
 {
     pcCrit->m_fTrace = fTrace;
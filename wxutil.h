@@ -24,11 +24,20 @@ class CCritSec {
 
     CRITICAL_SECTION m_CritSec;
 
-#ifdef DEBUG
+#ifdef LOCKSTATS
+public:
+    int     m_idLockWait;    // MSR ids, 0 until named with LockStatsName
+    int     m_idLockHold;
+    DWORD   m_holdCount;     // recursion depth of the timed hold
+#endif
+
+#if defined(DEBUG) || defined(LOCKSTATS)
 public:
+#ifdef DEBUG
     DWORD   m_currentOwner;
     DWORD   m_lockCount;
     BOOL    m_fTrace;        // Trace this one
+#endif
 public:
     CCritSec();
     ~CCritSec();
@@ -77,6 +86,21 @@ public:
     #define DbgLockTrace(pc, fT)
 #endif
 
+//
+// Lock contention statistics, compiled in when LOCKSTATS is defined.  Once a
+// critical section is given a name, every acquisition records how long it
+// was held, and acquisitions that found it owned by another thread also
+// record how long they waited.  The counts and times go to the MSR_
+// statistics as "<name> hold" and "<name> wait", see Msr_DumpStats.  Locks
+// sharing a name are reported together.
+//
+
+#ifdef LOCKSTATS
+    void WINAPI LockStatsName(CCritSec * pcCrit, LPCTSTR pName);
+#else
+    #define LockStatsName(pc, name)
+#endif
+
 
 // locks a critical section, and unlocks it automatically
 // when the lock goes out of scope